@@ -0,0 +1,259 @@
+#include "audio.h"
+#include "sound_cache.h"
+#include <string.h>
+
+// A trigger that would start further ahead of the output than this (about
+// two frames) means the emulator is running faster than real time, so the
+// clock is re-anchored instead of letting latency build up
+#define AUDIO_MAX_AHEAD (2 * AUDIO_RATE / FRAMES_PER_SECOND)
+
+static audio_mixer mixer;
+static SDL_AudioDeviceID device = 0;
+static SDL_atomic_t device_open;
+
+void
+audio_mixer_init(audio_mixer *mixer)
+{
+  memset(mixer, 0, sizeof(*mixer));
+  SDL_AtomicSet(&mixer->head, 0);
+  SDL_AtomicSet(&mixer->tail, 0);
+}
+
+// Producer side, returns false (and drops the trigger) if the ring is full
+bool
+audio_mixer_push(audio_mixer *mixer, const audio_trigger *trigger)
+{
+  int head = SDL_AtomicGet(&mixer->head);
+  int tail = SDL_AtomicGet(&mixer->tail);
+
+  if (head - tail >= AUDIO_QUEUE_SIZE)
+    {
+      return false;
+    }
+
+  mixer->queue[head & AUDIO_QUEUE_MASK] = *trigger;
+
+  // make the slot visible before publishing the new head
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&mixer->head, head + 1);
+  return true;
+}
+
+static bool
+trigger_peek(audio_mixer *mixer, audio_trigger *trigger)
+{
+  int tail = SDL_AtomicGet(&mixer->tail);
+
+  if (SDL_AtomicGet(&mixer->head) == tail)
+    {
+      return false;
+    }
+
+  SDL_MemoryBarrierAcquire();
+  *trigger = mixer->queue[tail & AUDIO_QUEUE_MASK];
+  return true;
+}
+
+static void
+anchor(audio_mixer *mixer, uint64_t cycle, uint64_t sample)
+{
+  mixer->anchored = true;
+  mixer->anchor_cycle = cycle;
+  mixer->anchor_sample = sample;
+}
+
+/*
+Offset into the buffer being rendered at which a trigger takes effect, or
+frames if it belongs to a later buffer. A trigger that is already late plays
+now and moves the anchor with it, so the ones after it keep their spacing.
+Cycles going backwards (a loaded state or a rollback) also re-anchor.
+*/
+static int
+trigger_offset(audio_mixer *mixer, const audio_trigger *trigger, int position,
+               int frames)
+{
+  uint64_t now = mixer->buffer_start + position;
+
+  if (!mixer->anchored || trigger->cycle < mixer->anchor_cycle)
+    {
+      anchor(mixer, trigger->cycle, now);
+    }
+
+  uint64_t when = mixer->anchor_sample
+                  + (trigger->cycle - mixer->anchor_cycle) * AUDIO_RATE
+                        / CLOCK_SPEED_HZ;
+  if (when < now || when - now > AUDIO_MAX_AHEAD)
+    {
+      anchor(mixer, trigger->cycle, now);
+      when = now;
+    }
+
+  if (when >= mixer->buffer_start + frames)
+    {
+      return frames;
+    }
+  return (int)(when - mixer->buffer_start);
+}
+
+static void
+apply_trigger(audio_mixer *mixer, const audio_trigger *trigger)
+{
+  audio_voice *voice = &mixer->voices[trigger->sound];
+
+  if (!trigger->start)
+    {
+      voice->playing = false;
+      return;
+    }
+  if (trigger->sample == NULL || trigger->sample->length == 0)
+    {
+      return;
+    }
+  voice->sample = trigger->sample;
+  voice->position = 0;
+  voice->playing = true;
+  voice->loop = trigger->loop;
+}
+
+static void
+mix(audio_mixer *mixer, int16_t *out, int count)
+{
+  for (int i = 0; i < count; i++)
+    {
+      int32_t sum = 0;
+      for (int sound = 0; sound < NUM_SOUNDS; sound++)
+        {
+          audio_voice *voice = &mixer->voices[sound];
+          if (!voice->playing)
+            {
+              continue;
+            }
+          sum += voice->sample->data[voice->position++];
+          if (voice->position >= voice->sample->length)
+            {
+              voice->position = 0;
+              voice->playing = voice->loop;
+            }
+        }
+      if (sum > INT16_MAX)
+        {
+          sum = INT16_MAX;
+        }
+      else if (sum < INT16_MIN)
+        {
+          sum = INT16_MIN;
+        }
+      out[i] = (int16_t)sum;
+    }
+}
+
+// Consumer side: fill out with frames samples, starting and stopping voices
+// at the exact sample their triggers map to
+void
+audio_mixer_render(audio_mixer *mixer, int16_t *out, int frames)
+{
+  int position = 0;
+
+  while (position < frames)
+    {
+      int until = frames;
+      audio_trigger trigger;
+
+      if (trigger_peek(mixer, &trigger))
+        {
+          int offset = trigger_offset(mixer, &trigger, position, frames);
+          if (offset <= position)
+            {
+              apply_trigger(mixer, &trigger);
+              SDL_AtomicAdd(&mixer->tail, 1);
+              continue;
+            }
+          until = offset;
+        }
+
+      mix(mixer, out + position, until - position);
+      position = until;
+    }
+  mixer->buffer_start += frames;
+}
+
+static void
+audio_callback(void *userdata, Uint8 *stream, int len)
+{
+  audio_mixer_render(userdata, (int16_t *)stream,
+                     len / (int)sizeof(int16_t));
+}
+
+// Start the output device and decode every sample up front, so no trigger
+// from the emulation thread ever waits on SDL_LoadWAV or a conversion. A
+// device that fails to open leaves the emulator silent and loads nothing.
+bool
+audio_open(void)
+{
+  SDL_AudioSpec want;
+
+  audio_mixer_init(&mixer);
+
+  memset(&want, 0, sizeof(want));
+  want.freq = AUDIO_RATE;
+  want.format = AUDIO_S16SYS;
+  want.channels = 1;
+  want.samples = AUDIO_BUFFER_SAMPLES;
+  want.callback = audio_callback;
+  want.userdata = &mixer;
+
+  // no allowed changes, SDL converts to whatever the hardware wants
+  device = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+  if (device == 0)
+    {
+      fprintf(stderr, "Could not open audio device: %s\n", SDL_GetError());
+      return false;
+    }
+
+  sound_cache_preload();
+  SDL_AtomicSet(&device_open, 1);
+  SDL_PauseAudioDevice(device, 0);
+  return true;
+}
+
+void
+audio_close(void)
+{
+  if (!SDL_AtomicGet(&device_open))
+    {
+      return;
+    }
+  SDL_AtomicSet(&device_open, 0);
+  // the callback has stopped, no voice can point into the cache any more
+  SDL_CloseAudioDevice(device);
+  device = 0;
+  sound_cache_free();
+}
+
+// Emulation thread side, never blocks: a full ring drops the trigger
+void
+audio_play(uint8_t sound, uint64_t cycle, bool loop)
+{
+  if (!SDL_AtomicGet(&device_open))
+    {
+      return;
+    }
+  const audio_sample *sample = sound_get(sound);
+  if (sample == NULL)
+    {
+      return;
+    }
+  audio_trigger trigger = { cycle, sound, true, loop, sample };
+  audio_mixer_push(&mixer, &trigger);
+}
+
+void
+audio_stop(uint8_t sound, uint64_t cycle)
+{
+  if (!SDL_AtomicGet(&device_open))
+    {
+      return;
+    }
+  audio_trigger trigger = { cycle, sound, false, false, NULL };
+  audio_mixer_push(&mixer, &trigger);
+}
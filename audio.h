@@ -0,0 +1,89 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "emulator.h"
+
+// Output format: 16-bit mono at 44.1 kHz
+#define AUDIO_RATE 44100 // NOLINT
+
+// Samples per device buffer, 256 is about 5.8 ms at 44.1 kHz
+#define AUDIO_BUFFER_SAMPLES 256 // NOLINT
+
+// Number of slots in the trigger ring, must be a power of two
+#define AUDIO_QUEUE_SIZE 256 // NOLINT
+#define AUDIO_QUEUE_MASK (AUDIO_QUEUE_SIZE - 1)
+
+// Sounds, one per sound circuit on the board
+enum audio_sound
+{
+  SOUND_UFO,          // port 3 bit 0, loops for as long as the bit is set
+  SOUND_SHOT,         // port 3 bit 1
+  SOUND_PLAYER_DIES,  // port 3 bit 2
+  SOUND_INVADER_DIES, // port 3 bit 3
+  SOUND_FLEET_1,      // port 5 bits 0-3, the four marching notes
+  SOUND_FLEET_2,
+  SOUND_FLEET_3,
+  SOUND_FLEET_4,
+  SOUND_UFO_HIT, // port 5 bit 4
+  NUM_SOUNDS
+};
+
+// PCM already converted to the output format
+typedef struct
+{
+  const int16_t *data;
+  uint32_t length;
+} audio_sample;
+
+typedef struct
+{
+  const audio_sample *sample;
+  uint32_t position;
+  bool playing;
+  bool loop;
+} audio_voice;
+
+// A start or stop request, stamped with the CPU cycle of the OUT that made it.
+// Starts carry the sample to play, which must outlive the voice.
+typedef struct
+{
+  uint64_t cycle;
+  uint8_t sound;
+  bool start;
+  bool loop;
+  const audio_sample *sample;
+} audio_trigger;
+
+/*
+Mixer run from the SDL audio callback. The emulation thread only pushes
+triggers into a lock-free single producer / single consumer ring, the
+callback owns everything else. Trigger cycles are mapped onto the output
+sample clock through an anchor (a cycle and the sample it played at), so
+sounds start with the same spacing the ROM gave them, to the sample.
+*/
+typedef struct
+{
+  audio_voice voices[NUM_SOUNDS];
+  audio_trigger queue[AUDIO_QUEUE_SIZE];
+  SDL_atomic_t head;
+  SDL_atomic_t tail;
+
+  // Callback side clock: sample number of the start of the current buffer
+  uint64_t buffer_start;
+  bool anchored;
+  uint64_t anchor_cycle;
+  uint64_t anchor_sample;
+} audio_mixer;
+
+void audio_mixer_init(audio_mixer *mixer);
+bool audio_mixer_push(audio_mixer *mixer, const audio_trigger *trigger);
+void audio_mixer_render(audio_mixer *mixer, int16_t *out, int frames);
+
+// The process-wide output device, triggers are ignored (and no sample is ever
+// loaded) while it is closed
+bool audio_open(void);
+void audio_close(void);
+void audio_play(uint8_t sound, uint64_t cycle, bool loop);
+void audio_stop(uint8_t sound, uint64_t cycle);
+
+#endif
@@ -0,0 +1,237 @@
+#include "emulator.h"
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+Runs CP/M programs, such as the 8080 exercisers (cpudiag, 8080PRE, 8080EXM,
+TST8080), headless and as fast as the host allows. Just enough of CP/M is
+there for them: the program is loaded at 0x0100, a CALL 5 is caught to print
+through the BDOS console functions, and a jump to 0x0000 (warm boot) ends it.
+*/
+
+// Where CP/M loads a program, the start of the transient program area
+#define TPA_START 0x0100 // NOLINT
+
+// BDOS entry point, the function number is in C
+#define BDOS_ENTRY 0x0005 // NOLINT
+
+// End of the TPA, kept after the entry as CP/M does; programs put their stack
+// below it
+#define BDOS_TOP 0xF000 // NOLINT
+
+// Warm boot, a program is done once it gets here
+#define WARM_BOOT 0x0000
+
+// BDOS functions
+#define BDOS_CONSOLE_OUTPUT 2 // E is the character
+#define BDOS_PRINT_STRING 9   // DE points to a '$' terminated string
+
+// Longest line of output checked for failure messages, longer ones are cut
+#define MAX_LINE_LENGTH 256 // NOLINT
+
+// Opcodes placed in low memory
+#define OPCODE_RET 0xC9 // NOLINT
+
+// What the programs print when something is wrong
+static const char *failure_words[] = { "ERROR", "FAIL" };
+
+typedef struct
+{
+  char line[MAX_LINE_LENGTH];
+  size_t length;
+  bool failed;
+} console;
+
+// Print a character, watching each line for a failure message
+static void
+console_put(console *out, char c)
+{
+  putchar(c);
+
+  if (c != '\n' && out->length < MAX_LINE_LENGTH - 1)
+    {
+      out->line[out->length++] = c;
+      return;
+    }
+  out->line[out->length] = '\0';
+  for (size_t i = 0; i < sizeof(failure_words) / sizeof(*failure_words); i++)
+    {
+      if (strstr(out->line, failure_words[i]) != NULL)
+        {
+          out->failed = true;
+        }
+    }
+  out->length = 0;
+}
+
+// Called at BDOS_ENTRY, before the RET there takes the program back
+static void
+bdos_call(i8080 *cpu, console *out)
+{
+  switch (cpu->c)
+    {
+    case BDOS_CONSOLE_OUTPUT:
+      console_put(out, (char)cpu->e);
+      break;
+    case BDOS_PRINT_STRING:
+      {
+        uint16_t address = cpu->de;
+        char c = 0;
+
+        while ((c = (char)cpu_read_mem(cpu, address++)) != '$')
+          {
+            console_put(out, c);
+          }
+        break;
+      }
+    default:
+      fprintf(stderr, "Unsupported BDOS function %u\n", cpu->c);
+      break;
+    }
+}
+
+static double
+seconds_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9; // NOLINT
+}
+
+/*
+Run one program to its warm boot. It passes if it gets there without printing
+a failure message, stopping on an unimplemented opcode, halting or running
+past max_cycles (0 for no limit).
+*/
+static bool
+run_program(const char *path, bool lazy, uint64_t max_cycles)
+{
+  static i8080 cpu;
+  console out = { .length = 0, .failed = false };
+  uint64_t instructions = 0;
+  const char *stopped = NULL;
+
+  cpu_init(&cpu);
+  cpu_set_lazy_flags(&cpu, lazy);
+  if (!cpu_load_file(&cpu, path, TPA_START))
+    {
+      return false;
+    }
+
+  // a RET at the BDOS entry, the top of memory after it, and a return
+  // address of 0 on the stack for programs that end with RET
+  cpu.memory[BDOS_ENTRY] = OPCODE_RET;
+  cpu.memory[BDOS_ENTRY + 1] = BDOS_TOP & LOWER_8_BIT_MASK;
+  cpu.memory[BDOS_ENTRY + 2] = BDOS_TOP >> BYTE;
+  cpu.sp = BDOS_TOP - 2;
+  cpu.pc = TPA_START;
+
+  printf("%s:\n", path);
+  double start = seconds_now();
+  while (cpu.pc != WARM_BOOT)
+    {
+      if (cpu.pc == BDOS_ENTRY)
+        {
+          bdos_call(&cpu, &out);
+        }
+
+      int cycles = execute_instruction(&cpu, cpu_read_mem(&cpu, cpu.pc));
+      if (cycles < 0)
+        {
+          stopped = "unimplemented opcode";
+          break;
+        }
+      cpu.cycles += cycles;
+      instructions++;
+
+      if (cpu.halted)
+        {
+          stopped = "halted";
+          break;
+        }
+      if (max_cycles != 0 && cpu.cycles >= max_cycles)
+        {
+          stopped = "cycle limit reached";
+          break;
+        }
+    }
+  double elapsed = seconds_now() - start;
+
+  if (out.length > 0)
+    {
+      console_put(&out, '\n');
+    }
+
+  bool passed = stopped == NULL && !out.failed;
+  printf("%s: %s", path, passed ? "PASS" : "FAIL");
+  if (stopped != NULL)
+    {
+      printf(" (%s at 0x%04x)", stopped, cpu.pc);
+    }
+  printf(", %" PRIu64 " instructions, %" PRIu64 " cycles in %.2f s, "
+         "%.1f MHz\n",
+         instructions, cpu.cycles, elapsed,
+         elapsed > 0 ? cpu.cycles / elapsed / 1e6 : 0); // NOLINT
+  fflush(stdout);
+  return passed;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static const struct option long_options[]
+      = { { "lazy-flags", no_argument, NULL, 'l' },
+          { "max-cycles", required_argument, NULL, 'c' },
+          { NULL, 0, NULL, 0 } };
+  bool lazy = false;
+  uint64_t max_cycles = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+      switch (opt)
+        {
+        case 'l':
+          lazy = true;
+          break;
+        case 'c':
+          {
+            char *end = NULL;
+            max_cycles = strtoull(optarg, &end, 0);
+            if (*optarg == '\0' || *end != '\0' || optarg[0] == '-')
+              {
+                fprintf(stderr, "Invalid cycle count: %s\n", optarg);
+                exit(EXIT_FAILURE);
+              }
+            break;
+          }
+        default:
+          exit(EXIT_FAILURE);
+        }
+    }
+
+  if (optind >= argc)
+    {
+      fprintf(stderr, "Please provide one or more CP/M programs!\n");
+      exit(EXIT_FAILURE);
+    }
+
+  int failures = 0;
+  for (int i = optind; i < argc; i++)
+    {
+      if (!run_program(argv[i], lazy, max_cycles))
+        {
+          failures++;
+        }
+    }
+
+  printf("%d of %d passed\n", argc - optind - failures, argc - optind);
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -5,904 +5,1071 @@
  * Citation: derived from http://www.emulator101.com/disassembler-pt-1.html
  */
 
+#include "opcodes.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
-int
-disassemble_8080(unsigned char *buffer, int counter)
-{
-  unsigned char *op_code = &buffer[counter];
-  int num_op_bytes = 1;
-  printf("%04x ", counter);
-
-  // Chart From: http://www.emulator101.com/reference/8080-by-opcode.html
-  switch (*op_code)
-    {
-    case 0x00:
-      printf("NOP");
-      break;
-    case 0x01:
-      printf("LXI B,#$%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0x02:
-      printf("STAX B");
-      break;
-    case 0x03:
-      printf("INX B");
-      break;
-    case 0x04:
-      printf("INR B");
-      break;
-    case 0x05:
-      printf("DCR B");
-      break;
-    case 0x06:
-      printf("MVI B,#$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0x07:
-      printf("RLC");
-      break;
-    case 0x08:
-      printf("");
-      break;
-    case 0x09:
-      printf("DAD B");
-      break;
-    case 0x0a:
-      printf("LDAX B");
-      break;
-    case 0x0b:
-      printf("DCX B");
-      break;
-    case 0x0c:
-      printf("INR C");
-      break;
-    case 0x0d:
-      printf("DCR C");
-      break;
-    case 0x0e:
-      printf("MVI C,#$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0x0f:
-      printf("RRC");
-      break;
-    case 0x10:
-      printf("");
-      break;
-    case 0x11:
-      printf("LXI D,#$%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0x12:
-      printf("STAX D");
-      break;
-    case 0x13:
-      printf("INX D");
-      break;
-    case 0x14:
-      printf("INR D");
-      break;
-    case 0x15:
-      printf("DCR D");
-      break;
-    case 0x16:
-      printf("MVI D,#$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0x17:
-      printf("RAL");
-      break;
-    case 0x18:
-      printf("");
-      break;
-    case 0x19:
-      printf("DAD D");
-      break;
-    case 0x1a:
-      printf("LDAX D");
-      break;
-    case 0x1b:
-      printf("DCX D");
-      break;
-    case 0x1c:
-      printf("INR E");
-      break;
-    case 0x1d:
-      printf("DCR E");
-      break;
-    case 0x1e:
-      printf("MVI E,#$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0x1f:
-      printf("RAR");
-      break;
-    case 0x20:
-      printf("");
-      break;
-    case 0x21:
-      printf("LXI H,#$%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0x22:
-      printf("SHLD $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0x23:
-      printf("INX H");
-      break;
-    case 0x24:
-      printf("INR H");
-      break;
-    case 0x25:
-      printf("DCR H");
-      break;
-    case 0x26:
-      printf("MVI H,#$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0x27:
-      printf("DAA");
-      break;
-    case 0x28:
-      printf("");
-      break;
-    case 0x29:
-      printf("DAD H");
-      break;
-    case 0x2a:
-      printf("LHLD $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0x2b:
-      printf("DCX H");
-      break;
-    case 0x2c:
-      printf("INR L");
-      break;
-    case 0x2d:
-      printf("DCR L");
-      break;
-    case 0x2e:
-      printf("MVI L,#$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0x2f:
-      printf("CMA");
-      break;
-    case 0x30:
-      printf("");
-      break;
-    case 0x31:
-      printf("LXI SP,#$%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0x32:
-      printf("STA $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0x33:
-      printf("INX P");
-      break;
-    case 0x34:
-      printf("INR M");
-      break;
-    case 0x35:
-      printf("DCR M");
-      break;
-    case 0x36:
-      printf("MVI M,#$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0x37:
-      printf("STC");
-      break;
-    case 0x38:
-      printf("");
-      break;
-    case 0x39:
-      printf("DAD SP");
-      break;
-    case 0x3a:
-      printf("LDA $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0x3b:
-      printf("DCX SCP");
-      break;
-    case 0x3c:
-      printf("INR A");
-      break;
-    case 0x3d:
-      printf("DCR A");
-      break;
-    case 0x3e:
-      printf("MVI A,#$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0x3f:
-      printf("CMC");
-      break;
-    case 0x40:
-      printf("MOV B,B");
-      break;
-    case 0x41:
-      printf("MOV B,C");
-      break;
-    case 0x42:
-      printf("MOV B,D");
-      break;
-    case 0x43:
-      printf("MOV B,E");
-      break;
-    case 0x44:
-      printf("MOV B,H");
-      break;
-    case 0x45:
-      printf("MOV B,L");
-      break;
-    case 0x46:
-      printf("MOV B,M");
-      break;
-    case 0x47:
-      printf("MOV B,A");
-      break;
-    case 0x48:
-      printf("MOV C,B");
-      break;
-    case 0x49:
-      printf("MOV C,C");
-      break;
-    case 0x4a:
-      printf("MOV C,D");
-      break;
-    case 0x4b:
-      printf("MOV C,E");
-      break;
-    case 0x4c:
-      printf("MOV C,H");
-      break;
-    case 0x4d:
-      printf("MOV C,L");
-      break;
-    case 0x4e:
-      printf("MOV C,M");
-      break;
-    case 0x4f:
-      printf("MOV C,A");
-      break;
-    case 0x50:
-      printf("MOV D,B");
-      break;
-    case 0x51:
-      printf("MOV D,C");
-      break;
-    case 0x52:
-      printf("MOV D,D");
-      break;
-    case 0x53:
-      printf("MOV D,E");
-      break;
-    case 0x54:
-      printf("MOV D,H");
-      break;
-    case 0x55:
-      printf("MOV D,L");
-      break;
-    case 0x56:
-      printf("MOV D,M");
-      break;
-    case 0x57:
-      printf("MOV D,A");
-      break;
-    case 0x58:
-      printf("MOV E,B");
-      break;
-    case 0x59:
-      printf("MOV E,C");
-      break;
-    case 0x5a:
-      printf("MOV E,D");
-      break;
-    case 0x5b:
-      printf("MOV E,E");
-      break;
-    case 0x5c:
-      printf("MOV E,H");
-      break;
-    case 0x5d:
-      printf("MOV E,L");
-      break;
-    case 0x5e:
-      printf("MOV E,M");
-      break;
-    case 0x5f:
-      printf("MOV E,A");
-      break;
-    case 0x60:
-      printf("MOV H,B");
-      break;
-    case 0x61:
-      printf("MOV H,C");
-      break;
-    case 0x62:
-      printf("MOV H,D");
-      break;
-    case 0x63:
-      printf("MOV H,E");
-      break;
-    case 0x64:
-      printf("MOV H,H");
-      break;
-    case 0x65:
-      printf("MOV H,L");
-      break;
-    case 0x66:
-      printf("MOV H,M");
-      break;
-    case 0x67:
-      printf("MOV H,A");
-      break;
-    case 0x68:
-      printf("MOV L,B");
-      break;
-    case 0x69:
-      printf("MOV L,C");
-      break;
-    case 0x6a:
-      printf("MOV L,D");
-      break;
-    case 0x6b:
-      printf("MOV L,E");
-      break;
-    case 0x6c:
-      printf("MOV L,H");
-      break;
-    case 0x6d:
-      printf("MOV L,L");
-      break;
-    case 0x6e:
-      printf("MOV L,M");
-      break;
-    case 0x6f:
-      printf("MOV L,A");
-      break;
-    case 0x70:
-      printf("MOV M,B");
-      break;
-    case 0x71:
-      printf("MOV M,C");
-      break;
-    case 0x72:
-      printf("MOV M,D");
-      break;
-    case 0x73:
-      printf("MOV M,E");
-      break;
-    case 0x74:
-      printf("MOV M,H");
-      break;
-    case 0x75:
-      printf("MOV M,L");
-      break;
-    case 0x76:
-      printf("HLT");
-      break;
-    case 0x77:
-      printf("MOV M,A");
-      break;
-    case 0x78:
-      printf("MOV A,B");
-      break;
-    case 0x79:
-      printf("MOV A,C");
-      break;
-    case 0x7a:
-      printf("MOV A,D");
-      break;
-    case 0x7b:
-      printf("MOV A,E");
-      break;
-    case 0x7c:
-      printf("MOV A,H");
-      break;
-    case 0x7d:
-      printf("MOV A,L");
-      break;
-    case 0x7e:
-      printf("MOV A,M");
-      break;
-    case 0x7f:
-      printf("MOV A,A");
-      break;
-    case 0x80:
-      printf("ADD B");
-      break;
-    case 0x81:
-      printf("ADD C");
-      break;
-    case 0x82:
-      printf("ADD D");
-      break;
-    case 0x83:
-      printf("ADD E");
-      break;
-    case 0x84:
-      printf("ADD H");
-      break;
-    case 0x85:
-      printf("ADD L");
-      break;
-    case 0x86:
-      printf("ADD M");
-      break;
-    case 0x87:
-      printf("ADD A");
-      break;
-    case 0x88:
-      printf("ADC B");
-      break;
-    case 0x89:
-      printf("ADC C");
-      break;
-    case 0x8a:
-      printf("ADC D");
-      break;
-    case 0x8b:
-      printf("ADC E");
-      break;
-    case 0x8c:
-      printf("ADC H");
-      break;
-    case 0x8d:
-      printf("ADC L");
-      break;
-    case 0x8e:
-      printf("ADC M");
-      break;
-    case 0x8f:
-      printf("ADC A");
-      break;
-    case 0x90:
-      printf("SUB B");
-      break;
-    case 0x91:
-      printf("SUB C");
-      break;
-    case 0x92:
-      printf("SUB D");
-      break;
-    case 0x93:
-      printf("SUB E");
-      break;
-    case 0x94:
-      printf("SUB H");
-      break;
-    case 0x95:
-      printf("SUB L");
-      break;
-    case 0x96:
-      printf("SUB M");
-      break;
-    case 0x97:
-      printf("SUB A");
-      break;
-    case 0x98:
-      printf("SBB B");
-      break;
-    case 0x99:
-      printf("SBB C");
-      break;
-    case 0x9a:
-      printf("SBB D");
-      break;
-    case 0x9b:
-      printf("SBB E");
-      break;
-    case 0x9c:
-      printf("SBB H");
-      break;
-    case 0x9d:
-      printf("SBB L");
-      break;
-    case 0x9e:
-      printf("SBB M");
-      break;
-    case 0x9f:
-      printf("SBB A");
-      break;
-    case 0xa0:
-      printf("ANA B");
-      break;
-    case 0xa1:
-      printf("ANA C");
-      break;
-    case 0xa2:
-      printf("ANA D");
-      break;
-    case 0xa3:
-      printf("ANA E");
-      break;
-    case 0xa4:
-      printf("ANA H");
-      break;
-    case 0xa5:
-      printf("ANA L");
-      break;
-    case 0xa6:
-      printf("ANA M");
-      break;
-    case 0xa7:
-      printf("ANA A");
-      break;
-    case 0xa8:
-      printf("XRA B");
-      break;
-    case 0xa9:
-      printf("XRA C");
-      break;
-    case 0xaa:
-      printf("XRA D");
-      break;
-    case 0xab:
-      printf("XRA E");
-      break;
-    case 0xac:
-      printf("XRA H");
-      break;
-    case 0xad:
-      printf("XRA L");
-      break;
-    case 0xae:
-      printf("XRA M");
-      break;
-    case 0xaf:
-      printf("XRA A");
-      break;
-    case 0xb0:
-      printf("ORA B");
-      break;
-    case 0xb1:
-      printf("ORA C");
-      break;
-    case 0xb2:
-      printf("ORA D");
-      break;
-    case 0xb3:
-      printf("ORA E");
-      break;
-    case 0xb4:
-      printf("ORA H");
-      break;
-    case 0xb5:
-      printf("ORA L");
-      break;
-    case 0xb6:
-      printf("ORA M");
-      break;
-    case 0xb7:
-      printf("ORA A");
-      break;
-    case 0xb8:
-      printf("CMP B");
-      break;
-    case 0xb9:
-      printf("CMP C");
-      break;
-    case 0xba:
-      printf("CMP D");
-      break;
-    case 0xbb:
-      printf("CMP E");
-      break;
-    case 0xbc:
-      printf("CMP H");
-      break;
-    case 0xbd:
-      printf("CMP L");
-      break;
-    case 0xbe:
-      printf("CMP M");
-      break;
-    case 0xbf:
-      printf("CMP A");
-      break;
-    case 0xc0:
-      printf("RNZ");
-      break;
-    case 0xc1:
-      printf("POP B");
-      break;
-    case 0xc2:
-      printf("JNZ $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xc3:
-      printf("JMP $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xc4:
-      printf("CNZ $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xc5:
-      printf("PUSH B");
-      break;
-    case 0xc6:
-      printf("ADI #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xc7:
-      printf("RST 0");
-      break;
-    case 0xc8:
-      printf("RZ");
-      break;
-    case 0xc9:
-      printf("RET");
-      break;
-    case 0xca:
-      printf("JZ $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xcb:
-      printf("");
-      break;
-    case 0xcc:
-      printf("CZ $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xcd:
-      printf("CALL $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xce:
-      printf("ACI #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xcf:
-      printf("RST");
-      break;
-    case 0xd0:
-      printf("RNC");
-      break;
-    case 0xd1:
-      printf("POP D");
-      break;
-    case 0xd2:
-      printf("JNC $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xd3:
-      printf("OUT #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xd4:
-      printf("CNC $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xd5:
-      printf("PUSH D");
-      break;
-    case 0xd6:
-      printf("SUI #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xd7:
-      printf("RST 2");
-      break;
-    case 0xd8:
-      printf("RC");
-      break;
-    case 0xd9:
-      printf("");
-      break;
-    case 0xda:
-      printf("JC $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xdb:
-      printf("IN #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xdc:
-      printf("CC $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xdd:
-      printf("");
-      break;
-    case 0xde:
-      printf("SBI #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xdf:
-      printf("RST 3");
-      break;
-    case 0xe0:
-      printf("RPO");
-      break;
-    case 0xe1:
-      printf("POP H");
-      break;
-    case 0xe2:
-      printf("JPO $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xe3:
-      printf("XTHL");
-      break;
-    case 0xe4:
-      printf("CPO $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xe5:
-      printf("PUSH H");
-      break;
-    case 0xe6:
-      printf("ANI #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xe7:
-      printf("RST 4");
-      break;
-    case 0xe8:
-      printf("RPE");
-      break;
-    case 0xe9:
-      printf("PCHL");
-      break;
-    case 0xea:
-      printf("JPE $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xeb:
-      printf("XCHG");
-      break;
-    case 0xec:
-      printf("CPE $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xed:
-      printf("");
-      break;
-    case 0xee:
-      printf("XRI #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xef:
-      printf("RST 5");
-      break;
-    case 0xf0:
-      printf("RP");
-      break;
-    case 0xf1:
-      printf("POP PSW");
-      break;
-    case 0xf2:
-      printf("JP $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xf3:
-      printf("DI");
-      break;
-    case 0xf4:
-      printf("CP $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xf5:
-      printf("PUSH PSW");
-      break;
-    case 0xf6:
-      printf("ORI #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xf7:
-      printf("RST 6");
-      break;
-    case 0xf8:
-      printf("RM");
-      break;
-    case 0xf9:
-      printf("SPHL");
-      break;
-    case 0xfa:
-      printf("JM $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xfb:
-      printf("EI");
-      break;
-    case 0xfc:
-      printf("CM $%02x%02x", op_code[2], op_code[1]);
-      num_op_bytes += 2;
-      break;
-    case 0xfd:
-      printf("");
-      break;
-    case 0xfe:
-      printf("CPI #$%02x", op_code[1]);
-      num_op_bytes += 1;
-      break;
-    case 0xff:
-      printf("RST 7");
-      break;
-    }
-
-  putchar('\n');
-
-  return num_op_bytes;
+// Bytes read from a stream at a time
+#define STREAM_CHUNK_SIZE (1 << 16) // NOLINT
+
+// Input bytes per chunk, and chunks per thread per round, when disassembling
+// in parallel
+#define PARALLEL_CHUNK_SIZE (1 << 20) // NOLINT
+
+// Upper limit for --jobs
+#define MAX_JOBS 256 // NOLINT
+
+// Bytes of data per db line
+#define DATA_PER_LINE 8 // NOLINT
+
+// Text is collected here and written with one fwrite per chunk
+#define OUTPUT_BUFFER_SIZE (1 << 16) // NOLINT
+
+// Longest possible line: 8 address digits, a space, the longest prefix, 4
+// operand digits and a newline
+#define MAX_LINE_LENGTH 32 // NOLINT
+
+// Longest mnemonic plus separator and operand sigil, e.g. "LXI SP,#$"
+#define MAX_PREFIX_LENGTH 16 // NOLINT
+
+/*
+Text is written to file, or when there is none (a chunk disassembled in
+parallel) kept in memory until the chunks before it have been written.
+*/
+typedef struct
+{
+  char data[OUTPUT_BUFFER_SIZE];
+  size_t used;
+  FILE *file;
+  char *kept;
+  size_t kept_used;
+  size_t kept_capacity;
+} output_buffer;
+
+// Everything on a line between the address and the operand digits
+typedef struct
+{
+  char text[MAX_PREFIX_LENGTH];
+  size_t length;
+} line_prefix;
+
+static const char hex_digits[] = "0123456789abcdef";
+static line_prefix prefixes[256]; // NOLINT
+
+// Build the per opcode line text once from the opcode table
+static void
+build_prefixes(void)
+{
+  for (int opcode = 0; opcode < 256; opcode++) // NOLINT
+    {
+      const opcode_info *info = &opcode_table[opcode];
+
+      // an immediate follows a register operand after a comma, a bare
+      // mnemonic after a space
+      const char *separator = strchr(info->mnemonic, ' ') != NULL ? "," : " ";
+      const char *sigil = "";
+
+      if (info->operand == OPERAND_D8 || info->operand == OPERAND_D16)
+        {
+          sigil = "#$";
+        }
+      else if (info->operand == OPERAND_ADDR)
+        {
+          sigil = "$";
+        }
+      else
+        {
+          separator = "";
+        }
+      snprintf(prefixes[opcode].text, MAX_PREFIX_LENGTH, "%s%s%s",
+               info->mnemonic, separator, sigil);
+      prefixes[opcode].length = strlen(prefixes[opcode].text);
+    }
 }
 
-int
-main(int argc, char *argv[])
+static void
+flush_output(output_buffer *out)
 {
-  // make sure an argument was passed
-  if (argc < 2)
+  if (out->file == NULL)
     {
-      fprintf(stderr, "Please provide a file!\n");
+      if (out->kept_used + out->used > out->kept_capacity)
+        {
+          size_t capacity = out->kept_capacity * 2 + OUTPUT_BUFFER_SIZE;
+          out->kept = realloc(out->kept, capacity);
+          if (out->kept == NULL)
+            {
+              fprintf(stderr, "Error allocating buffer!\n");
+              exit(1);
+            }
+          out->kept_capacity = capacity;
+        }
+      memcpy(out->kept + out->kept_used, out->data, out->used);
+      out->kept_used += out->used;
+    }
+  else if (out->used > 0
+           && fwrite(out->data, 1, out->used, out->file) != out->used)
+    {
+      perror("Error writing output");
       exit(1);
     }
+  out->used = 0;
+}
 
-  // try to open the file
-  FILE *file_str;
-  file_str = fopen(argv[1], "r");
+// Room for at least length more bytes of text at the end of the buffer
+static char *
+output_space(output_buffer *out, size_t length)
+{
+  if (out->used + length > OUTPUT_BUFFER_SIZE)
+    {
+      flush_output(out);
+    }
+  return &out->data[out->used];
+}
 
-  // error if open file fails
-  if (!file_str)
+// Write value as lower case hex, at least digits long like %0*x
+static char *
+put_hex(char *text, size_t value, int digits)
+{
+  while (digits < (int)sizeof(size_t) * 2 && (value >> (digits * 4)) != 0)
     {
-      fprintf(stderr, "Error opening file!\n");
-      exit(1);
+      digits++;
+    }
+  for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4) // NOLINT
+    {
+      *text++ = hex_digits[(value >> shift) & 0xF]; // NOLINT
+    }
+  return text;
+}
+
+/*
+Write the instruction at op_code as one line of text, returns its length in
+bytes. The caller makes sure all of its operand bytes are there.
+*/
+static int
+disassemble_8080(const unsigned char *op_code, size_t address,
+                 output_buffer *out)
+{
+  const opcode_info *info = &opcode_table[*op_code];
+  const line_prefix *prefix = &prefixes[*op_code];
+
+  char *text = output_space(out, MAX_LINE_LENGTH);
+  text = put_hex(text, address, 4);
+  *text++ = ' ';
+  memcpy(text, prefix->text, prefix->length);
+  text += prefix->length;
+
+  if (info->operand == OPERAND_D8)
+    {
+      text = put_hex(text, op_code[1], 2);
+    }
+  else if (info->operand != OPERAND_NONE)
+    {
+      text = put_hex(text, op_code[2] << 8 | op_code[1], 4); // NOLINT
+    }
+  *text++ = '\n';
+
+  out->used = text - out->data;
+  return info->length;
+}
+
+static void
+put_text(output_buffer *out, const char *text, size_t length)
+{
+  memcpy(output_space(out, length), text, length);
+  out->used += length;
+}
+
+static void
+put_address(output_buffer *out, size_t address)
+{
+  char *text = output_space(out, MAX_LINE_LENGTH);
+
+  out->used = put_hex(text, address, 4) - out->data;
+}
+
+// Bytes that are not (whole) instructions, as one db line
+static void
+write_db(output_buffer *out, size_t address, const unsigned char *bytes,
+         size_t count)
+{
+  put_address(out, address);
+  put_text(out, " db ", 4);
+  for (size_t i = 0; i < count; i++)
+    {
+      char *text = output_space(out, 4); // NOLINT
+      *text++ = '$';
+      text = put_hex(text, bytes[i], 2);
+      if (i + 1 < count)
+        {
+          *text++ = ',';
+        }
+      out->used = text - out->data;
+    }
+  put_text(out, "\n", 1);
+}
+
+/*
+Control flow mode. Instead of sweeping linearly, decoding starts at the
+entry points and follows every jump, call and restart, so data tables are
+left alone and operands never get decoded as opcodes. Whatever is never
+reached is listed as data.
+*/
+
+// Reset plus the two interrupt vectors the Space Invaders board raises
+static const size_t entry_points[] = { 0x0000, 0x0008, 0x0010 }; // NOLINT
+
+// What each byte turned out to be
+enum byte_kind
+{
+  BYTE_DATA,
+  BYTE_CODE,    // first byte of an instruction
+  BYTE_OPERAND, // the rest of one
+};
+
+// A branch from source to target (offsets into the image), for the
+// cross-reference comments
+typedef struct
+{
+  size_t target;
+  size_t source;
+} xref;
+
+typedef struct
+{
+  const unsigned char *buffer;
+  size_t length;
+  size_t base; // address of buffer[0]
+  uint8_t *kind;
+  bool *block_start; // length + 1 entries, a block can start at the end
+  bool *label;
+  xref *xrefs;
+  size_t num_xrefs;
+  size_t *pending; // labels still to decode from
+  size_t num_pending;
+} flow_map;
+
+// Whether execution never carries on to the next instruction
+static bool
+ends_flow(const opcode_info *info)
+{
+  // skip the '*' of an undocumented alias
+  const char *mnemonic = info->mnemonic + (info->mnemonic[0] == '*');
+
+  return strcmp(mnemonic, "JMP") == 0 || strcmp(mnemonic, "RET") == 0
+         || strcmp(mnemonic, "PCHL") == 0;
+}
+
+// Queue the instruction at address for decoding, reached from source
+static void
+add_target(flow_map *map, size_t source, size_t address)
+{
+  // e.g. a call into RAM, nothing to decode there
+  if (address < map->base || address - map->base >= map->length)
+    {
+      return;
+    }
+  size_t target = address - map->base;
+
+  map->xrefs[map->num_xrefs++] = (xref){ target, source };
+  map->block_start[target] = true;
+  if (!map->label[target])
+    {
+      map->label[target] = true;
+      map->pending[map->num_pending++] = target;
+    }
+}
+
+// Decode straight-line code from offset address until the flow leaves it
+static void
+trace_from(flow_map *map, size_t address)
+{
+  while (address < map->length && map->kind[address] == BYTE_DATA)
+    {
+      uint8_t opcode = map->buffer[address];
+      const opcode_info *info = &opcode_table[opcode];
+      size_t next = address + info->length;
+
+      // operands running off the end or into code already found mean
+      // these bytes are not really an instruction
+      if (next > map->length)
+        {
+          return;
+        }
+      for (size_t i = address + 1; i < next; i++)
+        {
+          if (map->kind[i] != BYTE_DATA)
+            {
+              return;
+            }
+        }
+
+      map->kind[address] = BYTE_CODE;
+      for (size_t i = address + 1; i < next; i++)
+        {
+          map->kind[i] = BYTE_OPERAND;
+        }
+
+      if (info->branch && info->operand == OPERAND_ADDR)
+        {
+          add_target(map, address,
+                     map->buffer[address + 1]
+                         | map->buffer[address + 2] << 8); // NOLINT
+        }
+      else if ((opcode & 0xC7) == 0xC7) // NOLINT RST n calls 8 * n
+        {
+          add_target(map, address, opcode & 0x38); // NOLINT
+        }
+
+      if (ends_flow(info))
+        {
+          return;
+        }
+      if (info->branch)
+        {
+          map->block_start[next] = true;
+        }
+      address = next;
     }
+}
 
-  // get file size
-  if (fseek(file_str, 0, SEEK_END) < 0)
+static int
+compare_xrefs(const void *a, const void *b)
+{
+  const xref *left = a;
+  const xref *right = b;
+
+  if (left->target != right->target)
+    {
+      return left->target < right->target ? -1 : 1;
+    }
+  if (left->source != right->source)
     {
-      fprintf(stderr, "ERROR\n");
+      return left->source < right->source ? -1 : 1;
+    }
+  return 0;
+}
+
+// "L_0018:" and where it is reached from, xref walks the sorted xrefs
+static void
+write_label(const flow_map *map, size_t address, size_t *xref_index,
+            output_buffer *out)
+{
+  size_t x = *xref_index;
+
+  while (x < map->num_xrefs && map->xrefs[x].target < address)
+    {
+      x++;
+    }
+
+  put_text(out, "L_", 2);
+  put_address(out, map->base + address);
+  put_text(out, ":", 1);
+  if (x == map->num_xrefs || map->xrefs[x].target != address)
+    {
+      put_text(out, "  ; entry", 9); // NOLINT
+    }
+  else
+    {
+      put_text(out, "  ; from", 8); // NOLINT
+      for (; x < map->num_xrefs && map->xrefs[x].target == address; x++)
+        {
+          put_text(out, " ", 1);
+          put_address(out, map->base + map->xrefs[x].source);
+        }
+    }
+  put_text(out, "\n", 1);
+  *xref_index = x;
+}
+
+// One db line of unreached bytes before limit, returns the offset after it
+static size_t
+write_data(const flow_map *map, size_t address, size_t limit,
+           output_buffer *out)
+{
+  size_t end = address;
+
+  while (end < limit && end - address < DATA_PER_LINE
+         && map->kind[end] != BYTE_CODE)
+    {
+      end++;
+    }
+
+  write_db(out, map->base + address, &map->buffer[address], end - address);
+  return end;
+}
+
+static void
+write_block(FILE *file, const flow_map *map, size_t start, size_t end)
+{
+  fprintf(file, "%04zx %04zx\n", map->base + start, map->base + end);
+}
+
+// Basic blocks as "start end" lines, end exclusive, both in hex
+static bool
+write_blocks(const flow_map *map, const char *path)
+{
+  FILE *file = fopen(path, "w");
+  size_t address = 0;
+  size_t start = 0;
+  bool open = false;
+
+  if (file == NULL)
+    {
+      fprintf(stderr, "Error opening %s!\n", path);
+      return false;
+    }
+
+  fprintf(file, "# basic blocks: start end (exclusive), hex\n");
+  while (address < map->length)
+    {
+      if (map->kind[address] != BYTE_CODE)
+        {
+          if (open)
+            {
+              write_block(file, map, start, address);
+              open = false;
+            }
+          address++;
+          continue;
+        }
+      if (open && map->block_start[address])
+        {
+          write_block(file, map, start, address);
+          open = false;
+        }
+      if (!open)
+        {
+          start = address;
+          open = true;
+        }
+
+      const opcode_info *info = &opcode_table[map->buffer[address]];
+      address += info->length;
+      // a branch always ends its block, taken or not
+      if (info->branch)
+        {
+          write_block(file, map, start, address);
+          open = false;
+        }
+    }
+  if (open)
+    {
+      write_block(file, map, start, address);
+    }
+
+  if (fclose(file) != 0)
+    {
+      fprintf(stderr, "Error writing %s!\n", path);
+      return false;
+    }
+  return true;
+}
+
+/*
+List [start, end) of an image loaded at base in control flow mode, returns
+the instructions listed. The whole image is analysed whatever the range.
+*/
+static size_t
+disassemble_flow(const unsigned char *buffer, size_t length, size_t base,
+                 size_t start, size_t end, output_buffer *out,
+                 const char *blocks_path)
+{
+  flow_map map = { buffer, length, base, calloc(length, sizeof(uint8_t)),
+                   calloc(length + 1, sizeof(bool)),
+                   calloc(length, sizeof(bool)),
+                   calloc(length, sizeof(xref)),
+                   0,
+                   calloc(length, sizeof(size_t)),
+                   0 };
+  size_t instructions = 0;
+  size_t xref_index = 0;
+
+  if (map.kind == NULL || map.block_start == NULL || map.label == NULL
+      || map.xrefs == NULL || map.pending == NULL)
+    {
+      fprintf(stderr, "Error allocating buffer!\n");
       exit(1);
     }
-  size_t len = ftell(file_str);
 
-  // reset file position indicator to beginning
-  if (fseek(file_str, 0, SEEK_SET) < 0)
+  for (size_t i = 0; i < sizeof(entry_points) / sizeof(entry_points[0]);
+       i++)
+    {
+      size_t entry = entry_points[i] - base;
+      if (entry_points[i] >= base && entry < length && !map.label[entry])
+        {
+          map.label[entry] = true;
+          map.block_start[entry] = true;
+          map.pending[map.num_pending++] = entry;
+        }
+    }
+  while (map.num_pending > 0)
+    {
+      trace_from(&map, map.pending[--map.num_pending]);
+    }
+  qsort(map.xrefs, map.num_xrefs, sizeof(xref), compare_xrefs);
+
+  for (size_t address = start - base; address < end - base;)
+    {
+      if (map.kind[address] != BYTE_CODE)
+        {
+          address = write_data(&map, address, end - base, out);
+          continue;
+        }
+      if (map.label[address])
+        {
+          write_label(&map, address, &xref_index, out);
+        }
+      address += disassemble_8080(&buffer[address], base + address, out);
+      instructions++;
+    }
+
+  if (blocks_path != NULL && !write_blocks(&map, blocks_path))
     {
-      fprintf(stderr, "ERROR\n");
       exit(1);
     }
 
-  // allocate buffer
-  unsigned char *buf = malloc(len);
+  free(map.kind);
+  free(map.block_start);
+  free(map.label);
+  free(map.xrefs);
+  free(map.pending);
+  return instructions;
+}
+
+/*
+Linear sweep of [start, end) of an image loaded at base, returns the
+instructions listed. An instruction cut off by the end of the image is
+listed as data rather than read past it.
+*/
+static size_t
+disassemble_linear(const unsigned char *buffer, size_t length, size_t base,
+                   size_t start, size_t end, output_buffer *out)
+{
+  size_t instructions = 0;
+
+  for (size_t address = start - base; address < end - base;)
+    {
+      size_t size = opcode_table[buffer[address]].length;
+
+      if (size > length - address)
+        {
+          write_db(out, base + address, &buffer[address], length - address);
+          break;
+        }
+      address += disassemble_8080(&buffer[address], base + address, out);
+      instructions++;
+    }
+  return instructions;
+}
+
+/*
+Parallel linear sweep. The image is cut into chunks and each is swept on its
+own thread, which only works if every thread knows where the first whole
+instruction of its chunk starts. An instruction is at most 3 bytes long, so
+the sweep enters a chunk 0, 1 or 2 bytes past its start. Every chunk is first
+walked (lengths only, which is cheap) from all three, giving where each entry
+leaves it; chaining those from the first chunk finds the real entries, and
+only then is the text produced, per chunk in memory, and written in order.
+The output is exactly that of the single threaded sweep.
+*/
+typedef struct
+{
+  const unsigned char *buffer;
+  size_t length; // of the whole image
+  size_t base;
+  size_t begin;  // chunk as offsets into the image, [begin, finish)
+  size_t finish;
+  size_t exits[3]; // where the sweep leaves, by entry offset past begin
+  size_t entry;    // where the sweep really enters
+  size_t instructions;
+  output_buffer *out;
+} sweep_chunk;
 
-  if (NULL == buf)
+// Offset the sweep from address leaves [address, finish) at
+static size_t
+sweep_exit(const unsigned char *buffer, size_t length, size_t address,
+           size_t finish)
+{
+  while (address < finish)
+    {
+      size_t size = opcode_table[buffer[address]].length;
+
+      // a cut off instruction is listed as data up to the end
+      if (size > length - address)
+        {
+          return length;
+        }
+      address += size;
+    }
+  return address;
+}
+
+static void *
+walk_chunk(void *data)
+{
+  sweep_chunk *chunk = data;
+
+  for (size_t offset = 0; offset < 3; offset++)
+    {
+      chunk->exits[offset] = sweep_exit(chunk->buffer, chunk->length,
+                                        chunk->begin + offset, chunk->finish);
+    }
+  return NULL;
+}
+
+static void *
+sweep_chunk_text(void *data)
+{
+  sweep_chunk *chunk = data;
+
+  chunk->out->used = 0;
+  chunk->out->kept_used = 0;
+  chunk->instructions = 0;
+  if (chunk->entry < chunk->finish)
+    {
+      chunk->instructions = disassemble_linear(
+          chunk->buffer, chunk->length, chunk->base,
+          chunk->base + chunk->entry, chunk->base + chunk->finish,
+          chunk->out);
+    }
+  flush_output(chunk->out);
+  return NULL;
+}
+
+// Run every chunk of a round on its own thread and wait for them
+static void
+run_chunks(sweep_chunk *chunks, size_t count, void *(*work)(void *))
+{
+  pthread_t threads[count];
+
+  for (size_t i = 0; i < count; i++)
+    {
+      if (pthread_create(&threads[i], NULL, work, &chunks[i]) != 0)
+        {
+          // no thread to spare, do it here instead
+          threads[i] = pthread_self();
+          work(&chunks[i]);
+        }
+    }
+  for (size_t i = 0; i < count; i++)
+    {
+      if (!pthread_equal(threads[i], pthread_self()))
+        {
+          pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+/*
+Linear sweep of [start, end) on jobs threads, a round of jobs chunks at a
+time so the text held in memory stays bounded. Returns the instructions
+listed.
+*/
+static size_t
+disassemble_parallel(const unsigned char *buffer, size_t length,
+                     size_t base, size_t start, size_t end,
+                     output_buffer *out, size_t jobs)
+{
+  sweep_chunk *chunks = calloc(jobs, sizeof(sweep_chunk));
+  output_buffer *outs = calloc(jobs, sizeof(output_buffer));
+  size_t instructions = 0;
+  size_t entry = start - base;
+  size_t limit = end - base;
+
+  if (chunks == NULL || outs == NULL)
     {
       fprintf(stderr, "Error allocating buffer!\n");
       exit(1);
     }
+  flush_output(out);
+
+  while (entry < limit)
+    {
+      size_t count = 0;
+
+      for (size_t begin = entry; count < jobs && begin < limit; count++)
+        {
+          sweep_chunk *chunk = &chunks[count];
+          chunk->buffer = buffer;
+          chunk->length = length;
+          chunk->base = base;
+          chunk->begin = begin;
+          chunk->finish = limit - begin > PARALLEL_CHUNK_SIZE
+                              ? begin + PARALLEL_CHUNK_SIZE
+                              : limit;
+          chunk->out = &outs[count];
+          begin = chunk->finish;
+        }
+      run_chunks(chunks, count, walk_chunk);
+
+      // chain the real entries, an entry past a chunk skips it entirely
+      for (size_t i = 0; i < count; i++)
+        {
+          chunks[i].entry = entry;
+          if (entry - chunks[i].begin < 3)
+            {
+              entry = chunks[i].exits[entry - chunks[i].begin];
+            }
+        }
+      run_chunks(chunks, count, sweep_chunk_text);
+
+      for (size_t i = 0; i < count; i++)
+        {
+          if (fwrite(outs[i].kept, 1, outs[i].kept_used, out->file)
+              != outs[i].kept_used)
+            {
+              perror("Error writing output");
+              exit(1);
+            }
+          instructions += chunks[i].instructions;
+        }
+    }
 
-  // read file into buffer
-  size_t num_read = fread(buf, len, 1, file_str);
+  for (size_t i = 0; i < jobs; i++)
+    {
+      free(outs[i].kept);
+    }
+  free(outs);
+  free(chunks);
+  return instructions;
+}
+
+/*
+Linear sweep of a stream, e.g. a pipe, as it arrives. Only an instruction
+cut by the end of a read is held back until the rest of it comes in, and
+each read's output is written straight away so live traces show up live.
+*/
+static size_t
+disassemble_stream(int fd, size_t base, size_t start, size_t end,
+                   output_buffer *out, size_t *length)
+{
+  static unsigned char chunk[STREAM_CHUNK_SIZE + 2];
+  size_t instructions = 0;
+  size_t kept = 0;       // bytes of a cut instruction carried over
+  size_t address = base; // address of chunk[0]
 
-  if (num_read < 1)
+  while (address < end)
     {
-      fprintf(stderr, "Error reading file into buffer!\n");
+      ssize_t count = read(fd, chunk + kept, STREAM_CHUNK_SIZE);
+      if (count < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (count < 0)
+        {
+          perror("Error reading input");
+          exit(1);
+        }
+      if (count == 0)
+        {
+          break;
+        }
+
+      size_t available = kept + count;
+      size_t used = 0;
+
+      // skip whatever comes before the range
+      if (address < start)
+        {
+          used = start - address < available ? start - address : available;
+        }
+      while (used < available && address + used < end)
+        {
+          size_t size = opcode_table[chunk[used]].length;
+          if (size > available - used)
+            {
+              break;
+            }
+          used += disassemble_8080(&chunk[used], address + used, out);
+          instructions++;
+        }
+
+      kept = available - used;
+      memmove(chunk, chunk + used, kept);
+      address += used;
+      flush_output(out);
+      fflush(out->file);
+    }
+
+  if (kept > 0 && address < end)
+    {
+      write_db(out, address, chunk, kept);
+    }
+  *length = address + kept - base;
+  return instructions;
+}
+
+// Read a stream that cannot be mapped to the end, for control flow mode
+static unsigned char *
+read_all(int fd, size_t *length)
+{
+  size_t capacity = STREAM_CHUNK_SIZE;
+  unsigned char *data = malloc(capacity);
+
+  *length = 0;
+  while (data != NULL)
+    {
+      if (*length == capacity)
+        {
+          unsigned char *grown = realloc(data, capacity * 2);
+          if (grown == NULL)
+            {
+              break;
+            }
+          data = grown;
+          capacity *= 2;
+        }
+
+      ssize_t count = read(fd, data + *length, capacity - *length);
+      if (count < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (count < 0)
+        {
+          perror("Error reading input");
+          exit(1);
+        }
+      if (count == 0)
+        {
+          return data;
+        }
+      *length += count;
+    }
+
+  fprintf(stderr, "Error allocating buffer!\n");
+  exit(1);
+}
+
+// Parse an address option, decimal or 0x prefixed hex
+static size_t
+parse_address(const char *arg, const char *option)
+{
+  char *end = NULL;
+
+  errno = 0;
+  unsigned long long value = strtoull(arg, &end, 0);
+  if (*arg == '\0' || *end != '\0' || errno != 0 || arg[0] == '-'
+      || value > SIZE_MAX)
+    {
+      fprintf(stderr, "Invalid address for --%s: %s\n", option, arg);
+      exit(1);
+    }
+  return (size_t)value;
+}
+
+// Parse a --jobs thread count, decimal only so 010 is not taken as octal
+static size_t
+parse_jobs(const char *arg)
+{
+  char *end = NULL;
+
+  errno = 0;
+  long value = strtol(arg, &end, 10); // NOLINT
+  if (*arg == '\0' || *end != '\0' || errno != 0 || value < 1
+      || value > MAX_JOBS)
+    {
+      fprintf(stderr, "--jobs takes 1 to %d threads, not %s\n", MAX_JOBS,
+              arg);
+      exit(1);
+    }
+  return (size_t)value;
+}
+
+static double
+seconds_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9; // NOLINT
+}
+
+int
+main(int argc, char *argv[])
+{
+  static const struct option long_options[]
+      = { { "stats", no_argument, NULL, 's' },
+          { "flow", no_argument, NULL, 'f' },
+          { "blocks", required_argument, NULL, 'b' },
+          { "base", required_argument, NULL, 'B' },
+          { "start", required_argument, NULL, 'S' },
+          { "end", required_argument, NULL, 'E' },
+          { "jobs", required_argument, NULL, 'j' },
+          { NULL, 0, NULL, 0 } };
+  const char *blocks_path = NULL;
+  bool stats = false;
+  bool flow = false;
+  size_t base = 0;
+  size_t start = 0;
+  size_t end = SIZE_MAX;
+  bool start_set = false;
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t jobs = online > 0 ? (size_t)online : 1;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+      switch (opt)
+        {
+        case 's':
+          stats = true;
+          break;
+        case 'b':
+          // the block map comes out of the control flow pass
+          blocks_path = optarg;
+          flow = true;
+          break;
+        case 'f':
+          flow = true;
+          break;
+        case 'B':
+          base = parse_address(optarg, "base");
+          break;
+        case 'S':
+          start = parse_address(optarg, "start");
+          start_set = true;
+          break;
+        case 'E':
+          end = parse_address(optarg, "end");
+          break;
+        case 'j':
+          jobs = parse_jobs(optarg);
+          break;
+        default:
+          exit(1);
+        }
+    }
+
+  // make sure an argument was passed, - reads standard input
+  if (optind >= argc)
+    {
+      fprintf(stderr, "Please provide a file!\n");
+      exit(1);
+    }
+  if (!start_set)
+    {
+      start = base;
+    }
+  if (start < base || end < start)
+    {
+      fprintf(stderr, "Need base <= start <= end!\n");
       exit(1);
     }
 
-  fclose(file_str);
+  int fd = STDIN_FILENO;
+  if (strcmp(argv[optind], "-") != 0)
+    {
+      fd = open(argv[optind], O_RDONLY);
+    }
 
-  size_t count = 0;
+  // error if open file fails
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) < 0)
+    {
+      fprintf(stderr, "Error opening file!\n");
+      exit(1);
+    }
+
+  static output_buffer out;
+  size_t instructions = 0;
+  size_t len = 0;
+  double started = seconds_now();
+
+  build_prefixes();
+  out.file = stdout;
+
+  if (!S_ISREG(info.st_mode) && !flow)
+    {
+      instructions = disassemble_stream(fd, base, start, end, &out, &len);
+    }
+  else
+    {
+      // a regular file is mapped rather than copied, a pipe has to be read
+      void *mapped = NULL;
+      unsigned char *buf = NULL;
+
+      if (S_ISREG(info.st_mode))
+        {
+          len = info.st_size;
+          if (len > 0)
+            {
+              mapped = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+              if (mapped == MAP_FAILED)
+                {
+                  perror("Error mapping file");
+                  exit(1);
+                }
+              buf = mapped;
+            }
+        }
+      else
+        {
+          buf = read_all(fd, &len);
+        }
+
+      // clamp the range to the image
+      size_t image_end = base + len;
+      if (end > image_end)
+        {
+          end = image_end;
+        }
+      if (start > end)
+        {
+          start = end;
+        }
 
-  // interpet
-  while (count < len)
+      if (flow)
+        {
+          instructions = disassemble_flow(buf, len, base, start, end, &out,
+                                          blocks_path);
+        }
+      else if (jobs > 1 && end - start > PARALLEL_CHUNK_SIZE)
+        {
+          instructions = disassemble_parallel(buf, len, base, start, end,
+                                              &out, jobs);
+        }
+      else
+        {
+          instructions
+              = disassemble_linear(buf, len, base, start, end, &out);
+        }
+
+      if (mapped != NULL)
+        {
+          munmap(mapped, len);
+        }
+      else
+        {
+          free(buf);
+        }
+    }
+  flush_output(&out);
+  if (fd != STDIN_FILENO)
     {
-      count += disassemble_8080(buf, count);
+      close(fd);
     }
 
-  // free memory
-  free(buf);
+  if (stats)
+    {
+      double elapsed = seconds_now() - started;
+      fprintf(stderr,
+              "%zu instructions (%zu bytes) in %.3f s, %.0f instructions "
+              "per second\n",
+              instructions, len, elapsed,
+              elapsed > 0 ? instructions / elapsed : 0.0);
+    }
 
   return 0;
 }
@@ -0,0 +1,116 @@
+/*
+ * Description: Build time generator for embedded_assets.c. Dumps a ROM image
+ * and the sounds, decoded exactly as the sound cache would decode them at run
+ * time, as const C arrays.
+ */
+
+#include "sound_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Values per line in the generated arrays
+#define VALUES_PER_LINE 12 // NOLINT
+
+static bool
+write_rom(FILE *out, const char *rom_path)
+{
+  static uint8_t rom[MEM_SIZE];
+  FILE *file = fopen(rom_path, "rb");
+
+  if (file == NULL)
+    {
+      fprintf(stderr, "Error: Unable to open file %s\n", rom_path);
+      return false;
+    }
+  size_t size = fread(rom, 1, sizeof(rom), file);
+  bool too_big = fgetc(file) != EOF;
+  fclose(file);
+  if (size == 0 || too_big)
+    {
+      fprintf(stderr, "Error: %s is empty or larger than memory\n", rom_path);
+      return false;
+    }
+
+  fprintf(out, "const uint8_t embedded_rom[] = {");
+  for (size_t i = 0; i < size; i++)
+    {
+      fprintf(out, "%s0x%02x,", i % VALUES_PER_LINE ? " " : "\n  ", rom[i]);
+    }
+  fprintf(out, "\n};\nconst size_t embedded_rom_size = %zu;\n\n", size);
+  return true;
+}
+
+static void
+write_sounds(FILE *out)
+{
+  const audio_sample *samples[NUM_SOUNDS];
+
+  for (int sound = 0; sound < NUM_SOUNDS; sound++)
+    {
+      samples[sound] = sound_get(sound);
+      if (samples[sound] == NULL)
+        {
+          // a missing sound stays silent, as it would at run time
+          continue;
+        }
+      fprintf(out, "static const int16_t sound_%d[] = {", sound);
+      for (uint32_t i = 0; i < samples[sound]->length; i++)
+        {
+          fprintf(out, "%s%d,", i % VALUES_PER_LINE ? " " : "\n  ",
+                  samples[sound]->data[i]);
+        }
+      fprintf(out, "\n};\n\n");
+    }
+
+  fprintf(out, "const audio_sample embedded_sounds[NUM_SOUNDS] = {\n");
+  for (int sound = 0; sound < NUM_SOUNDS; sound++)
+    {
+      if (samples[sound] == NULL)
+        {
+          fprintf(out, "  { NULL, 0 },\n");
+        }
+      else
+        {
+          fprintf(out, "  { sound_%d, %u },\n", sound,
+                  (unsigned int)samples[sound]->length);
+        }
+    }
+  fprintf(out, "};\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  if (argc != 3)
+    {
+      fprintf(stderr, "Usage: %s rom_filepath output_filepath\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+
+  FILE *out = fopen(argv[2], "w");
+  if (out == NULL)
+    {
+      fprintf(stderr, "Error: Unable to open file %s\n", argv[2]);
+      exit(EXIT_FAILURE);
+    }
+
+  fprintf(out, "// Generated by embed_assets from %s, do not edit\n\n"
+               "#include \"embedded_assets.h\"\n\n",
+          argv[1]);
+  if (!write_rom(out, argv[1]))
+    {
+      fclose(out);
+      remove(argv[2]);
+      exit(EXIT_FAILURE);
+    }
+  write_sounds(out);
+  sound_cache_free();
+
+  if (fclose(out) != 0)
+    {
+      perror("Error: unable to write output");
+      remove(argv[2]);
+      exit(EXIT_FAILURE);
+    }
+  return 0;
+}
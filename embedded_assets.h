@@ -0,0 +1,15 @@
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+#include "audio.h"
+
+/*
+The invaders ROM and the sound samples, already converted to the output
+format, compiled into the executable by a make EMBED=1 build. The data is
+written to embedded_assets.c by embed_assets at build time.
+*/
+extern const uint8_t embedded_rom[];
+extern const size_t embedded_rom_size;
+extern const audio_sample embedded_sounds[NUM_SOUNDS];
+
+#endif
@@ -1,12 +1,16 @@
 #include "emulator.h"
+#include "audio.h"
 #include <SDL2/SDL.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static uint8_t port_in(i8080 *cpu, uint8_t port);
 static void port_out(i8080 *cpu, uint8_t port, uint8_t value);
+static void set_szp(i8080 *cpu, uint8_t result);
+static void set_ac(i8080 *cpu, uint8_t a, uint8_t b, uint8_t carry);
 
 // Add Register or Memory to Accumulator with Carry
 int
@@ -17,11 +21,9 @@ ADC(i8080 *cpu, const u_int8_t *reg)
   uint16_t result = cpu->a + *reg + carry;
 
   // set A to sum and set flags
-  update_aux_carry_flag(cpu, cpu->a, (*reg + carry));
+  set_ac(cpu, cpu->a, *reg, carry);
   cpu->a = (uint8_t)result;
-  update_zero_flag(cpu, cpu->a);
-  update_sign_flag(cpu, cpu->a);
-  update_parity_flag(cpu, cpu->a);
+  set_szp(cpu, cpu->a);
   update_carry_flag(cpu, result > MAX_8_BIT_VALUE);
   return 4; // NOLINT
 }
@@ -30,10 +32,10 @@ ADC(i8080 *cpu, const u_int8_t *reg)
 int
 ANA(i8080 *cpu, const uint8_t value)
 {
+  // the 8080 sets AC to the OR of bit 3 of the operands
+  set_ac(cpu, (cpu->a | value) & 0x08, 0x08, 0); // NOLINT
   cpu->a = cpu->a & value;
-  update_zero_flag(cpu, cpu->a);
-  update_sign_flag(cpu, cpu->a);
-  update_parity_flag(cpu, cpu->a);
+  set_szp(cpu, cpu->a);
   update_carry_flag(cpu, false);
   return 4; // NOLINT
 }
@@ -42,13 +44,13 @@ ANA(i8080 *cpu, const uint8_t value)
 int
 CALL(i8080 *cpu, uint16_t address)
 {
-  uint16_t return_address = readRegisterPair(cpu, PC) + 3; // NOLINT
+  uint16_t return_address = cpu->pc + 3; // NOLINT
   cpu_write_mem(cpu, cpu->sp - 1,
                 (uint8_t)((return_address & UPPER_8_BIT_MASK) >> BYTE));
   cpu_write_mem(cpu, cpu->sp - 2,
                 (uint8_t)(return_address & LOWER_8_BIT_MASK));
   cpu->sp -= 2;
-  writeRegisterPair(cpu, PC, address);
+  cpu->pc = address;
   return 17; // NOLINT
 }
 
@@ -57,10 +59,9 @@ int
 CMP(i8080 *cpu, uint8_t value)
 {
   u_int8_t result = cpu->a - value;
-  update_zero_flag(cpu, result);
+  set_szp(cpu, result);
+  set_ac(cpu, cpu->a, ~value, 1);
   update_carry_flag(cpu, value > cpu->a);
-  update_parity_flag(cpu, result);
-  update_sign_flag(cpu, result);
   return 4; // NOLINT
 }
 
@@ -68,51 +69,44 @@ CMP(i8080 *cpu, uint8_t value)
 int
 DAA(i8080 *cpu)
 {
+  cpu_sync_flags(cpu);
+
   // break accumulator into 2 4-bit pieces
   uint8_t lo_nibble = (cpu->a & LOWER_4_BIT_MASK);
-  uint8_t hi_nibble = ((cpu->a & UPPER_4_BIT_MASK) >> NIBBLE);
+  uint8_t correction = 0;
+  bool carry = (cpu->flags & FLAG_CY) == FLAG_CY;
 
-  // STEP 1: if least sig bits are > 9 or AC is set, increment A by 6
+  // STEP 1: if least sig bits are > 9 or AC is set, add 6 to them
   if (lo_nibble > 9 || ((cpu->flags & FLAG_AC) == FLAG_AC)) // NOLINT
     {
-      cpu->a += 6; // NOLINT
-
-      // set AC to 1
-      cpu->flags |= FLAG_AC;
-
-      // reassign nibbles to newly incremented A value
-      lo_nibble = (cpu->a & LOWER_4_BIT_MASK);
-      hi_nibble = ((cpu->a & UPPER_4_BIT_MASK) >> NIBBLE);
-    }
-  else
-    {
-      // clear AC if no carry
-      cpu->flags &= ~FLAG_AC;
+      correction |= 0x06; // NOLINT
     }
 
-  // STEP 2: if most sig bits are NOW > 9 or CY is set, increment hi_nibble by
-  // 6
-  if (hi_nibble > 9 || ((cpu->flags & FLAG_CY) == FLAG_CY)) // NOLINT
+  // STEP 2: if A is past 99 or CY is set, add 6 to the most sig bits too.
+  // Checking A rather than the most sig bits after step 1 catches the carry
+  // step 1 makes into them
+  if (cpu->a > 0x99 || carry) // NOLINT
     {
-      hi_nibble += 6; // NOLINT
-      // reconstruct 8-bit A register after hi_nibble increment
-      cpu->a = ((hi_nibble << NIBBLE) | lo_nibble);
-
-      // set CY to 1
-      update_carry_flag(cpu, true);
+      correction |= 0x60; // NOLINT
+      carry = true;
     }
 
+  // AC comes from the addition, CY is only ever set, never cleared
+  set_ac(cpu, cpu->a, correction, 0);
+  cpu->a += correction;
+  set_szp(cpu, cpu->a);
+  update_carry_flag(cpu, carry);
+
   return 4; // NOLINT
 }
 
 // Double Add
 int
-DAD(i8080 *cpu, int pair)
+DAD(i8080 *cpu, const uint16_t *pair)
 {
-  uint32_t result
-      = (uint32_t)(readRegisterPair(cpu, pair) + readRegisterPair(cpu, HL));
+  uint32_t result = (uint32_t)*pair + cpu->hl;
   update_carry_flag(cpu, result > MAX_16_BIT_VALUE);
-  writeRegisterPair(cpu, HL, (uint16_t)result);
+  cpu->hl = (uint16_t)result;
   return 10; // NOLINT
 }
 
@@ -121,10 +115,8 @@ int
 add_reg_accum(i8080 *cpu, uint8_t value)
 {
   uint16_t result = cpu->a + value;
-  update_sign_flag(cpu, result);
-  update_zero_flag(cpu, result);
-  update_aux_carry_flag(cpu, cpu->a, value);
-  update_parity_flag(cpu, result);
+  set_szp(cpu, result);
+  set_ac(cpu, cpu->a, value, 0);
   if (result > MAX_8_BIT_VALUE)
     {
       update_carry_flag(cpu, true);
@@ -141,20 +133,17 @@ add_reg_accum(i8080 *cpu, uint8_t value)
 int
 DCR(i8080 *cpu, uint8_t *reg)
 {
-  update_aux_carry_flag(cpu, *reg, MAX_8_BIT_VALUE);
+  set_ac(cpu, *reg, MAX_8_BIT_VALUE, 0);
   *reg -= 1;
-  update_zero_flag(cpu, *reg);
-  update_sign_flag(cpu, *reg);
-  update_parity_flag(cpu, *reg);
+  set_szp(cpu, *reg);
   return 5; // NOLINT
 }
 
 // Decrement Register Pair
 int
-DCX(i8080 *cpu, int pair)
+DCX(uint16_t *pair)
 {
-  uint16_t value = readRegisterPair(cpu, pair) - 1;
-  writeRegisterPair(cpu, pair, value);
+  *pair -= 1;
   return 5; // NOLINT
 }
 
@@ -162,20 +151,17 @@ DCX(i8080 *cpu, int pair)
 int
 INR(i8080 *cpu, uint8_t *reg)
 {
-  update_aux_carry_flag(cpu, *reg, 0x01);
+  set_ac(cpu, *reg, 0x01, 0);
   *reg += 1;
-  update_zero_flag(cpu, *reg);
-  update_sign_flag(cpu, *reg);
-  update_parity_flag(cpu, *reg);
+  set_szp(cpu, *reg);
   return 5; // NOLINT
 }
 
 // Increment Register Pair
 int
-INX(i8080 *cpu, int pair)
+INX(uint16_t *pair)
 {
-  uint16_t value = readRegisterPair(cpu, pair) + 1;
-  writeRegisterPair(cpu, pair, value);
+  *pair += 1;
   return 5; // NOLINT
 }
 
@@ -183,16 +169,15 @@ INX(i8080 *cpu, int pair)
 int
 JMP(i8080 *cpu)
 {
-  writeRegisterPair(cpu, PC, getImmediate16BitValue(cpu));
+  cpu->pc = getImmediate16BitValue(cpu);
   return 10; // NOLINT
 }
 
 // Load Accumulator
 int
-LDAX(i8080 *cpu, int pair)
+LDAX(i8080 *cpu, const uint16_t *pair)
 {
-  uint16_t address = readRegisterPair(cpu, pair);
-  cpu->a = cpu_read_mem(cpu, address);
+  cpu->a = cpu_read_mem(cpu, *pair);
   return 7; // NOLINT
 }
 
@@ -207,9 +192,9 @@ LHLD(i8080 *cpu, u_int16_t address)
 
 // Load 16-bit Data to Register Pair
 int
-LXI(i8080 *cpu, int pair, uint16_t value)
+LXI(uint16_t *pair, uint16_t value)
 {
-  writeRegisterPair(cpu, pair, value);
+  *pair = value;
   return 10; // NOLINT
 }
 
@@ -225,7 +210,7 @@ MOV(uint8_t *dest, const uint8_t *src)
 int
 MOV_TO_MEM(i8080 *cpu, const uint8_t *reg)
 {
-  cpu_write_mem(cpu, readRegisterPair(cpu, HL), *reg);
+  cpu_write_mem(cpu, cpu->hl, *reg);
   return 7; // NOLINT
 }
 
@@ -233,7 +218,7 @@ MOV_TO_MEM(i8080 *cpu, const uint8_t *reg)
 int
 MOV_FROM_MEM(i8080 *cpu, uint8_t *reg)
 {
-  *reg = cpu_read_mem(cpu, readRegisterPair(cpu, HL));
+  *reg = cpu_read_mem(cpu, cpu->hl);
   return 7; // NOLINT
 }
 
@@ -259,28 +244,26 @@ ORA(i8080 *cpu, u_int8_t value)
   cpu->a |= value;
   // always set to 0
   update_carry_flag(cpu, false);
-  update_parity_flag(cpu, cpu->a);
-  update_sign_flag(cpu, cpu->a);
-  update_zero_flag(cpu, cpu->a);
+  set_ac(cpu, 0, 0, 0);
+  set_szp(cpu, cpu->a);
   return 4;
 }
 
 // Pop from Stack
 int
-POP(i8080 *cpu, int pair)
+POP(i8080 *cpu, uint16_t *pair)
 {
-  uint16_t value = ((cpu_read_mem(cpu, cpu->sp + 1) << BYTE)
-                    | cpu_read_mem(cpu, cpu->sp));
-  writeRegisterPair(cpu, pair, value);
+  *pair = (uint16_t)((cpu_read_mem(cpu, cpu->sp + 1) << BYTE)
+                     | cpu_read_mem(cpu, cpu->sp));
   cpu->sp += 2;
   return 10; // NOLINT
 }
 
 // Push to Stack
 int
-PUSH(i8080 *cpu, int pair)
+PUSH(i8080 *cpu, const uint16_t *pair)
 {
-  uint16_t value = readRegisterPair(cpu, pair);
+  uint16_t value = *pair;
   cpu_write_mem(cpu, cpu->sp - 1,
                 (uint8_t)((value & UPPER_8_BIT_MASK) >> BYTE));
   cpu_write_mem(cpu, cpu->sp - 2, (uint8_t)(value & LOWER_8_BIT_MASK));
@@ -295,34 +278,53 @@ RET(i8080 *cpu)
   uint16_t address = ((cpu_read_mem(cpu, cpu->sp + 1) << BYTE)
                       | cpu_read_mem(cpu, cpu->sp));
   cpu->sp += 2;
-  writeRegisterPair(cpu, PC, address);
+  cpu->pc = address;
   return 10; // NOLINT
 }
 
-// Subtract Immediate Value with Borrow
+// Restart, a one byte call to the vector for n
 int
-SBI(i8080 *cpu, u_int8_t value)
+RST(i8080 *cpu, uint8_t n)
+{
+  uint16_t return_address = cpu->pc + 1;
+  cpu_write_mem(cpu, cpu->sp - 1,
+                (uint8_t)((return_address & UPPER_8_BIT_MASK) >> BYTE));
+  cpu_write_mem(cpu, cpu->sp - 2,
+                (uint8_t)(return_address & LOWER_8_BIT_MASK));
+  cpu->sp -= 2;
+  cpu->pc = BYTE * n;
+  return 11; // NOLINT
+}
+
+// Subtract Register or Memory from Accumulator with Borrow
+int
+SBB(i8080 *cpu, u_int8_t value)
 {
   // get carry bit and add A, register and CY together
   uint8_t carry = ((cpu->flags & FLAG_CY) == FLAG_CY);
 
-  // set A to sum and set flags
-  update_aux_carry_flag(cpu, cpu->a, (~value + carry));
+  // the 8080 subtracts by adding the complement, AC is the carry out of
+  // bit 3 of A + ~value + !CY
+  set_ac(cpu, cpu->a, ~value, !carry);
   update_carry_flag(cpu, cpu->a < (value + carry));
   cpu->a = cpu->a - (value + carry);
-  update_zero_flag(cpu, cpu->a);
-  update_sign_flag(cpu, cpu->a);
-  update_parity_flag(cpu, cpu->a);
+  set_szp(cpu, cpu->a);
 
-  return 7; // NOLINT
+  return 4; // NOLINT
+}
+
+// Subtract Immediate Value with Borrow
+int
+SBI(i8080 *cpu, u_int8_t value)
+{
+  return SBB(cpu, value) + 3; // 7 cycles
 }
 
 // Store Accumulator
 int
-STAX(i8080 *cpu, int pair)
+STAX(i8080 *cpu, const uint16_t *pair)
 {
-  uint16_t address = readRegisterPair(cpu, pair);
-  cpu_write_mem(cpu, address, cpu->a);
+  cpu_write_mem(cpu, *pair, cpu->a);
   return 7; // NOLINT
 }
 
@@ -331,12 +333,10 @@ int
 SUB(i8080 *cpu, const uint8_t value)
 {
   // set flags and subtract register value from accumulator
-  update_aux_carry_flag(cpu, cpu->a, ((u_int8_t)~value + 1));
+  set_ac(cpu, cpu->a, ~value, 1);
   update_carry_flag(cpu, cpu->a < value); // carry if borrow
   cpu->a = cpu->a - value;
-  update_zero_flag(cpu, cpu->a);
-  update_sign_flag(cpu, cpu->a);
-  update_parity_flag(cpu, cpu->a);
+  set_szp(cpu, cpu->a);
   return 4; // NOLINT
 }
 
@@ -345,10 +345,8 @@ int
 XRA(i8080 *cpu, const uint8_t *reg)
 {
   cpu->a = cpu->a ^ *reg;
-  update_zero_flag(cpu, cpu->a);
-  update_sign_flag(cpu, cpu->a);
-  update_parity_flag(cpu, cpu->a);
-  update_aux_carry_flag(cpu, cpu->a, MAX_8_BIT_VALUE);
+  set_szp(cpu, cpu->a);
+  set_ac(cpu, 0, 0, 0); // always cleared
   update_carry_flag(cpu, false);
   return 4; // NOLINT
 }
@@ -369,36 +367,29 @@ getImmediate16BitValue(i8080 *cpu)
   return (uint16_t)((hi << BYTE) | lo);
 }
 
-// Get 16-bit value for given register pair
-uint16_t
-readRegisterPair(i8080 *cpu, int pair)
+/*
+Register pairs by number. The instructions resolve their pair at decode time
+and use the union members directly, these are for tests and debugging code
+that pick a pair at run time.
+*/
+static uint16_t *
+register_pair(i8080 *cpu, int pair)
 {
   switch (pair)
     {
     case PSW:
-      {
-        return (uint16_t)((cpu->a << BYTE) | cpu->flags);
-      }
+      cpu_sync_flags(cpu);
+      return &cpu->psw;
     case BC:
-      {
-        return (uint16_t)((cpu->b << BYTE) | cpu->c);
-      }
+      return &cpu->bc;
     case DE:
-      {
-        return (uint16_t)((cpu->d << BYTE) | cpu->e);
-      }
+      return &cpu->de;
     case HL:
-      {
-        return (uint16_t)((cpu->h << BYTE) | cpu->l);
-      }
+      return &cpu->hl;
     case SP:
-      {
-        return cpu->sp;
-      }
+      return &cpu->sp;
     case PC:
-      {
-        return cpu->pc;
-      }
+      return &cpu->pc;
     default:
       {
         fprintf(stderr, "Invalid register pair: %d", pair);
@@ -407,96 +398,71 @@ readRegisterPair(i8080 *cpu, int pair)
     }
 }
 
+// Get 16-bit value for given register pair
+uint16_t
+readRegisterPair(i8080 *cpu, int pair)
+{
+  return *register_pair(cpu, pair);
+}
+
 // Write 16-bit value to given register pair
 void
 writeRegisterPair(i8080 *cpu, int pair, uint16_t value)
 {
-  switch (pair)
-    {
-    case PSW:
-      {
-        cpu->a = (uint8_t)((value & UPPER_8_BIT_MASK) >> BYTE);
-        cpu->flags = (uint8_t)(value & LOWER_8_BIT_MASK);
-        break;
-      }
-    case BC:
-      {
-        cpu->b = (uint8_t)((value & UPPER_8_BIT_MASK) >> BYTE);
-        cpu->c = (uint8_t)(value & LOWER_8_BIT_MASK);
-        break;
-      }
-    case DE:
-      {
-        cpu->d = (uint8_t)((value & UPPER_8_BIT_MASK) >> BYTE);
-        cpu->e = (uint8_t)(value & LOWER_8_BIT_MASK);
-        break;
-      }
-    case HL:
-      {
-        cpu->h = (uint8_t)((value & UPPER_8_BIT_MASK) >> BYTE);
-        cpu->l = (uint8_t)(value & LOWER_8_BIT_MASK);
-        break;
-      }
-    case SP:
-      {
-        cpu->sp = value;
-        break;
-      }
-    case PC:
-      {
-        cpu->pc = value;
-        break;
-      }
-    default:
-      {
-        fprintf(stderr, "Invalid register pair: %d", pair);
-        exit(EXIT_FAILURE);
-      }
-    }
+  *register_pair(cpu, pair) = value;
 }
 
-// Execute Instruction
+/*
+Execute Instruction. The cases only do the work: the cycles and the PC step
+past the operands come from opcode_table after the switch, so the two cannot
+drift apart. A branch that moves PC returns at once with the taken cycles.
+*/
 int
 execute_instruction(i8080 *cpu, uint8_t opcode)
 {
-  int num_cycles = 0;
+  const opcode_info *info = &opcode_table[opcode];
   switch (opcode)
     {
     case 0x00: // NOLINT
-      {        // NOP
-        num_cycles = NOP();
+    case 0x08: // NOLINT
+    case 0x10: // NOLINT
+    case 0x18: // NOLINT
+    case 0x20: // NOLINT
+    case 0x28: // NOLINT
+    case 0x30: // NOLINT
+    case 0x38: // NOLINT
+      {        // NOP, *NOP
+        NOP();
         break;
       }
     case 0x01: // NOLINT
       {        // LXI B
-        num_cycles = LXI(cpu, BC, getImmediate16BitValue(cpu));
-        cpu->pc += 2;
+        LXI(&cpu->bc, getImmediate16BitValue(cpu));
         break;
       }
     case 0x02: // NOLINT
       {        // STAX B
-        num_cycles = STAX(cpu, BC);
+        STAX(cpu, &cpu->bc);
         break;
       }
     case 0x03: // NOLINT
       {        // INX B
-        num_cycles = INX(cpu, BC);
+        INX(&cpu->bc);
         break;
       }
     case 0x04: // NOLINT
       {        // INR B
-        num_cycles = INR(cpu, &cpu->b);
+        INR(cpu, &cpu->b);
         break;
       }
     case 0x05: // NOLINT
       {        // DCR B
-        num_cycles = DCR(cpu, &cpu->b);
+        DCR(cpu, &cpu->b);
         break;
       }
     case 0x06: // NOLINT
       {        // MVI B, mem8
-        num_cycles = MVI(&cpu->b, getImmediate8BitValue(cpu));
-        cpu->pc += 1;
+        MVI(&cpu->b, getImmediate8BitValue(cpu));
         break;
       }
     case 0x07: // NOLINT
@@ -519,38 +485,36 @@ execute_instruction(i8080 *cpu, uint8_t opcode)
           {
             update_carry_flag(cpu, false);
           }
-        num_cycles = 4; // NOLINT
         break;
       }
     case 0x09: // NOLINT
       {        // DAD B
-        num_cycles = DAD(cpu, BC);
+        DAD(cpu, &cpu->bc);
         break;
       }
     case 0x0a: // NOLINT
       {        // LDAX B
-        num_cycles = LDAX(cpu, BC);
+        LDAX(cpu, &cpu->bc);
         break;
       }
     case 0x0b: // NOLINT
       {        // DCX B
-        num_cycles = DCX(cpu, BC);
+        DCX(&cpu->bc);
         break;
       }
     case 0x0c: // NOLINT
       {        // INR C
-        num_cycles = INR(cpu, &cpu->c);
+        INR(cpu, &cpu->c);
         break;
       }
     case 0x0d: // NOLINT
       {        // DCR C
-        num_cycles = DCR(cpu, &cpu->c);
+        DCR(cpu, &cpu->c);
         break;
       }
     case 0x0e: // NOLINT
       {        // MVI C, D8
-        num_cycles = MVI(&cpu->c, getImmediate8BitValue(cpu));
-        cpu->pc += 1;
+        MVI(&cpu->c, getImmediate8BitValue(cpu));
         break;
       }
     case 0x0f: // NOLINT
@@ -573,70 +537,84 @@ execute_instruction(i8080 *cpu, uint8_t opcode)
           {
             update_carry_flag(cpu, false);
           }
-        num_cycles = 4; // NOLINT
         break;
       }
     case 0x11: // NOLINT
       {        // LXI D
-        num_cycles = LXI(cpu, DE, getImmediate16BitValue(cpu));
-        cpu->pc += 2;
+        LXI(&cpu->de, getImmediate16BitValue(cpu));
         break;
       }
     case 0x12: // NOLINT
       {        // STAX D
-        num_cycles = STAX(cpu, DE);
+        STAX(cpu, &cpu->de);
         break;
       }
     case 0x13: // NOLINT
       {        // INX D
-        num_cycles = INX(cpu, DE);
+        INX(&cpu->de);
         break;
       }
     case 0x14: // NOLINT
       {        // INR D
-        num_cycles = INR(cpu, &cpu->d);
+        INR(cpu, &cpu->d);
         break;
       }
     case 0x15: // NOLINT
       {        // DCR D
-        num_cycles = DCR(cpu, &cpu->d);
+        DCR(cpu, &cpu->d);
         break;
       }
     case 0x16: // NOLINT
       {        // MVI D
-        num_cycles = MVI(&cpu->d, getImmediate8BitValue(cpu));
-        cpu->pc += 1;
+        MVI(&cpu->d, getImmediate8BitValue(cpu));
+        break;
+      }
+    case 0x17: // NOLINT
+      {        // RAL
+        // keep old bit 7
+        uint8_t bit7 = cpu->a >> 7; // NOLINT
+
+        // left shift register a by 1
+        cpu->a = cpu->a << 1;
+
+        // replace bit 0 with old CY value
+        if ((cpu->flags & FLAG_CY) != 0)
+          {
+            cpu->a |= 0x01; // NOLINT
+          }
+
+        // set new CY to previous bit 7
+        update_carry_flag(cpu, bit7 != 0);
         break;
       }
     case 0x19: // NOLINT
       {        // DAD D
-        num_cycles = DAD(cpu, DE);
+        DAD(cpu, &cpu->de);
         break;
       }
     case 0x1a: // NOLINT
       {        // LDAX D
-        num_cycles = LDAX(cpu, DE);
+        LDAX(cpu, &cpu->de);
         break;
       }
     case 0x1b: // NOLINT
       {        // DCX D
-        num_cycles = DCX(cpu, DE);
+        DCX(&cpu->de);
         break;
       }
     case 0x1c: // NOLINT
       {        // INR E
-        num_cycles = INR(cpu, &cpu->e);
+        INR(cpu, &cpu->e);
         break;
       }
     case 0x1d: // NOLINT
       {        // DCR E
-        num_cycles = DCR(cpu, &cpu->e);
+        DCR(cpu, &cpu->e);
         break;
       }
     case 0x1e: // NOLINT
       {        // MVI E
-        num_cycles = MVI(&cpu->e, getImmediate8BitValue(cpu));
-        cpu->pc += 1;
+        MVI(&cpu->e, getImmediate8BitValue(cpu));
         break;
       }
     case 0x1f: // NOLINT
@@ -663,13 +641,11 @@ execute_instruction(i8080 *cpu, uint8_t opcode)
             update_carry_flag(cpu, false);
           }
 
-        num_cycles = 4; // NOLINT
         break;
       }
     case 0x21: // NOLINT
       {        // LXI H
-        num_cycles = LXI(cpu, HL, getImmediate16BitValue(cpu));
-        cpu->pc += 2;
+        LXI(&cpu->hl, getImmediate16BitValue(cpu));
         break;
       }
     case 0x22: // NOLINT
@@ -677,608 +653,1024 @@ execute_instruction(i8080 *cpu, uint8_t opcode)
         uint16_t address = getImmediate16BitValue(cpu);
         cpu_write_mem(cpu, address, cpu->l);
         cpu_write_mem(cpu, (address + 1), cpu->h);
-        num_cycles = 16; // NOLINT
-        cpu->pc += 2;
         break;
       }
     case 0x23: // NOLINT
       {        // INX H
-        num_cycles = INX(cpu, HL);
+        INX(&cpu->hl);
         break;
       }
     case 0x24: // NOLINT
       {        // INR H
-        num_cycles = INR(cpu, &cpu->h);
+        INR(cpu, &cpu->h);
         break;
       }
     case 0x25: // NOLINT
       {        // DCR H
-        num_cycles = DCR(cpu, &cpu->h);
+        DCR(cpu, &cpu->h);
         break;
       }
     case 0x26: // NOLINT
       {        // MVI H, D8
-        num_cycles = MVI(&cpu->h, getImmediate8BitValue(cpu));
-        cpu->pc += 1;
+        MVI(&cpu->h, getImmediate8BitValue(cpu));
         break;
       }
     case 0x27: // NOLINT
       {        // DAA
-        num_cycles = DAA(cpu);
+        DAA(cpu);
         break;
       }
     case 0x29: // NOLINT
       {        // DAD H
-        num_cycles = DAD(cpu, HL);
+        DAD(cpu, &cpu->hl);
         break;
       }
     case 0x2a: // NOLINT
       {        // LHLD
-        num_cycles = LHLD(cpu, getImmediate16BitValue(cpu));
-        cpu->pc += 2;
+        LHLD(cpu, getImmediate16BitValue(cpu));
         break;
       }
     case 0x2b: // NOLINT
       {        // DCX H
-        num_cycles = DCX(cpu, HL);
+        DCX(&cpu->hl);
         break;
       }
     case 0x2c: // NOLINT
       {        // INR L
-        num_cycles = INR(cpu, &cpu->l);
+        INR(cpu, &cpu->l);
+        break;
+      }
+    case 0x2d: // NOLINT
+      {        // DCR L
+        DCR(cpu, &cpu->l);
         break;
       }
     case 0x2e: // NOLINT
       {        // MVI L
-        num_cycles = MVI(&cpu->l, getImmediate8BitValue(cpu));
-        cpu->pc += 1;
+        MVI(&cpu->l, getImmediate8BitValue(cpu));
         break;
       }
     case 0x2f: // NOLINT
       {        // CMA
         cpu->a = ~cpu->a;
-        num_cycles = 4;
         break;
       }
     case 0x31: // NOLINT
       {        // LXI SP
-        num_cycles = LXI(cpu, SP, getImmediate16BitValue(cpu));
-        cpu->pc += 2;
+        LXI(&cpu->sp, getImmediate16BitValue(cpu));
         break;
       }
     case 0x32: // NOLINT
       {        // STA
         uint16_t address = getImmediate16BitValue(cpu);
         cpu_write_mem(cpu, address, cpu->a);
-        cpu->pc += 2;
-        num_cycles = 13; // NOLINT
+        break;
+      }
+    case 0x33: // NOLINT
+      {        // INX SP
+        INX(&cpu->sp);
         break;
       }
     case 0x34: // NOLINT
       {        // INR M
-        uint16_t address = readRegisterPair(cpu, HL);
+        uint16_t address = cpu->hl;
         uint8_t value = cpu_read_mem(cpu, address);
-        update_aux_carry_flag(cpu, value, 0x01);
+        set_ac(cpu, value, 0x01, 0);
         value += 1;
-        update_zero_flag(cpu, value);
-        update_sign_flag(cpu, value);
-        update_parity_flag(cpu, value);
+        set_szp(cpu, value);
         cpu_write_mem(cpu, address, value);
-        num_cycles = 10; // NOLINT
         break;
       }
     case 0x35: // NOLINT
       {        // DCR M
-        uint16_t address = readRegisterPair(cpu, HL);
+        uint16_t address = cpu->hl;
         uint8_t mem_value = cpu_read_mem(cpu, address);
         uint8_t result = mem_value - 1;
-        update_zero_flag(cpu, result);
-        update_sign_flag(cpu, result);
-        update_parity_flag(cpu, result);
-        update_aux_carry_flag(cpu, mem_value, MAX_8_BIT_VALUE);
+        set_szp(cpu, result);
+        set_ac(cpu, mem_value, MAX_8_BIT_VALUE, 0);
         cpu_write_mem(cpu, address, result);
-        num_cycles = 10; // NOLINT
         break;
       }
     case 0x36: // NOLINT
       {        // MVI M, D8
-        uint16_t address = readRegisterPair(cpu, HL);
+        uint16_t address = cpu->hl;
         uint8_t value = getImmediate8BitValue(cpu);
 
         cpu_write_mem(cpu, address, value);
 
-        cpu->pc += 1;
-        num_cycles = 10; // NOLINT
         break;
       }
     case 0x37: // NOLINT
       {        // STC
         cpu->flags |= FLAG_CY;
-        num_cycles = 4; // NOLINT
+        break;
+      }
+    case 0x39: // NOLINT
+      {        // DAD SP
+        DAD(cpu, &cpu->sp);
         break;
       }
     case 0x3a: // NOLINT
       {        // LDA adr
         uint16_t addr = getImmediate16BitValue(cpu);
         cpu->a = cpu_read_mem(cpu, addr);
-        cpu->pc += 2;
-        num_cycles = 13; // NOLINT
+        break;
+      }
+    case 0x3b: // NOLINT
+      {        // DCX SP
+        DCX(&cpu->sp);
         break;
       }
     case 0x3c: // NOLINT
       {        // INR A
-        num_cycles = INR(cpu, &cpu->a);
+        INR(cpu, &cpu->a);
         break;
       }
     case 0x3d: // NOLINT
       {        // DCR A
-        num_cycles = DCR(cpu, &cpu->a);
+        DCR(cpu, &cpu->a);
         break;
       }
     case 0x3e: // NOLINT
       {        // MVI A
-        num_cycles = MVI(&cpu->a, getImmediate8BitValue(cpu));
-        cpu->pc += 1;
+        MVI(&cpu->a, getImmediate8BitValue(cpu));
+        break;
+      }
+    case 0x3f: // NOLINT
+      {        // CMC
+        cpu->flags ^= FLAG_CY;
         break;
       }
     case 0x40: // NOLINT
       {        // MOV B,B
-        num_cycles = MOV(&cpu->b, &cpu->b);
+        MOV(&cpu->b, &cpu->b);
         break;
       }
     case 0x41: // NOLINT
       {        // MOV B,C
-        num_cycles = MOV(&cpu->b, &cpu->c);
+        MOV(&cpu->b, &cpu->c);
         break;
       }
     case 0x42: // NOLINT
       {        // MOV B,D
-        num_cycles = MOV(&cpu->b, &cpu->d);
+        MOV(&cpu->b, &cpu->d);
         break;
       }
     case 0x43: // NOLINT
       {        // MOV B,E
-        num_cycles = MOV(&cpu->b, &cpu->e);
+        MOV(&cpu->b, &cpu->e);
         break;
       }
     case 0x44: // NOLINT
       {        // MOV B,H
-        num_cycles = MOV(&cpu->b, &cpu->h);
+        MOV(&cpu->b, &cpu->h);
+        break;
+      }
+    case 0x45: // NOLINT
+      {        // MOV B,L
+        MOV(&cpu->b, &cpu->l);
         break;
       }
     case 0x46: // NOLINT
       {        // MOV B,M
-        num_cycles = MOV_FROM_MEM(cpu, &cpu->b);
+        MOV_FROM_MEM(cpu, &cpu->b);
         break;
       }
     case 0x47: // NOLINT
       {        // MOV B,A
-        num_cycles = MOV(&cpu->b, &cpu->a);
+        MOV(&cpu->b, &cpu->a);
         break;
       }
     case 0x48: // NOLINT
       {        // MOV C,B
-        num_cycles = MOV(&cpu->c, &cpu->b);
+        MOV(&cpu->c, &cpu->b);
+        break;
+      }
+    case 0x49: // NOLINT
+      {        // MOV C,C
+        MOV(&cpu->c, &cpu->c);
+        break;
+      }
+    case 0x4a: // NOLINT
+      {        // MOV C,D
+        MOV(&cpu->c, &cpu->d);
+        break;
+      }
+    case 0x4b: // NOLINT
+      {        // MOV C,E
+        MOV(&cpu->c, &cpu->e);
+        break;
+      }
+    case 0x4c: // NOLINT
+      {        // MOV C,H
+        MOV(&cpu->c, &cpu->h);
+        break;
+      }
+    case 0x4d: // NOLINT
+      {        // MOV C,L
+        MOV(&cpu->c, &cpu->l);
         break;
       }
     case 0x4e: // NOLINT
       {        // MOV C,M
-        num_cycles = MOV_FROM_MEM(cpu, &cpu->c);
+        MOV_FROM_MEM(cpu, &cpu->c);
         break;
       }
     case 0x4f: // NOLINT
       {        // MOV C,A
-        num_cycles = MOV(&cpu->c, &cpu->a);
+        MOV(&cpu->c, &cpu->a);
+        break;
+      }
+    case 0x50: // NOLINT
+      {        // MOV D,B
+        MOV(&cpu->d, &cpu->b);
+        break;
+      }
+    case 0x51: // NOLINT
+      {        // MOV D,C
+        MOV(&cpu->d, &cpu->c);
+        break;
+      }
+    case 0x52: // NOLINT
+      {        // MOV D,D
+        MOV(&cpu->d, &cpu->d);
+        break;
+      }
+    case 0x53: // NOLINT
+      {        // MOV D,E
+        MOV(&cpu->d, &cpu->e);
+        break;
+      }
+    case 0x54: // NOLINT
+      {        // MOV D,H
+        MOV(&cpu->d, &cpu->h);
+        break;
+      }
+    case 0x55: // NOLINT
+      {        // MOV D,L
+        MOV(&cpu->d, &cpu->l);
         break;
       }
     case 0x56: // NOLINT
       {        // MOV D,M
-        num_cycles = MOV_FROM_MEM(cpu, &cpu->d);
+        MOV_FROM_MEM(cpu, &cpu->d);
         break;
       }
     case 0x57: // NOLINT
       {        // MOV D,A
-        num_cycles = MOV(&cpu->d, &cpu->a);
+        MOV(&cpu->d, &cpu->a);
+        break;
+      }
+    case 0x58: // NOLINT
+      {        // MOV E,B
+        MOV(&cpu->e, &cpu->b);
+        break;
+      }
+    case 0x59: // NOLINT
+      {        // MOV E,C
+        MOV(&cpu->e, &cpu->c);
+        break;
+      }
+    case 0x5a: // NOLINT
+      {        // MOV E,D
+        MOV(&cpu->e, &cpu->d);
+        break;
+      }
+    case 0x5b: // NOLINT
+      {        // MOV E,E
+        MOV(&cpu->e, &cpu->e);
+        break;
+      }
+    case 0x5c: // NOLINT
+      {        // MOV E,H
+        MOV(&cpu->e, &cpu->h);
+        break;
+      }
+    case 0x5d: // NOLINT
+      {        // MOV E,L
+        MOV(&cpu->e, &cpu->l);
         break;
       }
     case 0x5e: // NOLINT
       {        // MOV E,M
-        num_cycles = MOV_FROM_MEM(cpu, &cpu->e);
+        MOV_FROM_MEM(cpu, &cpu->e);
         break;
       }
     case 0x5f: // NOLINT
       {        // MOV E,A
-        num_cycles = MOV(&cpu->e, &cpu->a);
+        MOV(&cpu->e, &cpu->a);
+        break;
+      }
+    case 0x60: // NOLINT
+      {        // MOV H,B
+        MOV(&cpu->h, &cpu->b);
         break;
       }
     case 0x61: // NOLINT
       {        // MOV H,C
-        num_cycles = MOV(&cpu->h, &cpu->c);
+        MOV(&cpu->h, &cpu->c);
+        break;
+      }
+    case 0x62: // NOLINT
+      {        // MOV H,D
+        MOV(&cpu->h, &cpu->d);
+        break;
+      }
+    case 0x63: // NOLINT
+      {        // MOV H,E
+        MOV(&cpu->h, &cpu->e);
         break;
       }
     case 0x64: // NOLINT
       {        // MOV H,H
-        num_cycles = MOV(&cpu->h, &cpu->h);
+        MOV(&cpu->h, &cpu->h);
         break;
       }
     case 0x65: // NOLINT
       {        // MOV H,L
-        num_cycles = MOV(&cpu->h, &cpu->l);
+        MOV(&cpu->h, &cpu->l);
         break;
       }
     case 0x66: // NOLINT
       {        // MOV H,M
-        num_cycles = MOV_FROM_MEM(cpu, &cpu->h);
+        MOV_FROM_MEM(cpu, &cpu->h);
         break;
       }
     case 0x67: // NOLINT
       {        // MOV H,A
-        num_cycles = MOV(&cpu->h, &cpu->a);
+        MOV(&cpu->h, &cpu->a);
         break;
       }
     case 0x68: // NOLINT
       {        // MOV L,B
-        num_cycles = MOV(&cpu->l, &cpu->b);
+        MOV(&cpu->l, &cpu->b);
         break;
       }
     case 0x69: // NOLINT
       {        // MOV L,C
-        num_cycles = MOV(&cpu->l, &cpu->c);
+        MOV(&cpu->l, &cpu->c);
+        break;
+      }
+    case 0x6a: // NOLINT
+      {        // MOV L,D
+        MOV(&cpu->l, &cpu->d);
+        break;
+      }
+    case 0x6b: // NOLINT
+      {        // MOV L,E
+        MOV(&cpu->l, &cpu->e);
+        break;
+      }
+    case 0x6c: // NOLINT
+      {        // MOV L,H
+        MOV(&cpu->l, &cpu->h);
+        break;
+      }
+    case 0x6d: // NOLINT
+      {        // MOV L,L
+        MOV(&cpu->l, &cpu->l);
+        break;
+      }
+    case 0x6e: // NOLINT
+      {        // MOV L,M
+        MOV_FROM_MEM(cpu, &cpu->l);
         break;
       }
     case 0x6f: // NOLINT
       {        // MOV L,A
-        num_cycles = MOV(&cpu->l, &cpu->a);
+        MOV(&cpu->l, &cpu->a);
         break;
       }
     case 0x70: // NOLINT
       {        // MOV M,B
-        num_cycles = MOV_TO_MEM(cpu, &cpu->b);
+        MOV_TO_MEM(cpu, &cpu->b);
         break;
       }
     case 0x71: // NOLINT
       {        // MOV M,C
-        num_cycles = MOV_TO_MEM(cpu, &cpu->c);
+        MOV_TO_MEM(cpu, &cpu->c);
         break;
       }
     case 0x72: // NOLINT
       {        // MOV M,D
-        num_cycles = MOV_TO_MEM(cpu, &cpu->d);
+        MOV_TO_MEM(cpu, &cpu->d);
         break;
       }
     case 0x73: // NOLINT
       {        // MOV M,E
-        num_cycles = MOV_TO_MEM(cpu, &cpu->e);
+        MOV_TO_MEM(cpu, &cpu->e);
+        break;
+      }
+    case 0x74: // NOLINT
+      {        // MOV M,H
+        MOV_TO_MEM(cpu, &cpu->h);
+        break;
+      }
+    case 0x75: // NOLINT
+      {        // MOV M,L
+        MOV_TO_MEM(cpu, &cpu->l);
+        break;
+      }
+    case 0x76: // NOLINT
+      {        // HLT
+        // wait for an interrupt, see cpu_step
+        cpu->halted = true;
         break;
       }
     case 0x77: // NOLINT
       {        // MOV M,A
-        num_cycles = MOV_TO_MEM(cpu, &cpu->a);
+        MOV_TO_MEM(cpu, &cpu->a);
         break;
       }
     case 0x78: // NOLINT
       {        // MOV A,B
-        num_cycles = MOV(&cpu->a, &cpu->b);
+        MOV(&cpu->a, &cpu->b);
         break;
       }
     case 0x79: // NOLINT
       {        // MOV A,C
-        num_cycles = MOV(&cpu->a, &cpu->c);
+        MOV(&cpu->a, &cpu->c);
         break;
       }
     case 0x7a: // NOLINT
       {        // MOV A,D
-        num_cycles = MOV(&cpu->a, &cpu->d);
+        MOV(&cpu->a, &cpu->d);
         break;
       }
     case 0x7b: // NOLINT
       {        // MOV A,E
-        num_cycles = MOV(&cpu->a, &cpu->e);
+        MOV(&cpu->a, &cpu->e);
         break;
       }
     case 0x7c: // NOLINT
       {        // MOV A,H
-        num_cycles = MOV(&cpu->a, &cpu->h);
+        MOV(&cpu->a, &cpu->h);
         break;
       }
     case 0x7d: // NOLINT
       {        // MOV A,L
-        num_cycles = MOV(&cpu->a, &cpu->l);
+        MOV(&cpu->a, &cpu->l);
         break;
       }
     case 0x7e: // NOLINT
       {        // MOV A,M
-        num_cycles = MOV_FROM_MEM(cpu, &cpu->a);
+        MOV_FROM_MEM(cpu, &cpu->a);
+        break;
+      }
+    case 0x7f: // NOLINT
+      {        // MOV A,A
+        MOV(&cpu->a, &cpu->a);
         break;
       }
     case 0x80: // NOLINT
       {        // ADD B
-        num_cycles = add_reg_accum(cpu, cpu->b);
+        add_reg_accum(cpu, cpu->b);
         break;
       }
     case 0x81: // NOLINT
       {        // ADD C
-        num_cycles = add_reg_accum(cpu, cpu->c);
+        add_reg_accum(cpu, cpu->c);
         break;
       }
     case 0x82: // NOLINT
       {        // ADD D
-        num_cycles = add_reg_accum(cpu, cpu->d);
+        add_reg_accum(cpu, cpu->d);
         break;
       }
     case 0x83: // NOLINT
       {        // ADD E
-        num_cycles = add_reg_accum(cpu, cpu->e);
+        add_reg_accum(cpu, cpu->e);
+        break;
+      }
+    case 0x84: // NOLINT
+      {        // ADD H
+        add_reg_accum(cpu, cpu->h);
         break;
       }
     case 0x85: // NOLINT
       {        // ADD L
-        num_cycles = add_reg_accum(cpu, cpu->l);
+        add_reg_accum(cpu, cpu->l);
         break;
       }
     case 0x86: // NOLINT
       {        // ADD M
-        num_cycles
-            = add_reg_accum(cpu, cpu_read_mem(cpu, readRegisterPair(cpu, HL)))
-              + 3;
+        add_reg_accum(cpu, cpu_read_mem(cpu, cpu->hl));
+        break;
+      }
+    case 0x87: // NOLINT
+      {        // ADD A
+        add_reg_accum(cpu, cpu->a);
+        break;
+      }
+    case 0x88: // NOLINT
+      {        // ADC B
+        ADC(cpu, &cpu->b);
+        break;
+      }
+    case 0x89: // NOLINT
+      {        // ADC C
+        ADC(cpu, &cpu->c);
         break;
       }
     case 0x8a: // NOLINT
       {        // ADC D
-        num_cycles = ADC(cpu, &cpu->d);
+        ADC(cpu, &cpu->d);
+        break;
+      }
+    case 0x8b: // NOLINT
+      {        // ADC E
+        ADC(cpu, &cpu->e);
+        break;
+      }
+    case 0x8c: // NOLINT
+      {        // ADC H
+        ADC(cpu, &cpu->h);
+        break;
+      }
+    case 0x8d: // NOLINT
+      {        // ADC L
+        ADC(cpu, &cpu->l);
+        break;
+      }
+    case 0x8e: // NOLINT
+      {        // ADC M
+        uint8_t value = cpu_read_mem(cpu, cpu->hl);
+        ADC(cpu, &value);
+        break;
+      }
+    case 0x8f: // NOLINT
+      {        // ADC A
+        ADC(cpu, &cpu->a);
+        break;
+      }
+    case 0x90: // NOLINT
+      {        // SUB B
+        SUB(cpu, cpu->b);
+        break;
+      }
+    case 0x91: // NOLINT
+      {        // SUB C
+        SUB(cpu, cpu->c);
+        break;
+      }
+    case 0x92: // NOLINT
+      {        // SUB D
+        SUB(cpu, cpu->d);
+        break;
+      }
+    case 0x93: // NOLINT
+      {        // SUB E
+        SUB(cpu, cpu->e);
+        break;
+      }
+    case 0x94: // NOLINT
+      {        // SUB H
+        SUB(cpu, cpu->h);
+        break;
+      }
+    case 0x95: // NOLINT
+      {        // SUB L
+        SUB(cpu, cpu->l);
+        break;
+      }
+    case 0x96: // NOLINT
+      {        // SUB M
+        SUB(cpu, cpu_read_mem(cpu, cpu->hl));
         break;
       }
     case 0x97: // NOLINT
       {        // SUB A
-        num_cycles = SUB(cpu, cpu->a);
+        SUB(cpu, cpu->a);
+        break;
+      }
+    case 0x98: // NOLINT
+      {        // SBB B
+        SBB(cpu, cpu->b);
+        break;
+      }
+    case 0x99: // NOLINT
+      {        // SBB C
+        SBB(cpu, cpu->c);
+        break;
+      }
+    case 0x9a: // NOLINT
+      {        // SBB D
+        SBB(cpu, cpu->d);
+        break;
+      }
+    case 0x9b: // NOLINT
+      {        // SBB E
+        SBB(cpu, cpu->e);
+        break;
+      }
+    case 0x9c: // NOLINT
+      {        // SBB H
+        SBB(cpu, cpu->h);
+        break;
+      }
+    case 0x9d: // NOLINT
+      {        // SBB L
+        SBB(cpu, cpu->l);
+        break;
+      }
+    case 0x9e: // NOLINT
+      {        // SBB M
+        SBB(cpu, cpu_read_mem(cpu, cpu->hl));
+        break;
+      }
+    case 0x9f: // NOLINT
+      {        // SBB A
+        SBB(cpu, cpu->a);
         break;
       }
     case 0xa0: // NOLINT
       {        // ANA B
-        num_cycles = ANA(cpu, cpu->b);
+        ANA(cpu, cpu->b);
         break;
       }
     case 0xa1: // NOLINT
       {        // ANA C
-        num_cycles = ANA(cpu, cpu->c);
+        ANA(cpu, cpu->c);
+        break;
+      }
+    case 0xa2: // NOLINT
+      {        // ANA D
+        ANA(cpu, cpu->d);
+        break;
+      }
+    case 0xa3: // NOLINT
+      {        // ANA E
+        ANA(cpu, cpu->e);
+        break;
+      }
+    case 0xa4: // NOLINT
+      {        // ANA H
+        ANA(cpu, cpu->h);
+        break;
+      }
+    case 0xa5: // NOLINT
+      {        // ANA L
+        ANA(cpu, cpu->l);
         break;
       }
     case 0xa6: // NOLINT
       {        // ANA M
-        num_cycles = ANA(cpu, cpu_read_mem(cpu, readRegisterPair(cpu, HL)))
-                     + 3; // 7 cycles
+        ANA(cpu, cpu_read_mem(cpu, cpu->hl));
         break;
       }
     case 0xa7: // NOLINT
       {        // ANA A
-        num_cycles = ANA(cpu, cpu->a);
+        ANA(cpu, cpu->a);
         break;
       }
     case 0xa8: // NOLINT
       {        // XRA B
-        num_cycles = XRA(cpu, &cpu->b);
+        XRA(cpu, &cpu->b);
+        break;
+      }
+    case 0xa9: // NOLINT
+      {        // XRA C
+        XRA(cpu, &cpu->c);
+        break;
+      }
+    case 0xaa: // NOLINT
+      {        // XRA D
+        XRA(cpu, &cpu->d);
+        break;
+      }
+    case 0xab: // NOLINT
+      {        // XRA E
+        XRA(cpu, &cpu->e);
+        break;
+      }
+    case 0xac: // NOLINT
+      {        // XRA H
+        XRA(cpu, &cpu->h);
+        break;
+      }
+    case 0xad: // NOLINT
+      {        // XRA L
+        XRA(cpu, &cpu->l);
+        break;
+      }
+    case 0xae: // NOLINT
+      {        // XRA M
+        uint8_t value = cpu_read_mem(cpu, cpu->hl);
+        XRA(cpu, &value);
         break;
       }
     case 0xaf: // NOLINT
       {        // XRA A
-        num_cycles = XRA(cpu, &cpu->a);
+        XRA(cpu, &cpu->a);
         break;
       }
     case 0xb0: // NOLINT
       {        // ORA B
-        num_cycles = ORA(cpu, cpu->b);
+        ORA(cpu, cpu->b);
+        break;
+      }
+    case 0xb1: // NOLINT
+      {        // ORA C
+        ORA(cpu, cpu->c);
+        break;
+      }
+    case 0xb2: // NOLINT
+      {        // ORA D
+        ORA(cpu, cpu->d);
+        break;
+      }
+    case 0xb3: // NOLINT
+      {        // ORA E
+        ORA(cpu, cpu->e);
         break;
       }
     case 0xb4: // NOLINT
       {        // ORA H
-        num_cycles = ORA(cpu, cpu->h);
+        ORA(cpu, cpu->h);
+        break;
+      }
+    case 0xb5: // NOLINT
+      {        // ORA L
+        ORA(cpu, cpu->l);
         break;
       }
     case 0xb6: // NOLINT
       {        // ORA M
-        num_cycles = ORA(cpu, cpu_read_mem(cpu, readRegisterPair(cpu, HL)))
-                     + 3; // 7 cycles
+        ORA(cpu, cpu_read_mem(cpu, cpu->hl));
+        break;
+      }
+    case 0xb7: // NOLINT
+      {        // ORA A
+        ORA(cpu, cpu->a);
         break;
       }
     case 0xb8: // NOLINT
       {        // CMP B
-        num_cycles = CMP(cpu, cpu->b);
+        CMP(cpu, cpu->b);
+        break;
+      }
+    case 0xb9: // NOLINT
+      {        // CMP C
+        CMP(cpu, cpu->c);
+        break;
+      }
+    case 0xba: // NOLINT
+      {        // CMP D
+        CMP(cpu, cpu->d);
+        break;
+      }
+    case 0xbb: // NOLINT
+      {        // CMP E
+        CMP(cpu, cpu->e);
         break;
       }
     case 0xbc: // NOLINT
       {        // CMP H
-        num_cycles = CMP(cpu, cpu->h);
+        CMP(cpu, cpu->h);
+        break;
+      }
+    case 0xbd: // NOLINT
+      {        // CMP L
+        CMP(cpu, cpu->l);
         break;
       }
     case 0xbe: // NOLINT
       {        // CMP M
-        num_cycles = CMP(cpu, cpu_read_mem(cpu, readRegisterPair(cpu, HL)))
-                     + 3; // 7 cyles
+        CMP(cpu, cpu_read_mem(cpu, cpu->hl));
+        break;
+      }
+    case 0xbf: // NOLINT
+      {        // CMP A
+        CMP(cpu, cpu->a);
         break;
       }
     case 0xc0:                          // NOLINT
       {                                 // RNZ
-        if ((cpu->flags & FLAG_Z) == 0) // if Z reset, RET
+        if (!is_zero_flag_set(cpu)) // if Z reset, RET
           {
-            return RET(cpu) + 1; // 11 cycles
+            RET(cpu);
+            return info->taken_cycles;
           }
-        num_cycles = 5; // NOLINT
         break;
       }
     case 0xc1: // NOLINT
       {        // POP B
-        num_cycles = POP(cpu, BC);
+        POP(cpu, &cpu->bc);
         break;
       }
     case 0xc2: // NOLINT
       {        // JNZ
-        if ((cpu->flags & FLAG_Z) == 0)
+        if (!is_zero_flag_set(cpu))
           {
-            return JMP(cpu);
+            JMP(cpu);
+            return info->taken_cycles;
           }
-        cpu->pc += 2;
-        num_cycles = 10; // NOLINT
         break;
       }
     case 0xc3: // NOLINT
-      {        // JMP
-        return JMP(cpu);
+    case 0xcb: // NOLINT
+      {        // JMP, *JMP
+        JMP(cpu);
+        return info->taken_cycles;
       }
     case 0xc4: // NOLINT
       {        // CNZ
-        if ((cpu->flags & FLAG_Z) == 0)
+        if (!is_zero_flag_set(cpu))
           {
-            return CALL(cpu, getImmediate16BitValue(cpu));
+            CALL(cpu, getImmediate16BitValue(cpu));
+            return info->taken_cycles;
           }
-        cpu->pc += 2;
-        num_cycles = 11; // NOLINT
         break;
       }
     case 0xc5: // NOLINT
       {        // PUSH B
-        num_cycles = PUSH(cpu, BC);
+        PUSH(cpu, &cpu->bc);
         break;
       }
     case 0xc6: // NOLINT
       {        // ADI
         uint8_t immediate = getImmediate8BitValue(cpu);
         uint16_t answer = cpu->a + immediate;
-        update_zero_flag(cpu, (uint8_t)answer);
-        update_sign_flag(cpu, (uint8_t)answer);
-        update_parity_flag(cpu, (uint8_t)answer);
+        set_szp(cpu, (uint8_t)answer);
         update_carry_flag(cpu, answer > MAX_8_BIT_VALUE);
-        update_aux_carry_flag(cpu, cpu->a, immediate);
+        set_ac(cpu, cpu->a, immediate, 0);
         cpu->a = (uint8_t)(answer & LOWER_8_BIT_MASK);
-        cpu->pc += 1;
-        num_cycles = 7; // NOLINT
         break;
       }
+    case 0xc7: // NOLINT
+      {        // RST 0
+        RST(cpu, 0);
+        return info->taken_cycles;
+      }
     case 0xc8:                               // NOLINT
       {                                      // RZ
-        if ((cpu->flags & FLAG_Z) == FLAG_Z) // if Z set, RET
+        if (is_zero_flag_set(cpu)) // if Z set, RET
           {
-            return RET(cpu) + 1; // 11 cycles
+            RET(cpu);
+            return info->taken_cycles;
           }
-        num_cycles = 5; // NOLINT
         break;
       }
     case 0xc9: // NOLINT
-      {        // RET
-        return RET(cpu);
+    case 0xd9: // NOLINT
+      {        // RET, *RET
+        RET(cpu);
+        return info->taken_cycles;
       }
     case 0xca: // NOLINT
       {        // JZ
         if (is_zero_flag_set(cpu))
           {
-            return JMP(cpu);
+            JMP(cpu);
+            return info->taken_cycles;
           }
-        cpu->pc += 2;    // NOLINT
-        num_cycles = 10; // NOLINT
         break;
       }
     case 0xcc: // NOLINT
       {        // CZ ADDR
-        if ((cpu->flags & FLAG_Z) == FLAG_Z)
+        if (is_zero_flag_set(cpu))
           {
-            return CALL(cpu, getImmediate16BitValue(cpu));
+            CALL(cpu, getImmediate16BitValue(cpu));
+            return info->taken_cycles;
           }
-        cpu->pc += 2;
-        num_cycles = 11; // NOLINT
         break;
       }
     case 0xcd: // NOLINT
-      {        // CALL ADDR
-        return CALL(cpu, getImmediate16BitValue(cpu));
+    case 0xdd: // NOLINT
+    case 0xed: // NOLINT
+    case 0xfd: // NOLINT
+      {        // CALL ADDR, *CALL
+        CALL(cpu, getImmediate16BitValue(cpu));
+        return info->taken_cycles;
+      }
+    case 0xce: // NOLINT
+      {        // ACI d8
+        uint8_t immediate = getImmediate8BitValue(cpu);
+        ADC(cpu, &immediate);
+        break;
+      }
+    case 0xcf: // NOLINT
+      {        // RST 1
+        RST(cpu, 1);
+        return info->taken_cycles;
       }
     case 0xd0: // NOLINT
       {        // RNC
         if ((cpu->flags & FLAG_CY) == 0)
           {
-            return RET(cpu) + 1; // 11 cycles
+            RET(cpu);
+            return info->taken_cycles;
           }
-        num_cycles = 5;
         break;
       }
     case 0xd1: // NOLINT
       {        // POP D
-        num_cycles = POP(cpu, DE);
+        POP(cpu, &cpu->de);
         break;
       }
     case 0xd2:                                 // NOLINT
       {                                        // JNC ADR
         if ((cpu->flags & FLAG_CY) != FLAG_CY) // if CY not set JUMP
           {
-            return JMP(cpu);
+            JMP(cpu);
+            return info->taken_cycles;
           }
-        cpu->pc += 2;
-        num_cycles = 10; // NOLINT
         break;
       }
     case 0xd3: // NOLINT
       {        // OUT d8
         uint8_t port = getImmediate8BitValue(cpu);
         port_out(cpu, port, cpu->a);
-        cpu->pc += 1;
-        num_cycles = 10;
         break;
       }
     case 0xd4: // NOLINT
       {        // CNC ADDR
         if ((cpu->flags & FLAG_CY) == 0)
           {
-            return CALL(cpu, getImmediate16BitValue(cpu));
+            CALL(cpu, getImmediate16BitValue(cpu));
+            return info->taken_cycles;
           }
-        cpu->pc += 2;
-        num_cycles = 11; // NOLINT
         break;
       }
     case 0xd5: // NOLINT
       {        // PUSH D
-        num_cycles = PUSH(cpu, DE);
+        PUSH(cpu, &cpu->de);
         break;
       }
     case 0xd6:                                                 // NOLINT
       {                                                        // SUI d8
-        num_cycles = SUB(cpu, getImmediate8BitValue(cpu)) + 3; // 7 cycles
-        cpu->pc += 1;
+        SUB(cpu, getImmediate8BitValue(cpu));
         break;
       }
+    case 0xd7: // NOLINT
+      {        // RST 2
+        RST(cpu, 2);
+        return info->taken_cycles;
+      }
     case 0xd8: // NOLINT
       {        // RC
         if ((cpu->flags & FLAG_CY) == FLAG_CY)
           {
-            return RET(cpu) + 1; // 11 cycles
+            RET(cpu);
+            return info->taken_cycles;
           }
-        num_cycles = 5;
         break;
       }
     case 0xda:                                 // NOLINT
       {                                        // JC ADR
         if ((cpu->flags & FLAG_CY) == FLAG_CY) // if CY set JUMP
           {
-            return JMP(cpu);
+            JMP(cpu);
+            return info->taken_cycles;
           }
-        cpu->pc += 2;
-        num_cycles = 10; // NOLINT
         break;
       }
     case 0xdb: // NOLINT
       {        // IN D8
         uint8_t port = getImmediate8BitValue(cpu);
         cpu->a = port_in(cpu, port);
-        cpu->pc += 1;
-        num_cycles = 10; // NOLINT
+        break;
+      }
+    case 0xdc: // NOLINT
+      {        // CC ADDR
+        if ((cpu->flags & FLAG_CY) == FLAG_CY)
+          {
+            CALL(cpu, getImmediate16BitValue(cpu));
+            return info->taken_cycles;
+          }
         break;
       }
     case 0xde: // NOLINT
       {
-        num_cycles = SBI(cpu, getImmediate8BitValue(cpu));
-        cpu->pc += 1;
+        SBI(cpu, getImmediate8BitValue(cpu));
+        break;
+      }
+    case 0xdf: // NOLINT
+      {        // RST 3
+        RST(cpu, 3);
+        return info->taken_cycles;
+      }
+    case 0xe0: // NOLINT
+      {        // RPO
+        if (!is_parity_flag_set(cpu))
+          {
+            RET(cpu);
+            return info->taken_cycles;
+          }
         break;
       }
     case 0xe1: // NOLINT
       {        // POP H
-        num_cycles = POP(cpu, HL);
+        POP(cpu, &cpu->hl);
+        break;
+      }
+    case 0xe2: // NOLINT
+      {        // JPO ADR
+        if (!is_parity_flag_set(cpu))
+          {
+            JMP(cpu);
+            return info->taken_cycles;
+          }
         break;
       }
     case 0xe3: // NOLINT
@@ -1291,54 +1683,127 @@ execute_instruction(i8080 *cpu, uint8_t opcode)
         cpu->l = cpu_read_mem(cpu, cpu->sp);
         cpu_write_mem(cpu, cpu->sp, tmp);
 
-        num_cycles = 18; // NOLINT
+        break;
+      }
+    case 0xe4: // NOLINT
+      {        // CPO ADDR
+        if (!is_parity_flag_set(cpu))
+          {
+            CALL(cpu, getImmediate16BitValue(cpu));
+            return info->taken_cycles;
+          }
         break;
       }
     case 0xe5: // NOLINT
       {        // PUSH H
-        num_cycles = PUSH(cpu, HL);
+        PUSH(cpu, &cpu->hl);
         break;
       }
     case 0xe6: // NOLINT
       {        // ANI d8
-        uint8_t immediate = getImmediate8BitValue(cpu);
-        cpu->a &= immediate;
-        update_zero_flag(cpu, cpu->a);
-        update_sign_flag(cpu, cpu->a);
-        update_parity_flag(cpu, cpu->a);
-        update_carry_flag(cpu, false);
-        cpu->flags &= ~FLAG_AC;
-        cpu->pc += 1;
-        num_cycles = 7; // NOLINT
+        ANA(cpu, getImmediate8BitValue(cpu));
+        break;
+      }
+    case 0xe7: // NOLINT
+      {        // RST 4
+        RST(cpu, 4);
+        return info->taken_cycles;
+      }
+    case 0xe8: // NOLINT
+      {        // RPE
+        if (is_parity_flag_set(cpu))
+          {
+            RET(cpu);
+            return info->taken_cycles;
+          }
         break;
       }
     case 0xe9: // NOLINT
       {        // PCHL
-        cpu->pc = readRegisterPair(cpu, HL);
-        return 5; // NOLINT
+        cpu->pc = cpu->hl;
+        return info->taken_cycles;
+      }
+    case 0xea: // NOLINT
+      {        // JPE ADR
+        if (is_parity_flag_set(cpu))
+          {
+            JMP(cpu);
+            return info->taken_cycles;
+          }
+        break;
       }
     case 0xeb: // NOLINT
       {        // XCHG
-        // exchange h and d
-        uint8_t temp = cpu->h;
-        cpu->h = cpu->d;
-        cpu->d = temp;
-
-        // exchange l and e
-        temp = cpu->l;
-        cpu->l = cpu->e;
-        cpu->e = temp;
-        num_cycles = 5; // NOLINT
+        // exchange hl and de
+        uint16_t temp = cpu->hl;
+        cpu->hl = cpu->de;
+        cpu->de = temp;
+        break;
+      }
+    case 0xec: // NOLINT
+      {        // CPE ADDR
+        if (is_parity_flag_set(cpu))
+          {
+            CALL(cpu, getImmediate16BitValue(cpu));
+            return info->taken_cycles;
+          }
+        break;
+      }
+    case 0xee: // NOLINT
+      {        // XRI d8
+        uint8_t immediate = getImmediate8BitValue(cpu);
+        XRA(cpu, &immediate);
+        break;
+      }
+    case 0xef: // NOLINT
+      {        // RST 5
+        RST(cpu, 5);
+        return info->taken_cycles;
+      }
+    case 0xf0: // NOLINT
+      {        // RP
+        if (!is_sign_flag_set(cpu))
+          {
+            RET(cpu);
+            return info->taken_cycles;
+          }
         break;
       }
     case 0xf1: // NOLINT
       {        // POP PSW
-        num_cycles = POP(cpu, PSW);
+        POP(cpu, &cpu->psw);
+        cpu->flags &= FLAGS_ALL; // the fixed bits are not flags
+        cpu->flags_pending = 0;
+        break;
+      }
+    case 0xf2: // NOLINT
+      {        // JP ADR
+        if (!is_sign_flag_set(cpu))
+          {
+            JMP(cpu);
+            return info->taken_cycles;
+          }
+        break;
+      }
+    case 0xf3: // NOLINT
+      {        // DI
+        cpu->interrupt_enabled = false;
+        break;
+      }
+    case 0xf4: // NOLINT
+      {        // CP ADDR
+        if (!is_sign_flag_set(cpu))
+          {
+            CALL(cpu, getImmediate16BitValue(cpu));
+            return info->taken_cycles;
+          }
         break;
       }
     case 0xf5: // NOLINT
       {        // PUSH PSW
-        num_cycles = PUSH(cpu, PSW);
+        cpu_sync_flags(cpu);
+        uint16_t psw = cpu->psw | PSW_SET_BITS;
+        PUSH(cpu, &psw);
         break;
       }
       break;
@@ -1346,122 +1811,142 @@ execute_instruction(i8080 *cpu, uint8_t opcode)
       {        // ORI d8
         uint8_t immediate = getImmediate8BitValue(cpu);
         cpu->a |= immediate;
-        update_zero_flag(cpu, cpu->a);
-        update_sign_flag(cpu, cpu->a);
-        update_parity_flag(cpu, cpu->a);
+        set_szp(cpu, cpu->a);
         update_carry_flag(cpu, false);
-        cpu->flags &= ~FLAG_AC;
-        cpu->pc += 1;
-        num_cycles = 7; // NOLINT
+        set_ac(cpu, 0, 0, 0); // always cleared
+        break;
+      }
+    case 0xf7: // NOLINT
+      {        // RST 6
+        RST(cpu, 6);
+        return info->taken_cycles;
+      }
+    case 0xf8: // NOLINT
+      {        // RM
+        if (is_sign_flag_set(cpu))
+          {
+            RET(cpu);
+            return info->taken_cycles;
+          }
+        break;
+      }
+    case 0xf9: // NOLINT
+      {        // SPHL
+        cpu->sp = cpu->hl;
         break;
       }
     case 0xfa: // NOLINT
       {        // JM
         if (is_sign_flag_set(cpu))
           {
-            return JMP(cpu);
+            JMP(cpu);
+            return info->taken_cycles;
           }
-        cpu->pc += 2;    // NOLINT
-        num_cycles = 10; // NOLINT
         break;
       }
     case 0xfb: // NOLINT
       {        // EI
         cpu->interrupt_enabled = true;
-        num_cycles = 4; // NOLINT
+        break;
+      }
+    case 0xfc: // NOLINT
+      {        // CM ADDR
+        if (is_sign_flag_set(cpu))
+          {
+            CALL(cpu, getImmediate16BitValue(cpu));
+            return info->taken_cycles;
+          }
         break;
       }
     case 0xfe: // NOLINT
       {        // CPI
         uint8_t data = getImmediate8BitValue(cpu);
         uint8_t result = cpu->a - data;
-        update_zero_flag(cpu, result);
-        update_sign_flag(cpu, result);
-        update_parity_flag(cpu, result);
+        set_szp(cpu, result);
         update_carry_flag(cpu, (data > cpu->a));
-        update_aux_carry_flag(cpu, cpu->a, (~data + 1));
-        cpu->pc += 1;
-        num_cycles = 7; // NOLINT
+        set_ac(cpu, cpu->a, ~data, 1);
         break;
       }
+    case 0xff: // NOLINT
+      {        // RST 7
+        RST(cpu, 7);
+        return info->taken_cycles;
+      }
     default:
       {
-        fprintf(stderr, "Error: opcode 0x%02x not found\n", opcode);
+        fprintf(stderr, "Error: opcode 0x%02x (%s) not implemented\n", opcode,
+                opcode_table[opcode].mnemonic);
         return -1;
       }
     }
-  cpu->pc += 1;
-  return num_cycles;
+  cpu->pc += info->length;
+  return info->cycles;
 }
+/*
+Sound effects are driven by single bits of ports 3 and 5. Every other sound
+starts on the rising edge of its bit; the UFO on port 3 bit 0 loops for as
+long as the bit stays set. Muted frames (run-ahead, rollback, hidden turbo
+frames) only move the latches: a speculative frame that clears the UFO bit
+must not stop the real loop. Whoever mutes calls cpu_sync_sound afterwards
+to bring the loop in line with the latch it is left with.
+*/
+static const uint8_t port3_sounds[] = { SOUND_UFO, SOUND_SHOT,
+                                        SOUND_PLAYER_DIES,
+                                        SOUND_INVADER_DIES };
+static const uint8_t port5_sounds[] = { SOUND_FLEET_1, SOUND_FLEET_2,
+                                        SOUND_FLEET_3, SOUND_FLEET_4,
+                                        SOUND_UFO_HIT };
+
 void
-load_sound(const char *soundFilePath, Mix_Chunk **sound)
+play_sound(i8080 *cpu, uint8_t bank)
 {
-  *sound = Mix_LoadWAV(soundFilePath);
-  if (*sound == NULL)
+  uint8_t data = cpu->a;
+  uint8_t *last = bank == 1 ? &cpu->last_out_port3 : &cpu->last_out_port5;
+  const uint8_t *sounds = bank == 1 ? port3_sounds : port5_sounds;
+  int count = bank == 1 ? (int)sizeof(port3_sounds)
+                        : (int)sizeof(port5_sounds);
+  uint8_t rising = data & ~*last;
+
+  *last = data;
+  if (cpu->sound_muted)
     {
-      fprintf(stderr, "Failed to load sound file!");
+      return;
+    }
+  if (bank == 1)
+    {
+      // the loop follows the level, which also picks up a change made
+      // while muted
+      cpu_sync_sound(cpu);
+      rising &= ~0x1;
+    }
+  for (int bit = 0; bit < count; bit++)
+    {
+      if (rising & (1 << bit))
+        {
+          audio_play(sounds[bit], cpu->cycles, false);
+        }
     }
 }
+
+// Start or stop the UFO loop to match the port 3 latch
 void
-play_sound(i8080 *cpu, uint8_t bank)
+cpu_sync_sound(i8080 *cpu)
 {
-  uint8_t data = cpu->a;
-  int sound_to_play = -1;
+  bool on = (cpu->last_out_port3 & 0x1) != 0;
 
-  if (bank == 1)
+  if (on == cpu->ufo_playing)
     {
-      if (data != cpu->last_out_port3)
-        {
-          if ((data & 0x1) && !(cpu->last_out_port3 & 0x1))
-            {
-              sound_to_play = 0;
-            }
-          if ((data & 0x2) && !(cpu->last_out_port3 & 0x2))
-            {
-              sound_to_play = 1;
-            }
-          if ((data & 0x4) && !(cpu->last_out_port3 & 0x4))
-            {
-              sound_to_play = 2;
-            }
-          if ((data & 0x8) && !(cpu->last_out_port3 & 0x8))
-            {
-              sound_to_play = 3;
-            }
-          cpu->last_out_port3 = data;
-        }
+      return;
     }
-  else if (bank == 2)
+  if (on)
     {
-      if (data != cpu->last_out_port5)
-        {
-          if ((data & 0x1) && !(cpu->last_out_port5 & 0x1))
-            {
-              sound_to_play = 4;
-            }
-          if ((data & 0x2) && !(cpu->last_out_port5 & 0x2))
-            {
-              sound_to_play = 5;
-            }
-          if ((data & 0x4) && !(cpu->last_out_port5 & 0x4))
-            {
-              sound_to_play = 6;
-            }
-          if ((data & 0x8) && !(cpu->last_out_port5 & 0x8))
-            {
-              sound_to_play = 7;
-            }
-          if ((data & 0x10) && !(cpu->last_out_port5 & 0x10))
-            {
-              sound_to_play = 8;
-            }
-          cpu->last_out_port5 = data;
-        }
+      audio_play(SOUND_UFO, cpu->cycles, true);
     }
-  if (sound_to_play != -1 && cpu->sounds[sound_to_play] != NULL)
+  else
     {
-      Mix_PlayChannel(-1, cpu->sounds[sound_to_play], 0);
+      audio_stop(SOUND_UFO, cpu->cycles);
     }
+  cpu->ufo_playing = on;
 }
 void
 cpu_init(i8080 *cpu)
@@ -1475,13 +1960,21 @@ cpu_init(i8080 *cpu)
   cpu->l = 0;
 
   cpu->flags = 0;
+  cpu->flags_pending = 0;
+  cpu->lazy_flags = false;
   cpu->pc = 0;
   cpu->sp = 0;
+  memset(cpu->memory, 0, MEM_SIZE);
+  cpu_map_flat(cpu);
   cpu->interrupt_enabled = false;
   cpu->halted = false;
 
   cpu->port1 = 0;
   cpu->port2 = 0;
+  cpu->ports_read = 0;
+  memset(cpu->port_read_cycle, 0, sizeof(cpu->port_read_cycle));
+  cpu->player_row_watch = 0;
+  cpu->player_write_cycle = 0;
 
   cpu->shift_msb = 0;
   cpu->shift_lsb = 0;
@@ -1489,27 +1982,110 @@ cpu_init(i8080 *cpu)
 
   cpu->last_out_port3 = 0;
   cpu->last_out_port5 = 0;
-  load_sound("sounds/8.wav", &cpu->sounds[0]);
-  load_sound("sounds/1.wav", &cpu->sounds[1]);
-  load_sound("sounds/2.wav", &cpu->sounds[2]);
-  load_sound("sounds/3.wav", &cpu->sounds[3]);
-  load_sound("sounds/4.wav", &cpu->sounds[4]);
-  load_sound("sounds/5.wav", &cpu->sounds[5]);
-  load_sound("sounds/6.wav", &cpu->sounds[6]);
-  load_sound("sounds/7.wav", &cpu->sounds[7]);
-  load_sound("sounds/0.wav", &cpu->sounds[8]);
+  cpu->cycles = 0;
+  cpu->cycle_debt = 0;
+  cpu->sound_muted = false;
+  cpu->ufo_playing = false;
 }
 
-uint8_t
-cpu_read_mem(i8080 *cpu, uint16_t address)
+// Memory map
+
+void
+cpu_map_page(i8080 *cpu, uint8_t page, const uint8_t *read, uint8_t *write,
+             mem_write_handler handler)
 {
-  return cpu->memory[address];
+  cpu->read_page[page] = read;
+  cpu->write_page[page] = write;
+  cpu->write_handler[page] = handler;
 }
 
+// Plain 64 KB of RAM, what the CPU tests and the CP/M style programs expect
 void
-cpu_write_mem(i8080 *cpu, uint16_t address, uint8_t data)
+cpu_map_flat(i8080 *cpu)
+{
+  for (int page = 0; page < NUM_PAGES; page++)
+    {
+      uint8_t *host = &cpu->memory[page << PAGE_SHIFT];
+      cpu_map_page(cpu, page, host, host, NULL);
+    }
+  cpu->vram_dirty = 0;
+
+  // code in RAM can change, nothing stays fused
+  memset(cpu->superop, 0, sizeof(cpu->superop));
+}
+
+static void
+write_rom(i8080 *cpu, uint16_t address, uint8_t data)
+{
+  // Writes to ROM are dropped, as on the real board
+  (void)cpu;
+  (void)address;
+  (void)data;
+}
+
+static void
+write_vram(i8080 *cpu, uint16_t address, uint8_t data)
 {
+  address &= ADDRESS_MASK;
+  if ((cpu->player_row_watch & cpu->ports_read) != 0
+      && (address - VRAM_START) % VRAM_COLUMN_BYTES == PLAYER_ROW
+      && cpu->memory[address] != data)
+    {
+      cpu->player_row_watch = 0;
+      cpu->player_write_cycle = cpu->cycles;
+    }
   cpu->memory[address] = data;
+  cpu->vram_dirty |= 1U << ((address - VRAM_START) >> PAGE_SHIFT);
+}
+
+/*
+Space Invaders hardware: 8 KB of ROM at 0x0000, 1 KB of work RAM at 0x2000,
+7 KB of video RAM at 0x2400 and the whole 16 KB repeated up to 0xFFFF.
+Mirrored pages share the host memory of the page they mirror.
+*/
+void
+cpu_map_invaders(i8080 *cpu)
+{
+  for (int page = 0; page < NUM_PAGES; page++)
+    {
+      uint16_t base = (page << PAGE_SHIFT) & ADDRESS_MASK;
+      uint8_t *host = &cpu->memory[base];
+
+      if (base < ROM_SIZE)
+        {
+          cpu_map_page(cpu, page, host, NULL, write_rom);
+        }
+      else if (base >= VRAM_START)
+        {
+          cpu_map_page(cpu, page, host, NULL, write_vram);
+        }
+      else
+        {
+          cpu_map_page(cpu, page, host, host, NULL);
+        }
+    }
+  cpu->vram_dirty = 0;
+}
+
+/*
+Serve the ROM in [address, address + size) straight from host memory outside
+the CPU, e.g. a mapped file, mirrors included. Both ends must be page
+aligned. Call after cpu_map_invaders; the CPU's own copy of those addresses
+is never read again.
+*/
+void
+cpu_map_rom(i8080 *cpu, uint16_t address, const uint8_t *rom, size_t size)
+{
+  for (int page = 0; page < NUM_PAGES; page++)
+    {
+      uint16_t base = (page << PAGE_SHIFT) & ADDRESS_MASK;
+
+      if (base >= address && (size_t)(base - address) < size
+          && base < ROM_SIZE)
+        {
+          cpu_map_page(cpu, page, rom + (base - address), NULL, write_rom);
+        }
+    }
 }
 
 bool
@@ -1523,16 +2099,18 @@ cpu_load_file(i8080 *cpu, const char *file_path, uint16_t address)
       return false;
     }
 
-  fseek(file, 0, SEEK_END);
-  size_t file_size = ftell(file);
-
-  if (file_size < 0)
+  long length = -1;
+  if (fseek(file, 0, SEEK_END) == 0)
+    {
+      length = ftell(file);
+    }
+  if (length < 0 || fseek(file, 0, SEEK_SET) != 0)
     {
       perror("Error: unable to obtain file size");
+      fclose(file);
       return false;
     }
-
-  fseek(file, 0, SEEK_SET);
+  size_t file_size = (size_t)length;
 
   if (address + file_size > MEM_SIZE)
     {
@@ -1553,8 +2131,500 @@ cpu_load_file(i8080 *cpu, const char *file_path, uint16_t address)
   return true;
 }
 
+// Copy a ROM image that is already in memory, e.g. one compiled in
+bool
+cpu_load_rom(i8080 *cpu, const uint8_t *rom, size_t size, uint16_t address)
+{
+  if (address + size > MEM_SIZE)
+    {
+      fprintf(stderr, "Error: ROM size exceeds available memory\n");
+      return false;
+    }
+
+  memcpy(&cpu->memory[address], rom, size);
+  return true;
+}
+
+// Save states
+
+void
+cpu_save_state(const i8080 *cpu, i8080_state *state)
+{
+  state->a = cpu->a;
+  state->b = cpu->b;
+  state->c = cpu->c;
+  state->d = cpu->d;
+  state->e = cpu->e;
+  state->h = cpu->h;
+  state->l = cpu->l;
+  state->flags = cpu_flags(cpu);
+  state->pc = cpu->pc;
+  state->sp = cpu->sp;
+  state->interrupt_enabled = cpu->interrupt_enabled;
+  state->halted = cpu->halted;
+  state->port1 = cpu->port1;
+  state->port2 = cpu->port2;
+  state->shift_msb = cpu->shift_msb;
+  state->shift_lsb = cpu->shift_lsb;
+  state->shift_offset = cpu->shift_offset;
+  state->last_out_port3 = cpu->last_out_port3;
+  state->last_out_port5 = cpu->last_out_port5;
+  state->ports_read = cpu->ports_read;
+  state->cycles = cpu->cycles;
+  state->cycle_debt = cpu->cycle_debt;
+
+  // copy what the CPU sees, so a ROM served from outside its memory is
+  // saved (and hashed) the same as one loaded into it
+  for (int page = 0; page < NUM_PAGES; page++)
+    {
+      memcpy(&state->memory[page << PAGE_SHIFT], cpu->read_page[page],
+             PAGE_SIZE);
+    }
+}
+
+void
+cpu_load_state(i8080 *cpu, const i8080_state *state)
+{
+  cpu->a = state->a;
+  cpu->b = state->b;
+  cpu->c = state->c;
+  cpu->d = state->d;
+  cpu->e = state->e;
+  cpu->h = state->h;
+  cpu->l = state->l;
+  cpu->flags = state->flags;
+  cpu->flags_pending = 0;
+  cpu->pc = state->pc;
+  cpu->sp = state->sp;
+  cpu->interrupt_enabled = state->interrupt_enabled;
+  cpu->halted = state->halted;
+  cpu->port1 = state->port1;
+  cpu->port2 = state->port2;
+  cpu->shift_msb = state->shift_msb;
+  cpu->shift_lsb = state->shift_lsb;
+  cpu->shift_offset = state->shift_offset;
+  cpu->last_out_port3 = state->last_out_port3;
+  cpu->last_out_port5 = state->last_out_port5;
+  cpu->ports_read = state->ports_read;
+  cpu->cycles = state->cycles;
+  cpu->cycle_debt = state->cycle_debt;
+
+  // put back only what the CPU can write: RAM through its write page and
+  // VRAM through its handler. ROM, and whatever backs an unmapped or split
+  // set ROM page, is left alone.
+  for (int page = 0; page < NUM_PAGES; page++)
+    {
+      const uint8_t *saved = &state->memory[page << PAGE_SHIFT];
+      if (cpu->write_page[page] != NULL)
+        {
+          memcpy(cpu->write_page[page], saved, PAGE_SIZE);
+        }
+      else if (cpu->write_handler[page] == write_vram)
+        {
+          memcpy(&cpu->memory[(page << PAGE_SHIFT) & ADDRESS_MASK], saved,
+                 PAGE_SIZE);
+        }
+    }
+
+  // the whole picture may have changed
+  cpu->vram_dirty = VRAM_DIRTY_ALL;
+}
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t
+hash_bytes(uint64_t hash, const uint8_t *data, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+    {
+      hash ^= data[i];
+      hash *= FNV_PRIME;
+    }
+  return hash;
+}
+
+// FNV-1a over every field of the state in a fixed byte order, so machines in
+// different processes (or builds) can be compared
+uint64_t
+cpu_state_hash(const i8080_state *state)
+{
+  uint8_t fields[] = {
+    state->a,
+    state->b,
+    state->c,
+    state->d,
+    state->e,
+    state->h,
+    state->l,
+    state->flags,
+    (uint8_t)(state->pc & LOWER_8_BIT_MASK),
+    (uint8_t)(state->pc >> BYTE),
+    (uint8_t)(state->sp & LOWER_8_BIT_MASK),
+    (uint8_t)(state->sp >> BYTE),
+    state->interrupt_enabled,
+    state->halted,
+    state->port1,
+    state->port2,
+    state->shift_msb,
+    state->shift_lsb,
+    state->shift_offset,
+    state->last_out_port3,
+    state->last_out_port5,
+    state->ports_read,
+  };
+  uint64_t hash = hash_bytes(FNV_OFFSET_BASIS, fields, sizeof(fields));
+  for (int i = 0; i < 8; i++) // NOLINT
+    {
+      uint8_t byte = (uint8_t)(state->cycles >> (BYTE * i));
+      hash = hash_bytes(hash, &byte, 1);
+    }
+  for (int i = 0; i < 4; i++) // NOLINT
+    {
+      uint8_t byte = (uint8_t)((uint32_t)state->cycle_debt >> (BYTE * i));
+      hash = hash_bytes(hash, &byte, 1);
+    }
+  return hash_bytes(hash, state->memory, MEM_SIZE);
+}
+
+// FNV-1a over VRAM, the picture the next frame would show
+uint64_t
+cpu_vram_hash(const i8080 *cpu)
+{
+  return hash_bytes(FNV_OFFSET_BASIS, &cpu->memory[VRAM_START], VRAM_SIZE);
+}
+
+/*
+Superinstructions. A handful of short loops account for most of the
+instructions the Space Invaders ROM executes: waiting for the interrupt
+routine to count down, scanning tables, copying and shifting sprites into
+VRAM. cpu_fuse_rom finds them once, since the ROM cannot change, and
+cpu_step then runs a whole loop body as one call instead of one dispatch per
+instruction. Every sequence ends in a conditional jump, so it is only fused
+when the budget left would have let the plain loop run the whole sequence
+too, which keeps interrupts landing on exactly the same instruction.
+*/
+
+#define ANY (-1)
+#define SUPEROP_MAX_LENGTH 28 // NOLINT
+#define JUMP_CYCLES 10        // NOLINT
+
+typedef struct
+{
+  const char *name;
+  int length;
+  int16_t pattern[SUPEROP_MAX_LENGTH]; // opcode bytes, ANY for operands
+  int cycles;                          // cycles for one pass, jump included
+  int (*run)(i8080 *cpu);
+} superop;
+
+// 16-bit operand at the given offset from the start of the sequence
+static uint16_t
+operand16(i8080 *cpu, uint16_t offset)
+{
+  return (uint16_t)(cpu_read_mem(cpu, cpu->pc + offset)
+                    | (cpu_read_mem(cpu, cpu->pc + offset + 1) << BYTE));
+}
+
+// JNZ or JZ at the given offset, ends every sequence
+static int
+fused_branch(i8080 *cpu, uint16_t offset)
+{
+  bool zero = is_zero_flag_set(cpu);
+  bool taken = cpu_read_mem(cpu, cpu->pc + offset) == 0xCA ? zero : !zero;
+
+  cpu->pc = taken ? operand16(cpu, offset + 1) : cpu->pc + offset + 3;
+  return JUMP_CYCLES;
+}
+
+// LXI B,d16 / DAD B / POP B / DCR B / JNZ a16, moving to the next row
+static int
+fused_next_row(i8080 *cpu, uint16_t offset)
+{
+  int cycles = LXI(&cpu->bc, operand16(cpu, offset + 1));
+  cycles += DAD(cpu, &cpu->bc);
+  cycles += POP(cpu, &cpu->bc);
+  cycles += DCR(cpu, &cpu->b);
+  return cycles + fused_branch(cpu, offset + 6); // NOLINT
+}
+
+// OUT d8 / IN d8, one pass through the shift register
+static int
+fused_shift(i8080 *cpu, uint16_t offset)
+{
+  port_out(cpu, cpu_read_mem(cpu, cpu->pc + offset + 1), cpu->a);
+  cpu->a = port_in(cpu, cpu_read_mem(cpu, cpu->pc + offset + 3));
+  return 20; // NOLINT
+}
+
+// LDA a16 / DCR A / JNZ a16
+static int
+fused_lda_dcr(i8080 *cpu)
+{
+  cpu->a = cpu_read_mem(cpu, operand16(cpu, 1));
+  int cycles = 13 + DCR(cpu, &cpu->a); // NOLINT
+  return cycles + fused_branch(cpu, 4);
+}
+
+// LDA a16 / ANA A / Jcc a16
+static int
+fused_lda_test(i8080 *cpu)
+{
+  cpu->a = cpu_read_mem(cpu, operand16(cpu, 1));
+  int cycles = 13 + ANA(cpu, cpu->a); // NOLINT
+  return cycles + fused_branch(cpu, 4);
+}
+
+// MOV A,M / ANA A / Jcc a16
+static int
+fused_mem_test(i8080 *cpu)
+{
+  int cycles = MOV_FROM_MEM(cpu, &cpu->a);
+  cycles += ANA(cpu, cpu->a);
+  return cycles + fused_branch(cpu, 2);
+}
+
+// INX H / DCR B / JNZ a16
+static int
+fused_next_byte(i8080 *cpu)
+{
+  int cycles = INX(&cpu->hl);
+  cycles += DCR(cpu, &cpu->b);
+  return cycles + fused_branch(cpu, 2);
+}
+
+// LDAX D / MOV M,A / INX H / INX D / DCR B / JNZ a16
+static int
+fused_block_copy(i8080 *cpu)
+{
+  int cycles = LDAX(cpu, &cpu->de);
+  cycles += MOV_TO_MEM(cpu, &cpu->a);
+  cycles += INX(&cpu->hl);
+  cycles += INX(&cpu->de);
+  cycles += DCR(cpu, &cpu->b);
+  return cycles + fused_branch(cpu, 5); // NOLINT
+}
+
+// PUSH B / LDAX D / MOV M,A / INX D / next row
+static int
+fused_sprite_row(i8080 *cpu)
+{
+  int cycles = PUSH(cpu, &cpu->bc);
+  cycles += LDAX(cpu, &cpu->de);
+  cycles += MOV_TO_MEM(cpu, &cpu->a);
+  cycles += INX(&cpu->de);
+  return cycles + fused_next_row(cpu, 4);
+}
+
+// PUSH B / MOV M,A / next row
+static int
+fused_fill_row(i8080 *cpu)
+{
+  int cycles = PUSH(cpu, &cpu->bc);
+  cycles += MOV_TO_MEM(cpu, &cpu->a);
+  return cycles + fused_next_row(cpu, 2);
+}
+
+/*
+PUSH B / PUSH H / LDAX D / OUT / IN / MOV M,A / INX H / INX D / XRA A / OUT /
+IN / MOV M,A / POP H / next row: a sprite row shifted into two VRAM bytes
+*/
+static int
+fused_shifted_row(i8080 *cpu)
+{
+  int cycles = PUSH(cpu, &cpu->bc);
+  cycles += PUSH(cpu, &cpu->hl);
+  cycles += LDAX(cpu, &cpu->de);
+  cycles += fused_shift(cpu, 3);
+  cycles += MOV_TO_MEM(cpu, &cpu->a);
+  cycles += INX(&cpu->hl);
+  cycles += INX(&cpu->de);
+  cycles += XRA(cpu, &cpu->a);
+  cycles += fused_shift(cpu, 11); // NOLINT
+  cycles += MOV_TO_MEM(cpu, &cpu->a);
+  cycles += POP(cpu, &cpu->hl);
+  return cycles + fused_next_row(cpu, 17); // NOLINT
+}
+
+// As above, but ORed into what is already on screen (ORA M before each store)
+static int
+fused_shifted_row_or(i8080 *cpu)
+{
+  int cycles = PUSH(cpu, &cpu->bc);
+  cycles += PUSH(cpu, &cpu->hl);
+  cycles += LDAX(cpu, &cpu->de);
+  cycles += fused_shift(cpu, 3);
+  cycles += ORA(cpu, cpu_read_mem(cpu, cpu->hl)) + 3;
+  cycles += MOV_TO_MEM(cpu, &cpu->a);
+  cycles += INX(&cpu->hl);
+  cycles += INX(&cpu->de);
+  cycles += XRA(cpu, &cpu->a);
+  cycles += fused_shift(cpu, 12); // NOLINT
+  cycles += ORA(cpu, cpu_read_mem(cpu, cpu->hl)) + 3;
+  cycles += MOV_TO_MEM(cpu, &cpu->a);
+  cycles += POP(cpu, &cpu->hl);
+  return cycles + fused_next_row(cpu, 19); // NOLINT
+}
+
+// NOLINTBEGIN
+static const superop superops[] = {
+  { "LDA/DCR A/JNZ", 7, { 0x3A, ANY, ANY, 0x3D, 0xC2, ANY, ANY }, 28,
+    fused_lda_dcr },
+  { "LDA/ANA A/JNZ", 7, { 0x3A, ANY, ANY, 0xA7, 0xC2, ANY, ANY }, 27,
+    fused_lda_test },
+  { "LDA/ANA A/JZ", 7, { 0x3A, ANY, ANY, 0xA7, 0xCA, ANY, ANY }, 27,
+    fused_lda_test },
+  { "MOV A,M/ANA A/JNZ", 5, { 0x7E, 0xA7, 0xC2, ANY, ANY }, 21,
+    fused_mem_test },
+  { "MOV A,M/ANA A/JZ", 5, { 0x7E, 0xA7, 0xCA, ANY, ANY }, 21,
+    fused_mem_test },
+  { "INX H/DCR B/JNZ", 5, { 0x23, 0x05, 0xC2, ANY, ANY }, 20,
+    fused_next_byte },
+  { "block copy", 8, { 0x1A, 0x77, 0x23, 0x13, 0x05, 0xC2, ANY, ANY }, 39,
+    fused_block_copy },
+  { "sprite row", 13,
+    { 0xC5, 0x1A, 0x77, 0x13, 0x01, ANY, ANY, 0x09, 0xC1, 0x05, 0xC2, ANY,
+      ANY },
+    75, fused_sprite_row },
+  { "fill row", 11,
+    { 0xC5, 0x77, 0x01, ANY, ANY, 0x09, 0xC1, 0x05, 0xC2, ANY, ANY }, 63,
+    fused_fill_row },
+  { "shifted sprite row", 26,
+    { 0xC5, 0xE5, 0x1A, 0xD3, ANY, 0xDB, ANY, 0x77, 0x23, 0x13, 0xAF,
+      0xD3, ANY, 0xDB, ANY, 0x77, 0xE1, 0x01, ANY, ANY, 0x09, 0xC1, 0x05,
+      0xC2, ANY, ANY },
+    152, fused_shifted_row },
+  { "shifted sprite row (OR)", 28,
+    { 0xC5, 0xE5, 0x1A, 0xD3, ANY, 0xDB, ANY, 0xB6, 0x77, 0x23, 0x13, 0xAF,
+      0xD3, ANY, 0xDB, ANY, 0xB6, 0x77, 0xE1, 0x01, ANY, ANY, 0x09, 0xC1,
+      0x05, 0xC2, ANY, ANY },
+    166, fused_shifted_row_or },
+};
+// NOLINTEND
+
+#define NUM_SUPEROPS ((int)(sizeof(superops) / sizeof(superops[0])))
+
+static bool
+superop_matches(const i8080 *cpu, const superop *op, int address)
+{
+  if (address + op->length > ROM_SIZE)
+    {
+      return false;
+    }
+  for (int i = 0; i < op->length; i++)
+    {
+      if (op->pattern[i] != ANY
+          && op->pattern[i] != cpu_read_mem(cpu, address + i))
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+// Find every catalogued sequence in write-protected ROM, returns the count
+int
+cpu_fuse_rom(i8080 *cpu)
+{
+  int found = 0;
+
+  memset(cpu->superop, 0, sizeof(cpu->superop));
+  for (int address = 0; address < ROM_SIZE; address++)
+    {
+      int page = address >> PAGE_SHIFT;
+      if (cpu->write_page[page] != NULL
+          || cpu->write_handler[page] != write_rom)
+        {
+          continue;
+        }
+      for (int op = 0; op < NUM_SUPEROPS; op++)
+        {
+          if (superop_matches(cpu, &superops[op], address))
+            {
+              cpu->superop[address] = (uint8_t)(op + 1);
+              found++;
+              break;
+            }
+        }
+    }
+  return found;
+}
+
+// Execute the next instruction, or the whole fused sequence starting at pc
+// when the remaining budget is enough for the unfused loop to run it all
+int
+cpu_step(i8080 *cpu, int budget)
+{
+  // a halted CPU does nothing until an interrupt, skip the rest of the budget
+  if (cpu->halted)
+    {
+      return budget;
+    }
+  if (cpu->pc < ROM_SIZE && cpu->superop[cpu->pc] != 0)
+    {
+      const superop *op = &superops[cpu->superop[cpu->pc] - 1];
+      if (budget > op->cycles - JUMP_CYCLES)
+        {
+          return op->run(cpu);
+        }
+    }
+  return execute_instruction(cpu, cpu_read_mem(cpu, cpu->pc));
+}
+
+// Headless execution
+
+int
+cpu_run(i8080 *cpu, int cycles)
+{
+  while (cycles > 0)
+    {
+      int num_cycles_used = cpu_step(cpu, cycles);
+
+      // execute instruction failed
+      if (num_cycles_used < 0)
+        {
+          fprintf(stderr, "Unimplemented opcode encountered. "
+                          "Exiting program.\n");
+          exit(EXIT_FAILURE);
+        }
+      cycles -= num_cycles_used;
+      cpu->cycles += num_cycles_used;
+    }
+  return cycles;
+}
+
+// Run one 60 Hz frame: half a frame, the mid-screen interrupt (RST 1), the
+// other half, then the vblank interrupt (RST 2). Any overrun is taken out of
+// the following half so the frame rate stays exact over time. run is called
+// for each half and may add input or tracing, cpu_run is the headless default.
+void
+cpu_run_frame(i8080 *cpu, cpu_runner run)
+{
+  if (run == NULL)
+    {
+      run = cpu_run;
+    }
+
+  cpu->cycle_debt = -run(cpu, HALF_FRAME_CYCLES - cpu->cycle_debt);
+  handle_interrupt(cpu, 0x01);
+
+  cpu->cycle_debt = -run(cpu, HALF_FRAME_CYCLES - cpu->cycle_debt);
+  handle_interrupt(cpu, 0x02);
+}
+
 // Input/Output
 
+// Mark a port as read, noting the cycle of the first IN since it was cleared
+static void
+note_port_read(i8080 *cpu, uint8_t port)
+{
+  if ((cpu->ports_read & (1 << port)) == 0)
+    {
+      cpu->ports_read |= 1 << port;
+      cpu->port_read_cycle[port] = cpu->cycles;
+    }
+}
+
 static uint8_t
 port_in(i8080 *cpu, uint8_t port)
 {
@@ -1566,9 +2636,11 @@ port_in(i8080 *cpu, uint8_t port)
       break;
     case 1:
       value = cpu->port1;
+      note_port_read(cpu, 1);
       break;
     case 2:
       value = cpu->port2;
+      note_port_read(cpu, 2);
       break;
     case 3:
       {
@@ -1612,33 +2684,112 @@ port_out(i8080 *cpu, uint8_t port, uint8_t value)
 
 // FLAGS
 
-void
-update_aux_carry_flag(i8080 *cpu, uint8_t a, uint8_t b)
+// Flag bits that lazy evaluation can leave pending
+#define LAZY_SZP (FLAG_S | FLAG_Z | FLAG_P)
+
+/*
+Works out the pending bits of flags: S, Z and P from result and AC from
+ac_sum, the low nibbles of the operands plus any carry in. This is the only
+place those bits are computed, eager updates and lazy materialization both
+come through here, so the two modes cannot disagree.
+*/
+static uint8_t
+resolve_flags(uint8_t flags, uint8_t pending, uint8_t result, uint8_t ac_sum)
 {
-  // Masks highest 4 bits which preserves the nibbles(last 4 bits of a and b)
-  // then adds nibbles to test for AC
-  uint16_t result = (a & 0x0F) + (b & 0x0F); // NOLINT
-  if (result & 0x10)                         // NOLINT
-    { // Check if carry from bit 3 to bit 4 exists
-      cpu->flags |= FLAG_AC;
+  uint8_t set = 0;
+
+  if (result & 0x80) // NOLINT
+    {
+      set |= FLAG_S;
     }
-  else
+  if (result == 0)
+    {
+      set |= FLAG_Z;
+    }
+  if ((pending & FLAG_P) && count_set_bits(result) % 2 == 0)
     {
-      cpu->flags &= ~FLAG_AC;
+      set |= FLAG_P;
     }
+  // a carry out of bit 3 of the nibble sum
+  if (ac_sum & 0x10) // NOLINT
+    {
+      set |= FLAG_AC;
+    }
+  return (flags & ~pending) | (set & pending);
 }
 
-void
-update_zero_flag(i8080 *cpu, uint8_t result)
+// S, Z and P as they would be for result
+static void
+set_szp(i8080 *cpu, uint8_t result)
 {
-  if (result == 0)
+  if (cpu->lazy_flags)
     {
-      cpu->flags |= FLAG_Z;
+      cpu->lazy_result = result;
+      cpu->flags_pending |= LAZY_SZP;
+      return;
     }
-  else
+  cpu->flags = resolve_flags(cpu->flags, LAZY_SZP, result, 0);
+}
+
+// Low nibbles of a + b + carry, whose bit 4 is AC
+static inline uint8_t
+nibble_sum(uint8_t a, uint8_t b, uint8_t carry)
+{
+  return (a & LOWER_4_BIT_MASK) + (b & LOWER_4_BIT_MASK) + carry;
+}
+
+// AC as it would be for adding a, b and carry
+static void
+set_ac(i8080 *cpu, uint8_t a, uint8_t b, uint8_t carry)
+{
+  if (cpu->lazy_flags)
     {
-      cpu->flags &= ~FLAG_Z;
+      cpu->lazy_ac = nibble_sum(a, b, carry);
+      cpu->flags_pending |= FLAG_AC;
+      return;
     }
+  cpu->flags
+      = resolve_flags(cpu->flags, FLAG_AC, 0, nibble_sum(a, b, carry));
+}
+
+// The flags register with any pending bits worked out
+uint8_t
+cpu_flags(const i8080 *cpu)
+{
+  return resolve_flags(cpu->flags, cpu->flags_pending, cpu->lazy_result,
+                       cpu->lazy_ac);
+}
+
+// Bring cpu->flags up to date before anything reads S, Z, P or AC from it
+void
+cpu_sync_flags(i8080 *cpu)
+{
+  if (cpu->flags_pending != 0)
+    {
+      cpu->flags = cpu_flags(cpu);
+      cpu->flags_pending = 0;
+    }
+}
+
+void
+cpu_set_lazy_flags(i8080 *cpu, bool lazy)
+{
+  cpu_sync_flags(cpu);
+  cpu->lazy_flags = lazy;
+}
+
+void
+update_aux_carry_flag(i8080 *cpu, uint8_t a, uint8_t b)
+{
+  cpu->flags = resolve_flags(cpu->flags, FLAG_AC, 0, nibble_sum(a, b, 0));
+  cpu->flags_pending &= ~FLAG_AC;
+}
+
+void
+update_zero_flag(i8080 *cpu, uint8_t result)
+{
+  cpu->flags = resolve_flags(cpu->flags, FLAG_Z, result, 0);
+  cpu->flags_pending &= ~FLAG_Z;
 }
 
 void
@@ -1657,54 +2808,49 @@ update_carry_flag(i8080 *cpu, bool carry_occurred)
 int
 count_set_bits(uint8_t value)
 {
-  int count = 0;
-  for (int i = 0; i < 8; i++) // NOLINT
-    {
-      if (value & (1 << i))
-        {
-          count++;
-        }
-    }
-  return count;
+  // a single instruction where the host has one, every parity update lands
+  // here
+  return __builtin_popcount(value);
 }
 
 void
 update_parity_flag(i8080 *cpu, uint8_t result)
 {
-  int set_bits = count_set_bits(result);
-  if (set_bits % 2 == 0)
-    {
-      cpu->flags |= FLAG_P;
-    }
-  else
-    {
-      cpu->flags &= ~FLAG_P;
-    }
+  cpu->flags = resolve_flags(cpu->flags, FLAG_P, result, 0);
+  cpu->flags_pending &= ~FLAG_P;
 }
 
 bool
 is_sign_flag_set(i8080 *cpu)
 {
-  return (cpu->flags & FLAG_S) != 0;
+  // work out just this bit, a branch should not pay for parity
+  uint8_t flags = resolve_flags(cpu->flags, cpu->flags_pending & FLAG_S,
+                                cpu->lazy_result, 0);
+  return (flags & FLAG_S) != 0;
+}
+
+bool
+is_parity_flag_set(i8080 *cpu)
+{
+  uint8_t flags = resolve_flags(cpu->flags, cpu->flags_pending & FLAG_P,
+                                cpu->lazy_result, 0);
+  return (flags & FLAG_P) != 0;
 }
 
 bool
 is_zero_flag_set(i8080 *cpu)
 {
-  return (cpu->flags & FLAG_Z) != 0;
+  // work out just this bit, a branch should not pay for parity
+  uint8_t flags = resolve_flags(cpu->flags, cpu->flags_pending & FLAG_Z,
+                                cpu->lazy_result, 0);
+  return (flags & FLAG_Z) != 0;
 }
 
 void
 update_sign_flag(i8080 *cpu, uint8_t result)
 {
-  if (result & 0x80) // NOLINT
-    {
-      cpu->flags |= FLAG_S;
-    }
-  else
-    {
-      cpu->flags &= ~FLAG_S;
-    }
+  cpu->flags = resolve_flags(cpu->flags, FLAG_S, result, 0);
+  cpu->flags_pending &= ~FLAG_S;
 }
 
 // Interrupts
@@ -1713,6 +2859,13 @@ update_sign_flag(i8080 *cpu, uint8_t result)
 
 void
 update_graphics(i8080 *cpu, SDL_Surface *buffer, SDL_Surface *surface)
+{
+  draw_vram(&cpu->memory[VRAM_START], buffer, surface);
+}
+
+// Decode a copy of video memory into buffer and scale it onto surface
+void
+draw_vram(const uint8_t *vram, SDL_Surface *buffer, SDL_Surface *surface)
 {
 
   uint32_t *screen_buff = buffer->pixels;
@@ -1720,13 +2873,15 @@ update_graphics(i8080 *cpu, SDL_Surface *buffer, SDL_Surface *surface)
   // Graphics data is rotated 90 degrees in memory counter-clockwise.  Reading
   // byte by byte starting at 0x2400 we need to fill in the screen left to
   // right, bottom to top.
-  int vram = 0x2400; // NOLINT
+  int offset = 0;
   // Start at the left edge
   for (int column = 0; column < SCREEN_WIDTH; column++)
     {
       // Start at bottom of screen, decrement by 8 since each bit is a pixel.
       for (int row = SCREEN_HEIGHT; row > 0; row -= 8) // NOLINT
         {
+          uint8_t cur_byte = vram[offset];
+
           // Set each pixel based on bit value.
           for (int pixel = 0; pixel < 8; pixel++) // NOLINT
             {
@@ -1734,8 +2889,6 @@ update_graphics(i8080 *cpu, SDL_Surface *buffer, SDL_Surface *surface)
               int surf_index = (SCREEN_WIDTH * (row - pixel)) + column
                                - (SCREEN_WIDTH - 1);
 
-              uint8_t cur_byte = cpu_read_mem(cpu, vram);
-
               // Set pixel to on by changing color to white.
               if ((cur_byte >> pixel) & 1)
                 {
@@ -1747,7 +2900,7 @@ update_graphics(i8080 *cpu, SDL_Surface *buffer, SDL_Surface *surface)
                   screen_buff[surf_index] = 0x000000; // NOLINT
                 }
             }
-          vram++; // Increment to next byte in VRAM
+          offset++; // Increment to next byte in VRAM
         }
     }
 
@@ -1757,6 +2910,7 @@ update_graphics(i8080 *cpu, SDL_Surface *buffer, SDL_Surface *surface)
 
   // Copy scaled surface to screen.
   SDL_BlitScaled(scaled_surface, NULL, surface, NULL);
+  SDL_FreeSurface(scaled_surface);
 }
 
 // DEBUGGING FUNCTIONS
@@ -1764,7 +2918,7 @@ update_graphics(i8080 *cpu, SDL_Surface *buffer, SDL_Surface *surface)
 void
 print_instruction(uint8_t opcode)
 {
-  printf("INSTRUCTION: 0x%02x\n", opcode);
+  printf("INSTRUCTION: 0x%02x %s\n", opcode, opcode_table[opcode].mnemonic);
 }
 
 void
@@ -1811,8 +2965,9 @@ handle_interrupt(i8080 *cpu, uint8_t rst_instruction)
   // set program counter to start of the interrupt subroutine
   cpu->pc = subroutine_address;
 
-  // disable interrupts
+  // disable interrupts and leave HLT
   cpu->interrupt_enabled = false;
+  cpu->halted = false;
 
   return 0;
 }
@@ -1,24 +1,13 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include "opcodes.h"
 #include <SDL2/SDL.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-// SDL Files
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_mixer.h>
-#define NUM_SOUNDS 18
-
-// #include "SDL_nmix.h"
-// #include "SDL_nmix_file.h"
-
-// Flags Defined
-#define FLAG_S 0x80  // NOLINT
-#define FLAG_Z 0x40  // NOLINT
-#define FLAG_AC 0x20 // NOLINT
-#define FLAG_P 0x10  // NOLINT
-#define FLAG_CY 0x08 // NOLINT
-
 // Register Pairs
 #define PSW 0
 #define BC 1
@@ -29,11 +18,31 @@
 
 // Memory
 #define MEM_SIZE 65536 // NOLINT
+#define VRAM_START 0x2400 // NOLINT
+#define VRAM_SIZE 0x1C00  // NOLINT
+#define ROM_SIZE 0x2000   // NOLINT
+
+// Memory is mapped in 256 byte pages. The Space Invaders board only decodes
+// the low 14 address lines, so everything above 0x3FFF mirrors 0x0000-0x3FFF
+#define PAGE_SHIFT 8
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define PAGE_MASK (PAGE_SIZE - 1)
+#define NUM_PAGES (MEM_SIZE / PAGE_SIZE)
+#define ADDRESS_MASK 0x3FFF // NOLINT
+
+// One vram_dirty bit per VRAM page
+#define VRAM_DIRTY_ALL ((1U << (VRAM_SIZE / PAGE_SIZE)) - 1)
 
 // Display
 #define SCREEN_WIDTH 224  // NOLINT
 #define SCREEN_HEIGHT 256 // NOLINT
 
+// VRAM holds the screen rotated, one 32 byte column per 256 pixel line. Byte
+// 4 of each column covers pixels 32-39 from the bottom, the row the player's
+// cannon moves along.
+#define VRAM_COLUMN_BYTES 32 // NOLINT
+#define PLAYER_ROW 4 // NOLINT
+
 // Bit Manipulation
 #define NIBBLE 4
 #define BYTE 8
@@ -47,15 +56,54 @@
 // Opcodes
 #define RST_RANGE 7
 
-typedef struct
-{
-  // Registers
-  uint8_t a, b, c, d, e, h, l;
+// Timing, the 8080 in Space Invaders runs at 2 MHz with a 60 Hz display
+#define CLOCK_SPEED_HZ 2000000                     // NOLINT
+#define FRAMES_PER_SECOND 60                       // NOLINT
+#define FRAME_CYCLES (CLOCK_SPEED_HZ / FRAMES_PER_SECOND)
+#define HALF_FRAME_CYCLES (FRAME_CYCLES / 2)
 
-  // Flags (stored in the F register)
-  // Includes z, s, p, cy, ac, pad
+struct i8080;
 
-  uint8_t flags;
+// A 16-bit register pair addressable as a whole or as its two halves
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+#define REGISTER_PAIR(pair, hi, lo)                                           \
+  union                                                                       \
+  {                                                                           \
+    uint16_t pair;                                                            \
+    struct                                                                    \
+    {                                                                         \
+      uint8_t hi, lo;                                                         \
+    };                                                                        \
+  }
+#else
+#define REGISTER_PAIR(pair, hi, lo)                                           \
+  union                                                                       \
+  {                                                                           \
+    uint16_t pair;                                                            \
+    struct                                                                    \
+    {                                                                         \
+      uint8_t lo, hi;                                                         \
+    };                                                                        \
+  }
+#endif
+
+// Called for writes to pages that have no direct write pointer
+typedef void (*mem_write_handler)(struct i8080 *cpu, uint16_t address,
+                                  uint8_t data);
+
+typedef struct i8080
+{
+  /*
+  Registers. Each pair shares storage with its two 8-bit halves, so
+  cpu->b/cpu->c and cpu->bc name the same bytes. The order of the halves
+  follows the host byte order so the high register is the high byte.
+  Flags (stored in the F register) are the low half of PSW and include
+  z, s, p, cy, ac, pad.
+  */
+  REGISTER_PAIR(psw, a, flags);
+  REGISTER_PAIR(bc, b, c);
+  REGISTER_PAIR(de, d, e);
+  REGISTER_PAIR(hl, h, l);
 
   /*
   Sign (S): Set if the result of an operation is negative (most significant bit
@@ -74,6 +122,34 @@ typedef struct
 
   uint8_t memory[MEM_SIZE];
 
+  /*
+  Page tables. Reads always go through read_page. A write goes straight to
+  write_page when it is set, otherwise to the page's write_handler, which is
+  how ROM protection, VRAM dirty tracking and watchpoints are hooked in.
+  */
+  const uint8_t *read_page[NUM_PAGES];
+  uint8_t *write_page[NUM_PAGES];
+  mem_write_handler write_handler[NUM_PAGES];
+
+  // Bit n is set when VRAM page n has been written. Nothing reads it yet;
+  // it is a hook for a renderer that only redraws the pages that changed.
+  // Mapping clears it and loading a state sets every bit.
+  uint32_t vram_dirty;
+
+  /*
+  Lazy flags. While lazy_flags is set, ALU instructions record the value S, Z
+  and P come from and the nibble sum AC comes from instead of computing them,
+  and mark those bits pending. Anything that reads them calls
+  cpu_sync_flags first; CY is cheap and always kept up to date.
+  */
+  bool lazy_flags;
+  uint8_t flags_pending;
+  uint8_t lazy_result;
+  uint8_t lazy_ac;
+
+  // Superinstruction starting at each ROM address (index + 1), 0 for none
+  uint8_t superop[ROM_SIZE];
+
   // Internal state for interrupt tracking and halted status tracking
 
   bool interrupt_enabled;
@@ -81,30 +157,119 @@ typedef struct
 
   bool colored_screen;
   // Ports & Shift registers for in/out opcode
-  Mix_Chunk *sounds[NUM_SOUNDS];
   uint8_t port1, port2;
   uint8_t shift_msb, shift_lsb, shift_offset;
   uint8_t last_out_port3, last_out_port5;
 
+  // Bit n is set whenever the ROM executes IN n, cleared by whoever watches.
+  // port_read_cycle[n] is the cycle of the IN that set it.
+  uint8_t ports_read;
+  uint64_t port_read_cycle[3];
+
+  // Ports to follow into VRAM: once one of them is in ports_read, the next
+  // write that changes the player's row stores its cycle in
+  // player_write_cycle and clears this
+  uint8_t player_row_watch;
+  uint64_t player_write_cycle;
+
+  // Total cycles executed, used to place input changes in emulated time
+  uint64_t cycles;
+
+  // Cycles the last half frame overran by, taken out of the next one
+  int cycle_debt;
+
+  // Set while running speculative frames that must not make any noise
+  bool sound_muted;
+
+  // Whether the UFO loop is running on the audio device, which after muted
+  // frames can differ from the port 3 latch until cpu_sync_sound
+  bool ufo_playing;
+
 } i8080;
 
+/*
+Everything needed to put a machine back exactly where it was: registers,
+flags, ports, timing and the whole address space. Host side switches (sound
+muting, lazy flags, the memory map) are not part of the state.
+*/
+typedef struct
+{
+  uint8_t a, b, c, d, e, h, l;
+  uint8_t flags;
+  uint16_t pc, sp;
+  bool interrupt_enabled;
+  bool halted;
+  uint8_t port1, port2;
+  uint8_t shift_msb, shift_lsb, shift_offset;
+  uint8_t last_out_port3, last_out_port5;
+  uint8_t ports_read;
+  uint64_t cycles;
+  int cycle_debt;
+  uint8_t memory[MEM_SIZE];
+} i8080_state;
+
+// Runs the CPU for at least the given number of cycles, returns the
+// (zero or negative) number of cycles left over
+typedef int (*cpu_runner)(i8080 *cpu, int cycles);
+
 // Funct prototypes
 void cpu_init(i8080 *cpu);
-uint8_t cpu_read_mem(i8080 *cpu, uint16_t address);
-void cpu_write_mem(i8080 *cpu, uint16_t address, uint8_t data);
+void cpu_map_page(i8080 *cpu, uint8_t page, const uint8_t *read,
+                  uint8_t *write, mem_write_handler handler);
+void cpu_map_flat(i8080 *cpu);
+void cpu_map_invaders(i8080 *cpu);
+void cpu_map_rom(i8080 *cpu, uint16_t address, const uint8_t *rom,
+                 size_t size);
 bool cpu_load_file(i8080 *cpu, const char *file_path, uint16_t address);
+bool cpu_load_rom(i8080 *cpu, const uint8_t *rom, size_t size,
+                  uint16_t address);
+void cpu_save_state(const i8080 *cpu, i8080_state *state);
+void cpu_load_state(i8080 *cpu, const i8080_state *state);
+void cpu_sync_sound(i8080 *cpu);
+uint64_t cpu_state_hash(const i8080_state *state);
+uint64_t cpu_vram_hash(const i8080 *cpu);
+int cpu_fuse_rom(i8080 *cpu);
+int cpu_step(i8080 *cpu, int budget);
+int cpu_run(i8080 *cpu, int cycles);
+void cpu_run_frame(i8080 *cpu, cpu_runner run);
 int execute_instruction(i8080 *cpu, uint8_t opcode);
 void update_graphics(i8080 *cpu, SDL_Surface *buffer, SDL_Surface *surface);
+void draw_vram(const uint8_t *vram, SDL_Surface *buffer, SDL_Surface *surface);
 void writeRegisterPair(i8080 *cpu, int pair, uint16_t value);
 uint16_t readRegisterPair(i8080 *cpu, int pair);
 uint8_t getImmediate8BitValue(i8080 *cpu);
 uint16_t getImmediate16BitValue(i8080 *cpu);
 
+/*
+Memory access, inlined so the common case is a table lookup and a load or
+store. Only pages without a direct write pointer pay for a call.
+*/
+static inline uint8_t
+cpu_read_mem(const i8080 *cpu, uint16_t address)
+{
+  return cpu->read_page[address >> PAGE_SHIFT][address & PAGE_MASK];
+}
+
+static inline void
+cpu_write_mem(i8080 *cpu, uint16_t address, uint8_t data)
+{
+  uint8_t *page = cpu->write_page[address >> PAGE_SHIFT];
+
+  if (page != NULL)
+    {
+      page[address & PAGE_MASK] = data;
+      return;
+    }
+
+  cpu->write_handler[address >> PAGE_SHIFT](cpu, address, data);
+}
+
 // Prototypes for Flags
 
 // Parity Flag
 int count_set_bits(uint8_t value);
 void update_parity_flag(i8080 *cpu, uint8_t result);
+bool is_parity_flag_set(i8080 *cpu);
 
 // Auxiliary Carry (AC)
 void update_aux_carry_flag(i8080 *cpu, uint8_t a, uint8_t b);
@@ -124,6 +289,10 @@ How to use in a function
 update_carry_flag(cpu, result > 0xFF); result > 0XFF will return true or false
 */
 
+uint8_t cpu_flags(const i8080 *cpu);
+void cpu_sync_flags(i8080 *cpu);
+void cpu_set_lazy_flags(i8080 *cpu, bool lazy);
+
 void cpu_set_flag(i8080 *cpu, uint8_t flag, bool value);
 bool cpu_get_flag(i8080 *cpu, uint8_t flag);
 
@@ -138,3 +307,5 @@ void print_flags(uint8_t flags);
 Interrupt functions
 */
 int handle_interrupt(i8080 *cpu, uint8_t rst_instruction);
+
+#endif
@@ -0,0 +1,378 @@
+#include "emulator.h"
+#include "movie.h"
+#include <float.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+Runs the ROM headless from reset the way the shell runs it (lazy flags, fused
+superinstructions, cpu_run_frame's interrupts), optionally replaying an input
+movie, and hashes VRAM (0x2400-0x3FFF) after chosen frames. The hashes are
+checked against a golden file, so a change to when interrupts land or to what
+the game draws shows up as the first frame whose picture differs. The run is
+timed as well, so the same check doubles as a performance canary.
+
+A golden file is text, one "frame hash" line per checked frame (hash in hex)
+in frame order, with # starting a comment. Frame n is the picture after n
+frames from reset.
+*/
+
+// What --update writes by default: a hash every second for a minute
+#define DEFAULT_FRAMES (60 * FRAMES_PER_SECOND) // NOLINT
+#define DEFAULT_EVERY FRAMES_PER_SECOND
+
+// Entries the first allocation holds
+#define GOLDEN_INITIAL_CAPACITY 64 // NOLINT
+
+// Longest line read from a golden file
+#define GOLDEN_LINE_LENGTH 128 // NOLINT
+
+// Most mismatching frames listed in a report
+#define MAX_REPORTED_FRAMES 8 // NOLINT
+
+typedef struct
+{
+  uint64_t frame;
+  uint64_t hash;
+} golden_entry;
+
+typedef struct
+{
+  golden_entry *entries;
+  size_t count;
+  size_t capacity;
+} golden_list;
+
+static input_movie movie;
+
+static bool
+golden_add(golden_list *golden, uint64_t frame, uint64_t hash)
+{
+  if (golden->count == golden->capacity)
+    {
+      size_t capacity = golden->capacity == 0 ? GOLDEN_INITIAL_CAPACITY
+                                              : golden->capacity * 2;
+      golden_entry *entries
+          = realloc(golden->entries, capacity * sizeof(golden_entry));
+      if (entries == NULL)
+        {
+          return false;
+        }
+      golden->entries = entries;
+      golden->capacity = capacity;
+    }
+  golden->entries[golden->count].frame = frame;
+  golden->entries[golden->count].hash = hash;
+  golden->count++;
+  return true;
+}
+
+static bool
+golden_load(golden_list *golden, const char *path)
+{
+  FILE *file = fopen(path, "r");
+  char line[GOLDEN_LINE_LENGTH];
+  int number = 0;
+
+  if (file == NULL)
+    {
+      fprintf(stderr, "Error: Unable to open golden file %s\n", path);
+      return false;
+    }
+
+  while (fgets(line, sizeof(line), file) != NULL)
+    {
+      uint64_t frame = 0;
+      uint64_t hash = 0;
+      char extra = 0;
+
+      number++;
+      line[strcspn(line, "#")] = '\0';
+      if (line[strspn(line, " \t\r\n")] == '\0')
+        {
+          continue;
+        }
+      if (sscanf(line, "%" SCNu64 " %" SCNx64 " %c", &frame, &hash, &extra)
+              != 2
+          || frame == 0
+          || (golden->count > 0
+              && frame <= golden->entries[golden->count - 1].frame))
+        {
+          fprintf(stderr, "Error: %s:%d is not a frame hash line in frame "
+                          "order\n",
+                  path, number);
+          fclose(file);
+          return false;
+        }
+      if (!golden_add(golden, frame, hash))
+        {
+          fprintf(stderr, "Error: Out of memory reading %s\n", path);
+          fclose(file);
+          return false;
+        }
+    }
+  fclose(file);
+
+  if (golden->count == 0)
+    {
+      fprintf(stderr, "Error: %s has no frames to check\n", path);
+      return false;
+    }
+  return true;
+}
+
+static bool
+golden_save(const golden_list *golden, const char *path,
+            const char *movie_path)
+{
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL)
+    {
+      fprintf(stderr, "Error: Unable to write golden file %s\n", path);
+      return false;
+    }
+
+  fprintf(file, "# frame vram_hash, frames counted from reset");
+  if (movie_path != NULL)
+    {
+      fprintf(file, " replaying %s", movie_path);
+    }
+  fprintf(file, "\n");
+  for (size_t i = 0; i < golden->count; i++)
+    {
+      fprintf(file, "%" PRIu64 " %016" PRIx64 "\n", golden->entries[i].frame,
+              golden->entries[i].hash);
+    }
+  return fclose(file) == 0;
+}
+
+// cpu_run with the movie's input applied before every dispatch, as the shell
+// applies live input
+static int
+run_replaying(i8080 *cpu, int cycles)
+{
+  while (cycles > 0)
+    {
+      movie_replay(&movie, cpu);
+
+      int num_cycles_used = cpu_step(cpu, cycles);
+      if (num_cycles_used < 0)
+        {
+          fprintf(stderr, "Unimplemented opcode encountered. "
+                          "Exiting program.\n");
+          exit(EXIT_FAILURE);
+        }
+      cycles -= num_cycles_used;
+      cpu->cycles += num_cycles_used;
+    }
+  return cycles;
+}
+
+static double
+seconds_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9; // NOLINT
+}
+
+// Parse a whole decimal number of at least 1
+static bool
+parse_count(const char *arg, uint64_t *value)
+{
+  char *end = NULL;
+  unsigned long long parsed = strtoull(arg, &end, 10); // NOLINT
+
+  if (*arg == '\0' || *end != '\0' || arg[0] == '-' || parsed == 0)
+    {
+      return false;
+    }
+  *value = parsed;
+  return true;
+}
+
+// Parse a rate above zero, such as 600 or 1e4
+static bool
+parse_rate(const char *arg, double *value)
+{
+  char *end = NULL;
+  double parsed = strtod(arg, &end);
+
+  if (end == arg || *end != '\0' || !(parsed > 0) || parsed > DBL_MAX)
+    {
+      return false;
+    }
+  *value = parsed;
+  return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static const struct option long_options[]
+      = { { "golden", required_argument, NULL, 'g' },
+          { "update", no_argument, NULL, 'U' },
+          { "frames", required_argument, NULL, 'f' },
+          { "every", required_argument, NULL, 'v' },
+          { "movie", required_argument, NULL, 'm' },
+          { "min-fps", required_argument, NULL, 'p' },
+          { "no-lazy", no_argument, NULL, 'e' },
+          { "no-fuse", no_argument, NULL, 'u' },
+          { NULL, 0, NULL, 0 } };
+  static i8080 cpu;
+  golden_list golden = { NULL, 0, 0 };
+  const char *golden_path = NULL;
+  const char *movie_path = NULL;
+  uint64_t frames = DEFAULT_FRAMES;
+  uint64_t every = DEFAULT_EVERY;
+  double min_fps = 0;
+  bool update = false;
+  bool lazy = true;
+  bool fuse = true;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+      switch (opt)
+        {
+        case 'g':
+          golden_path = optarg;
+          break;
+        case 'U':
+          update = true;
+          break;
+        case 'f':
+        case 'v':
+          if (!parse_count(optarg, opt == 'f' ? &frames : &every))
+            {
+              fprintf(stderr, "Invalid frame count: %s\n", optarg);
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case 'm':
+          if (!movie_load(&movie, optarg))
+            {
+              exit(EXIT_FAILURE);
+            }
+          movie_path = optarg;
+          break;
+        case 'p':
+          if (!parse_rate(optarg, &min_fps))
+            {
+              fprintf(stderr, "Invalid frame rate: %s\n", optarg);
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case 'e':
+          lazy = false;
+          break;
+        case 'u':
+          fuse = false;
+          break;
+        default:
+          exit(EXIT_FAILURE);
+        }
+    }
+
+  if (optind != argc - 1 || golden_path == NULL)
+    {
+      fprintf(stderr, "Please provide a golden file (--golden) and a ROM!\n");
+      exit(EXIT_FAILURE);
+    }
+  if (update)
+    {
+      for (uint64_t frame = every; frame <= frames; frame += every)
+        {
+          if (!golden_add(&golden, frame, 0))
+            {
+              fprintf(stderr, "Error: Out of memory\n");
+              exit(EXIT_FAILURE);
+            }
+        }
+      if (golden.count == 0)
+        {
+          fprintf(stderr, "No frames to hash, --every is past --frames\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+  else if (!golden_load(&golden, golden_path))
+    {
+      exit(EXIT_FAILURE);
+    }
+
+  cpu_init(&cpu);
+  if (!cpu_load_file(&cpu, argv[optind], 0))
+    {
+      exit(EXIT_FAILURE);
+    }
+  cpu_map_invaders(&cpu);
+  if (fuse)
+    {
+      cpu_fuse_rom(&cpu);
+    }
+  cpu_set_lazy_flags(&cpu, lazy);
+
+  uint64_t last_frame = golden.entries[golden.count - 1].frame;
+  size_t next = 0;
+  int mismatches = 0;
+
+  double start = seconds_now();
+  for (uint64_t frame = 1; frame <= last_frame; frame++)
+    {
+      cpu_run_frame(&cpu, movie_path != NULL ? run_replaying : NULL);
+      if (frame != golden.entries[next].frame)
+        {
+          continue;
+        }
+
+      uint64_t hash = cpu_vram_hash(&cpu);
+      if (update)
+        {
+          golden.entries[next].hash = hash;
+        }
+      else if (hash != golden.entries[next].hash)
+        {
+          if (mismatches++ < MAX_REPORTED_FRAMES)
+            {
+              printf("Frame %" PRIu64 ": VRAM hash %016" PRIx64
+                     ", expected %016" PRIx64 "\n",
+                     frame, hash, golden.entries[next].hash);
+            }
+        }
+      next++;
+    }
+  double elapsed = seconds_now() - start;
+  double fps = elapsed > 0 ? last_frame / elapsed : 0;
+
+  bool passed = true;
+  if (update)
+    {
+      passed = golden_save(&golden, golden_path, movie_path);
+      printf("%s: wrote %zu frame hashes", golden_path, golden.count);
+    }
+  else
+    {
+      passed = mismatches == 0;
+      printf("%s: %zu of %zu frames match", golden_path,
+             golden.count - mismatches, golden.count);
+    }
+  printf(", %" PRIu64 " frames in %.2f s, %.0f frames/s (%.0fx real time)\n",
+         last_frame, elapsed, fps, fps / FRAMES_PER_SECOND);
+  if (min_fps > 0 && fps < min_fps)
+    {
+      printf("Slower than the %.0f frames/s asked for\n", min_fps);
+      passed = false;
+    }
+
+  free(golden.entries);
+  movie_free(&movie);
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
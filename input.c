@@ -0,0 +1,73 @@
+#include "input.h"
+
+void
+input_queue_init(input_queue *queue)
+{
+  SDL_AtomicSet(&queue->head, 0);
+  SDL_AtomicSet(&queue->tail, 0);
+}
+
+// Producer side, returns false if the ring is full
+bool
+input_queue_push(input_queue *queue, const input_event *event)
+{
+  int head = SDL_AtomicGet(&queue->head);
+  int tail = SDL_AtomicGet(&queue->tail);
+
+  if (head - tail >= INPUT_QUEUE_SIZE)
+    {
+      return false;
+    }
+
+  queue->events[head & INPUT_QUEUE_MASK] = *event;
+
+  // make the slot visible before publishing the new head
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&queue->head, head + 1);
+  return true;
+}
+
+// Consumer side, copies the oldest event without removing it
+bool
+input_queue_peek(input_queue *queue, input_event *event)
+{
+  int tail = SDL_AtomicGet(&queue->tail);
+
+  if (SDL_AtomicGet(&queue->head) == tail)
+    {
+      return false;
+    }
+
+  SDL_MemoryBarrierAcquire();
+  *event = queue->events[tail & INPUT_QUEUE_MASK];
+  return true;
+}
+
+// Consumer side, releases the slot returned by the last peek
+void
+input_queue_pop(input_queue *queue)
+{
+  SDL_AtomicAdd(&queue->tail, 1);
+}
+
+bool
+input_event_is_empty(const input_event *event)
+{
+  return (event->port1_set | event->port1_clear | event->port2_set
+          | event->port2_clear)
+         == 0;
+}
+
+void
+input_apply(i8080 *cpu, const input_event *event)
+{
+  input_apply_ports(&cpu->port1, &cpu->port2, event);
+}
+
+// Apply an event to a pair of port images that are not wired to a CPU
+void
+input_apply_ports(uint8_t *port1, uint8_t *port2, const input_event *event)
+{
+  *port1 = (*port1 & ~event->port1_clear) | event->port1_set;
+  *port2 = (*port2 & ~event->port2_clear) | event->port2_set;
+}
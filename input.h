@@ -0,0 +1,44 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "emulator.h"
+
+// Number of slots in the input ring, must be a power of two
+#define INPUT_QUEUE_SIZE 256 // NOLINT
+#define INPUT_QUEUE_MASK (INPUT_QUEUE_SIZE - 1)
+
+/*
+A single change to the input ports. The producer (input thread) fills in the
+SDL event time and the bits to set/clear on each port; the consumer
+(emulation thread) turns the timestamp into a cycle position and applies the
+masks once the CPU reaches it.
+*/
+typedef struct
+{
+  uint32_t timestamp; // SDL event time in ms
+  uint8_t port1_set, port1_clear;
+  uint8_t port2_set, port2_clear;
+} input_event;
+
+/*
+Lock-free single producer / single consumer ring. head is only written by
+the producer and tail only by the consumer, so each side needs nothing more
+than an atomic load of the other's index.
+*/
+typedef struct
+{
+  input_event events[INPUT_QUEUE_SIZE];
+  SDL_atomic_t head;
+  SDL_atomic_t tail;
+} input_queue;
+
+void input_queue_init(input_queue *queue);
+bool input_queue_push(input_queue *queue, const input_event *event);
+bool input_queue_peek(input_queue *queue, input_event *event);
+void input_queue_pop(input_queue *queue);
+bool input_event_is_empty(const input_event *event);
+void input_apply(i8080 *cpu, const input_event *event);
+void input_apply_ports(uint8_t *port1, uint8_t *port2,
+                       const input_event *event);
+
+#endif
@@ -0,0 +1,222 @@
+#include "latency.h"
+#include <string.h>
+
+// Port bits of left and right, the same on both players' ports
+#define LATENCY_MOVE_BITS 0x60 // NOLINT
+
+// A press whose cannon never moves (attract mode, against the edge, between
+// lives) is given up after this many frames
+#define LATENCY_TIMEOUT_FRAMES FRAMES_PER_SECOND
+
+#define CYCLES_PER_MS (CLOCK_SPEED_HZ / 1000) // NOLINT
+
+static const char *stage_names[LATENCY_STAGES] = {
+  "input -> port read",
+  "port read -> vram",
+  "vram -> present",
+  "input -> present",
+};
+
+static void
+histogram_add(latency_histogram *histogram, uint32_t ms)
+{
+  uint32_t bucket = ms < LATENCY_BUCKETS ? ms : LATENCY_BUCKETS - 1;
+  histogram->buckets[bucket]++;
+  if (histogram->count == 0 || ms < histogram->min)
+    {
+      histogram->min = ms;
+    }
+  if (ms > histogram->max)
+    {
+      histogram->max = ms;
+    }
+  histogram->count++;
+  histogram->total += ms;
+}
+
+// Smallest bucket that holds at least the given fraction of the samples
+static uint32_t
+histogram_percentile(const latency_histogram *histogram, double fraction)
+{
+  uint32_t target = (uint32_t)(fraction * histogram->count + 0.5); // NOLINT
+  uint32_t seen = 0;
+  for (uint32_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+      seen += histogram->buckets[i];
+      if (seen >= target && seen > 0)
+        {
+          return i;
+        }
+    }
+  return LATENCY_BUCKETS - 1;
+}
+
+void
+latency_init(latency_tracker *tracker)
+{
+  memset(tracker, 0, sizeof(*tracker));
+  SDL_AtomicSet(&tracker->state, PROBE_IDLE);
+}
+
+// Milliseconds from one time to a later one, 0 if it is not later
+static uint32_t
+elapsed(uint32_t from, uint32_t to)
+{
+  return (int32_t)(to - from) > 0 ? to - from : 0;
+}
+
+/*
+Wall time of a cycle in a frame that started at start_cycle and start_time.
+This is the inverse of how the shell places input, which plays each frame's
+events back at their offset into it. A turbo tick runs several frames, so
+nothing is placed later than now.
+*/
+static uint32_t
+cycle_time(uint64_t cycle, uint64_t start_cycle, uint32_t start_time,
+           uint32_t now)
+{
+  if (cycle < start_cycle)
+    {
+      return start_time;
+    }
+  uint32_t time
+      = start_time + (uint32_t)((cycle - start_cycle) / CYCLES_PER_MS);
+  return elapsed(time, now) > 0 ? time : now;
+}
+
+// Called on the emulation thread right after an input change was applied
+void
+latency_input(latency_tracker *tracker, i8080 *cpu, uint32_t event_time,
+              uint8_t port1_changed, uint8_t port2_changed)
+{
+  uint8_t pressed1 = port1_changed & cpu->port1 & LATENCY_MOVE_BITS;
+  uint8_t pressed2 = port2_changed & cpu->port2 & LATENCY_MOVE_BITS;
+
+  if (SDL_AtomicGet(&tracker->state) != PROBE_IDLE
+      || (pressed1 | pressed2) == 0)
+    {
+      return;
+    }
+
+  tracker->port = pressed1 ? 1 : 2;
+  tracker->event_time = event_time;
+  SDL_AtomicSet(&tracker->state, PROBE_WAIT_READ);
+
+  // forget reads that happened before the change, and have the first write
+  // to the cannon's row after the next one stamped
+  cpu->ports_read &= ~(1 << tracker->port);
+  cpu->player_row_watch = 1 << tracker->port;
+}
+
+// Called on the emulation thread after each emulated frame, with the cycle
+// and time the frame (or turbo tick) started at
+void
+latency_frame(latency_tracker *tracker, i8080 *cpu, uint64_t frame,
+              uint64_t start_cycle, uint32_t start_time, uint32_t now)
+{
+  int state = SDL_AtomicGet(&tracker->state);
+
+  if (state == PROBE_WAIT_READ && (cpu->ports_read & (1 << tracker->port)))
+    {
+      tracker->read_time
+          = cycle_time(cpu->port_read_cycle[tracker->port], start_cycle,
+                       start_time, now);
+      tracker->read_frame = frame;
+      histogram_add(&tracker->stages[LATENCY_INPUT_TO_READ],
+                    elapsed(tracker->event_time, tracker->read_time));
+      state = PROBE_WAIT_VRAM;
+      SDL_AtomicSet(&tracker->state, state);
+    }
+
+  if (state != PROBE_WAIT_VRAM)
+    {
+      return;
+    }
+  if (cpu->player_row_watch != 0)
+    {
+      if (frame - tracker->read_frame >= LATENCY_TIMEOUT_FRAMES)
+        {
+          cpu->player_row_watch = 0;
+          SDL_AtomicSet(&tracker->state, PROBE_IDLE);
+        }
+      return;
+    }
+
+  tracker->vram_time = cycle_time(cpu->player_write_cycle, start_cycle,
+                                  start_time, now);
+  tracker->vram_frame = frame;
+  histogram_add(&tracker->stages[LATENCY_READ_TO_VRAM],
+                elapsed(tracker->read_time, tracker->vram_time));
+
+  // hands the probe over to the main thread
+  SDL_AtomicSet(&tracker->state, PROBE_WAIT_PRESENT);
+}
+
+// Called on the main thread once the given frame is on screen
+void
+latency_present(latency_tracker *tracker, uint64_t frame, uint32_t now)
+{
+  if (SDL_AtomicGet(&tracker->state) != PROBE_WAIT_PRESENT
+      || frame < tracker->vram_frame)
+    {
+      return;
+    }
+
+  histogram_add(&tracker->stages[LATENCY_VRAM_TO_PRESENT],
+                elapsed(tracker->vram_time, now));
+  histogram_add(&tracker->stages[LATENCY_TOTAL],
+                elapsed(tracker->event_time, now));
+  SDL_AtomicSet(&tracker->state, PROBE_IDLE);
+}
+
+void
+latency_report(const latency_tracker *tracker, FILE *out)
+{
+  fprintf(out, "%-20s %7s %5s %5s %5s %5s %5s %5s\n", "latency (ms)",
+          "samples", "min", "mean", "p50", "p95", "p99", "max");
+  for (int stage = 0; stage < LATENCY_STAGES; stage++)
+    {
+      const latency_histogram *histogram = &tracker->stages[stage];
+      if (histogram->count == 0)
+        {
+          fprintf(out, "%-20s %7u\n", stage_names[stage], 0);
+          continue;
+        }
+      fprintf(out, "%-20s %7u %5u %5.1f %5u %5u %5u %5u\n",
+              stage_names[stage], histogram->count, histogram->min,
+              (double)histogram->total / histogram->count,
+              histogram_percentile(histogram, 0.50),  // NOLINT
+              histogram_percentile(histogram, 0.95),  // NOLINT
+              histogram_percentile(histogram, 0.99),  // NOLINT
+              histogram->max);
+    }
+
+  // one row per non-empty bucket, bars scaled to the fullest bucket
+  for (int stage = 0; stage < LATENCY_STAGES; stage++)
+    {
+      const latency_histogram *histogram = &tracker->stages[stage];
+      uint32_t peak = 0;
+      for (int i = 0; i < LATENCY_BUCKETS; i++)
+        {
+          peak = histogram->buckets[i] > peak ? histogram->buckets[i] : peak;
+        }
+      if (peak == 0)
+        {
+          continue;
+        }
+
+      fprintf(out, "\n%s\n", stage_names[stage]);
+      for (int i = 0; i < LATENCY_BUCKETS; i++)
+        {
+          if (histogram->buckets[i] == 0)
+            {
+              continue;
+            }
+          int width = (int)((histogram->buckets[i] * 40 + peak - 1) / peak);
+          fprintf(out, "%3d%s ms | %-40.*s %u\n", i,
+                  i == LATENCY_BUCKETS - 1 ? "+" : " ", width,
+                  "########################################",
+                  histogram->buckets[i]);
+        }
+    }
+}
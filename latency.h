@@ -0,0 +1,61 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "emulator.h"
+
+// Histogram buckets are 1 ms wide, the last bucket collects everything slower
+#define LATENCY_BUCKETS 100 // NOLINT
+
+// Stages an input change goes through before it reaches the screen
+enum latency_stage
+{
+  LATENCY_INPUT_TO_READ,   // SDL event time -> ROM reads the port via IN
+  LATENCY_READ_TO_VRAM,    // port read -> the write that moves the cannon
+  LATENCY_VRAM_TO_PRESENT, // that write -> present returns
+  LATENCY_TOTAL,           // SDL event time -> present returns
+  LATENCY_STAGES
+};
+
+typedef struct
+{
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t count;
+  uint32_t min, max;
+  uint64_t total;
+} latency_histogram;
+
+enum latency_probe_state
+{
+  PROBE_IDLE,
+  PROBE_WAIT_READ,
+  PROBE_WAIT_VRAM,
+  PROBE_WAIT_PRESENT
+};
+
+/*
+Follows one press of left or right at a time through the pipeline, since
+moving the cannon is a VRAM change the press is known to cause. Presses that
+arrive while a probe is in flight are not tracked, so every sample describes
+an isolated press. Every stage is stamped with the time its event happened:
+the IN and the VRAM write by their cycle, the present when it returns. The
+emulation thread owns the probe until it reaches PROBE_WAIT_PRESENT, then the
+main thread, which presents, owns it until it goes back to PROBE_IDLE.
+*/
+typedef struct
+{
+  SDL_atomic_t state;
+  uint8_t port; // the input port that changed, 1 or 2
+  uint32_t event_time, read_time, vram_time;
+  uint64_t read_frame, vram_frame;
+  latency_histogram stages[LATENCY_STAGES];
+} latency_tracker;
+
+void latency_init(latency_tracker *tracker);
+void latency_input(latency_tracker *tracker, i8080 *cpu, uint32_t event_time,
+                   uint8_t port1_changed, uint8_t port2_changed);
+void latency_frame(latency_tracker *tracker, i8080 *cpu, uint64_t frame,
+                   uint64_t start_cycle, uint32_t start_time, uint32_t now);
+void latency_present(latency_tracker *tracker, uint64_t frame, uint32_t now);
+void latency_report(const latency_tracker *tracker, FILE *out);
+
+#endif
@@ -0,0 +1,401 @@
+#include "emulator.h"
+#include "movie.h"
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+Runs the reference interpreter (eager flags, one instruction per dispatch)
+and the configuration the shell runs (lazy flags, fused superinstructions)
+side by side on the same ROM and input, and stops at the first point where
+they disagree.
+
+The candidate is stepped one dispatch at a time and the reference is run until
+it has used as many cycles, so a fused sequence is checked as a whole. After
+every dispatch the registers, flags, ports and cycle counts are compared, and
+memory after every frame. When anything differs the frame is run again from
+its start comparing memory after every dispatch as well, so the report names
+the first dispatch that went wrong rather than the frame.
+*/
+
+// Frames run by default, an hour of play
+#define DEFAULT_FRAMES (60 * 60 * FRAMES_PER_SECOND) // NOLINT
+
+// Most differing memory bytes listed in a report
+#define MAX_REPORTED_BYTES 8 // NOLINT
+
+// Most reference instructions listed for one dispatch
+#define MAX_TRACED 32 // NOLINT
+
+// Random input: frames each pattern of buttons is held for, and how often a
+// coin and start are pressed to get a new game going
+#define INPUT_HOLD_FRAMES 16   // NOLINT
+#define NEW_GAME_FRAMES 3600   // NOLINT
+#define COIN_FRAME 60          // NOLINT
+#define START_FRAME 120        // NOLINT
+#define BUTTON_FRAMES 10       // NOLINT
+#define PORT1_COIN 0x01        // NOLINT
+#define PORT1_START 0x04       // NOLINT
+#define PORT1_PLAY_BUTTONS 0x70 // NOLINT fire, left and right
+
+// Machine state compared after every dispatch, besides the flags
+#define COMPARED_FIELDS(X)                                                    \
+  X(pc)                                                                       \
+  X(sp)                                                                       \
+  X(a)                                                                        \
+  X(b)                                                                        \
+  X(c)                                                                        \
+  X(d)                                                                        \
+  X(e)                                                                        \
+  X(h)                                                                        \
+  X(l)                                                                        \
+  X(interrupt_enabled)                                                        \
+  X(halted)                                                                   \
+  X(port1)                                                                    \
+  X(port2)                                                                    \
+  X(shift_msb)                                                                \
+  X(shift_lsb)                                                                \
+  X(shift_offset)                                                             \
+  X(last_out_port3)                                                           \
+  X(last_out_port5)                                                           \
+  X(ports_read)                                                               \
+  X(cycles)
+
+static i8080 reference;
+static i8080 candidate;
+
+// Where the current frame started, to run it again when it goes wrong
+static i8080_state reference_start;
+static i8080_state candidate_start;
+
+static input_movie movie;
+static bool use_movie = false;
+static uint32_t seed = 1;
+
+static uint64_t dispatches = 0;
+
+static bool
+registers_match(const i8080 *a, const i8080 *b)
+{
+#define MATCH_FIELD(field) &&a->field == b->field
+  return cpu_flags(a) == cpu_flags(b) COMPARED_FIELDS(MATCH_FIELD);
+#undef MATCH_FIELD
+}
+
+static void
+report_differences(const i8080 *a, const i8080 *b)
+{
+  int listed = 0;
+
+  printf("Differences (reference vs candidate):\n");
+#define REPORT_FIELD(field)                                                   \
+  if (a->field != b->field)                                                   \
+    {                                                                         \
+      printf("  %-16s 0x%" PRIx64 " vs 0x%" PRIx64 "\n", #field,            \
+             (uint64_t)a->field, (uint64_t)b->field);                         \
+    }
+  COMPARED_FIELDS(REPORT_FIELD)
+#undef REPORT_FIELD
+  if (cpu_flags(a) != cpu_flags(b))
+    {
+      printf("  %-16s ", "flags");
+      print_flags(cpu_flags(a));
+      printf(" vs ");
+      print_flags(cpu_flags(b));
+      printf("\n");
+    }
+  for (int address = 0; address < MEM_SIZE; address++)
+    {
+      if (a->memory[address] != b->memory[address])
+        {
+          if (listed++ == MAX_REPORTED_BYTES)
+            {
+              printf("  ...\n");
+              break;
+            }
+          printf("  memory 0x%04x    0x%02x vs 0x%02x\n", address,
+                 a->memory[address], b->memory[address]);
+        }
+    }
+}
+
+// The same made up but repeatable play for every run with the same seed
+static void
+random_input(uint64_t frame)
+{
+  uint64_t since_game = frame % NEW_GAME_FRAMES;
+  uint32_t hash = (uint32_t)(frame / INPUT_HOLD_FRAMES) * 2654435761U + seed;
+  uint8_t port1 = 0;
+
+  hash ^= hash >> 15; // NOLINT
+  hash *= 2246822519U; // NOLINT
+  hash ^= hash >> 13; // NOLINT
+
+  if (since_game >= COIN_FRAME && since_game < COIN_FRAME + BUTTON_FRAMES)
+    {
+      port1 |= PORT1_COIN;
+    }
+  if (since_game >= START_FRAME && since_game < START_FRAME + BUTTON_FRAMES)
+    {
+      port1 |= PORT1_START;
+    }
+  port1 |= hash & PORT1_PLAY_BUTTONS;
+
+  reference.port1 = candidate.port1 = port1;
+}
+
+/*
+Run both machines for cycles and return the (zero or negative) cycles left
+over, or INT32_MIN once they disagree. Without precise only registers are
+compared, with it memory as well and the first difference is reported.
+*/
+static int
+run_half(int cycles, uint64_t frame, bool precise)
+{
+  while (cycles > 0)
+    {
+      uint16_t traced[MAX_TRACED];
+      int count = 0;
+      uint16_t pc = candidate.pc;
+
+      if (use_movie)
+        {
+          movie_replay(&movie, &candidate);
+          reference.port1 = candidate.port1;
+          reference.port2 = candidate.port2;
+        }
+
+      int used = cpu_step(&candidate, cycles);
+      if (used < 0)
+        {
+          printf("Candidate stopped on opcode 0x%02x at 0x%04x in frame "
+                 "%" PRIu64 "\n",
+                 cpu_read_mem(&candidate, pc), pc, frame);
+          return INT32_MIN;
+        }
+      cycles -= used;
+      candidate.cycles += used;
+      dispatches++;
+
+      // the reference catches up one instruction at a time
+      while (reference.cycles < candidate.cycles)
+        {
+          if (count < MAX_TRACED)
+            {
+              traced[count] = reference.pc;
+            }
+          count++;
+          int step = cpu_step(&reference,
+                              (int)(candidate.cycles - reference.cycles));
+          if (step < 0)
+            {
+              printf("Reference stopped at 0x%04x in frame %" PRIu64 "\n",
+                     reference.pc, frame);
+              return INT32_MIN;
+            }
+          reference.cycles += step;
+        }
+
+      if (registers_match(&reference, &candidate)
+          && (!precise
+              || memcmp(reference.memory, candidate.memory, MEM_SIZE) == 0))
+        {
+          continue;
+        }
+      if (precise)
+        {
+          printf("Divergence in frame %" PRIu64 " after the dispatch at "
+                 "0x%04x, %" PRIu64 " dispatches in\n",
+                 frame, pc, dispatches);
+          printf("Reference ran %d instruction%s for it:\n", count,
+                 count == 1 ? "" : "s");
+          for (int i = 0; i < count && i < MAX_TRACED; i++)
+            {
+              uint8_t opcode = cpu_read_mem(&reference, traced[i]);
+              printf("  0x%04x  %02x  %s\n", traced[i], opcode,
+                     opcode_table[opcode].mnemonic);
+            }
+          report_differences(&reference, &candidate);
+        }
+      return INT32_MIN;
+    }
+  return cycles;
+}
+
+// One frame as cpu_run_frame runs it, on both machines
+static bool
+run_frame(uint64_t frame, bool precise)
+{
+  static const uint8_t interrupts[] = { 0x01, 0x02 };
+
+  if (!use_movie)
+    {
+      random_input(frame);
+    }
+
+  for (size_t half = 0; half < sizeof(interrupts); half++)
+    {
+      int left = run_half(HALF_FRAME_CYCLES - candidate.cycle_debt, frame,
+                          precise);
+      if (left == INT32_MIN)
+        {
+          return false;
+        }
+      reference.cycle_debt = candidate.cycle_debt = -left;
+      handle_interrupt(&reference, interrupts[half]);
+      handle_interrupt(&candidate, interrupts[half]);
+    }
+
+  return registers_match(&reference, &candidate)
+         && memcmp(reference.memory, candidate.memory, MEM_SIZE) == 0;
+}
+
+static bool
+load_machine(i8080 *cpu, const char *rom_path)
+{
+  cpu_init(cpu);
+  if (!cpu_load_file(cpu, rom_path, 0))
+    {
+      return false;
+    }
+  cpu_map_invaders(cpu);
+  return true;
+}
+
+static double
+seconds_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9; // NOLINT
+}
+
+// Parse a whole decimal number in [min, max]
+static bool
+parse_number(const char *arg, uint64_t min, uint64_t max, uint64_t *value)
+{
+  char *end = NULL;
+
+  errno = 0;
+  unsigned long long parsed = strtoull(arg, &end, 10); // NOLINT
+  if (*arg == '\0' || *end != '\0' || arg[0] == '-' || errno != 0
+      || parsed < min || parsed > max)
+    {
+      return false;
+    }
+  *value = parsed;
+  return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static const struct option long_options[]
+      = { { "frames", required_argument, NULL, 'f' },
+          { "movie", required_argument, NULL, 'm' },
+          { "seed", required_argument, NULL, 's' },
+          { "no-lazy", no_argument, NULL, 'e' },
+          { "no-fuse", no_argument, NULL, 'u' },
+          { NULL, 0, NULL, 0 } };
+  uint64_t frames = DEFAULT_FRAMES;
+  uint64_t value = 0;
+  bool lazy = true;
+  bool fuse = true;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+      switch (opt)
+        {
+        case 'f':
+          if (!parse_number(optarg, 1, UINT64_MAX, &frames))
+            {
+              fprintf(stderr, "Invalid frame count: %s\n", optarg);
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case 'm':
+          if (!movie_load(&movie, optarg))
+            {
+              exit(EXIT_FAILURE);
+            }
+          use_movie = true;
+          break;
+        case 's':
+          if (!parse_number(optarg, 0, UINT32_MAX, &value))
+            {
+              fprintf(stderr, "Invalid seed: %s\n", optarg);
+              exit(EXIT_FAILURE);
+            }
+          seed = (uint32_t)value;
+          break;
+        case 'e':
+          lazy = false;
+          break;
+        case 'u':
+          fuse = false;
+          break;
+        default:
+          exit(EXIT_FAILURE);
+        }
+    }
+
+  if (optind != argc - 1)
+    {
+      fprintf(stderr, "Please provide a ROM!\n");
+      exit(EXIT_FAILURE);
+    }
+  if (!load_machine(&reference, argv[optind])
+      || !load_machine(&candidate, argv[optind]))
+    {
+      exit(EXIT_FAILURE);
+    }
+  if (fuse)
+    {
+      cpu_fuse_rom(&candidate);
+    }
+  cpu_set_lazy_flags(&candidate, lazy);
+
+  double start = seconds_now();
+  for (uint64_t frame = 0; frame < frames; frame++)
+    {
+      size_t movie_next = movie.next;
+      uint64_t frame_dispatches = dispatches;
+
+      cpu_save_state(&reference, &reference_start);
+      cpu_save_state(&candidate, &candidate_start);
+      if (run_frame(frame, false))
+        {
+          continue;
+        }
+
+      // go back and find the exact dispatch
+      cpu_load_state(&reference, &reference_start);
+      cpu_load_state(&candidate, &candidate_start);
+      movie.next = movie_next;
+      dispatches = frame_dispatches;
+      if (run_frame(frame, true))
+        {
+          printf("Frame %" PRIu64 " diverged but not when run again\n",
+                 frame);
+        }
+      movie_free(&movie);
+      return EXIT_FAILURE;
+    }
+  double elapsed = seconds_now() - start;
+
+  printf("%" PRIu64 " frames (%.1f minutes of play), %" PRIu64
+         " dispatches matched in %.2f s, %.0fx real time\n",
+         frames, frames / (60.0 * FRAMES_PER_SECOND), dispatches, // NOLINT
+         elapsed,
+         elapsed > 0 ? frames / (elapsed * FRAMES_PER_SECOND) : 0);
+  movie_free(&movie);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+#include "movie.h"
+#include <inttypes.h>
+#include <string.h>
+
+// Entries the first allocation holds
+#define MOVIE_INITIAL_CAPACITY 256 // NOLINT
+
+// Longest line read from a movie file
+#define MOVIE_LINE_LENGTH 128 // NOLINT
+
+void
+movie_init(input_movie *movie)
+{
+  memset(movie, 0, sizeof(*movie));
+}
+
+void
+movie_free(input_movie *movie)
+{
+  free(movie->entries);
+  movie_init(movie);
+}
+
+static bool
+movie_add(input_movie *movie, const movie_entry *entry)
+{
+  if (movie->count == movie->capacity)
+    {
+      size_t capacity = movie->capacity == 0 ? MOVIE_INITIAL_CAPACITY
+                                             : movie->capacity * 2;
+      movie_entry *entries
+          = realloc(movie->entries, capacity * sizeof(movie_entry));
+      if (entries == NULL)
+        {
+          return false;
+        }
+      movie->entries = entries;
+      movie->capacity = capacity;
+    }
+  movie->entries[movie->count++] = *entry;
+  return true;
+}
+
+bool
+movie_load(input_movie *movie, const char *path)
+{
+  FILE *file = fopen(path, "r");
+  char line[MOVIE_LINE_LENGTH];
+  int number = 0;
+
+  if (file == NULL)
+    {
+      fprintf(stderr, "Error: Unable to open movie %s\n", path);
+      return false;
+    }
+
+  movie_init(movie);
+  while (fgets(line, sizeof(line), file) != NULL)
+    {
+      movie_entry entry;
+      unsigned int port1 = 0;
+      unsigned int port2 = 0;
+      char extra = 0;
+
+      number++;
+      line[strcspn(line, "#")] = '\0';
+      if (line[strspn(line, " \t\r\n")] == '\0')
+        {
+          continue;
+        }
+      if (sscanf(line, "%" SCNu64 " %x %x %c", &entry.cycle, &port1, &port2,
+                 &extra)
+              != 3
+          || port1 > MAX_8_BIT_VALUE || port2 > MAX_8_BIT_VALUE
+          || (movie->count > 0
+              && entry.cycle < movie->entries[movie->count - 1].cycle))
+        {
+          fprintf(stderr, "Error: %s:%d is not a cycle port1 port2 line in "
+                          "cycle order\n",
+                  path, number);
+          movie_free(movie);
+          fclose(file);
+          return false;
+        }
+      entry.port1 = (uint8_t)port1;
+      entry.port2 = (uint8_t)port2;
+      if (!movie_add(movie, &entry))
+        {
+          fprintf(stderr, "Error: Out of memory reading %s\n", path);
+          movie_free(movie);
+          fclose(file);
+          return false;
+        }
+    }
+  fclose(file);
+  return true;
+}
+
+bool
+movie_save(const input_movie *movie, const char *path)
+{
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL)
+    {
+      fprintf(stderr, "Error: Unable to write movie %s\n", path);
+      return false;
+    }
+
+  fprintf(file, "# cycle port1 port2\n");
+  for (size_t i = 0; i < movie->count; i++)
+    {
+      const movie_entry *entry = &movie->entries[i];
+      fprintf(file, "%" PRIu64 " %02x %02x\n", entry->cycle, entry->port1,
+              entry->port2);
+    }
+  return fclose(file) == 0;
+}
+
+// Add the ports as they are now, call after every change to them
+void
+movie_record(input_movie *movie, const i8080 *cpu)
+{
+  movie_entry entry = { cpu->cycles, cpu->port1, cpu->port2 };
+
+  if (!movie_add(movie, &entry))
+    {
+      fprintf(stderr, "Error: Out of memory recording input\n");
+    }
+}
+
+// Set the ports from every entry the CPU has reached
+void
+movie_replay(input_movie *movie, i8080 *cpu)
+{
+  while (movie->next < movie->count
+         && movie->entries[movie->next].cycle <= cpu->cycles)
+    {
+      cpu->port1 = movie->entries[movie->next].port1;
+      cpu->port2 = movie->entries[movie->next].port2;
+      movie->next++;
+    }
+}
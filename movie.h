@@ -0,0 +1,33 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "emulator.h"
+
+// The input ports as they became at one point in emulated time
+typedef struct
+{
+  uint64_t cycle;
+  uint8_t port1, port2;
+} movie_entry;
+
+/*
+Recorded input, replayed by setting the ports once the CPU reaches each
+entry's cycle. On disk it is text, one "cycle port1 port2" line per entry
+(ports in hex) in cycle order, with # starting a comment.
+*/
+typedef struct
+{
+  movie_entry *entries;
+  size_t count;
+  size_t capacity;
+  size_t next; // first entry not replayed yet
+} input_movie;
+
+void movie_init(input_movie *movie);
+void movie_free(input_movie *movie);
+bool movie_load(input_movie *movie, const char *path);
+bool movie_save(const input_movie *movie, const char *path);
+void movie_record(input_movie *movie, const i8080 *cpu);
+void movie_replay(input_movie *movie, i8080 *cpu);
+
+#endif
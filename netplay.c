@@ -0,0 +1,330 @@
+#include "netplay.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define NETPLAY_MAGIC 0x49383038 // "I808"
+#define NO_ROLLBACK UINT32_MAX
+
+// Port bits each player owns: coin, start and the player's own controls
+#define P1_PORT1_MASK 0x75 // NOLINT
+#define P2_PORT1_MASK 0x03 // NOLINT
+#define P2_PORT2_MASK 0x70 // NOLINT
+
+bool
+netplay_open(netplay_session *session, uint16_t local_port,
+             uint16_t peer_port, int player)
+{
+  memset(session, 0, sizeof(*session));
+  session->player = player;
+  session->rollback_frame = NO_ROLLBACK;
+  for (int i = 0; i < NETPLAY_WINDOW; i++)
+    {
+      session->remote_tag[i] = UINT32_MAX;
+      session->peer_hash_tag[i] = UINT32_MAX;
+    }
+
+  session->socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (session->socket < 0)
+    {
+      perror("Error: unable to create netplay socket");
+      return false;
+    }
+
+  struct sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  local.sin_port = htons(local_port);
+  if (bind(session->socket, (struct sockaddr *)&local, sizeof(local)) < 0)
+    {
+      perror("Error: unable to bind netplay socket");
+      close(session->socket);
+      return false;
+    }
+
+  // the emulation thread polls once per frame and must never block
+  int flags = fcntl(session->socket, F_GETFL, 0);
+  fcntl(session->socket, F_SETFL, flags | O_NONBLOCK);
+
+  session->peer.sin_family = AF_INET;
+  session->peer.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  session->peer.sin_port = htons(peer_port);
+  return true;
+}
+
+void
+netplay_close(netplay_session *session)
+{
+  if (session->socket >= 0)
+    {
+      close(session->socket);
+      session->socket = -1;
+    }
+}
+
+// Keep only the bits the given player is allowed to drive
+netplay_input
+netplay_local_input(int player, uint8_t port1, uint8_t port2)
+{
+  netplay_input input;
+  if (player == 1)
+    {
+      input.port1 = port1 & P1_PORT1_MASK;
+      input.port2 = 0;
+    }
+  else
+    {
+      input.port1 = port1 & P2_PORT1_MASK;
+      input.port2 = port2 & P2_PORT2_MASK;
+    }
+  return input;
+}
+
+static bool
+input_equal(netplay_input a, netplay_input b)
+{
+  return a.port1 == b.port1 && a.port2 == b.port2;
+}
+
+// Known remote input for a frame, or the last known one as a prediction
+static netplay_input
+remote_input(const netplay_session *session, uint32_t frame)
+{
+  netplay_input none = { 0, 0 };
+  uint32_t slot = frame & NETPLAY_WINDOW_MASK;
+
+  if (session->remote_tag[slot] == frame)
+    {
+      return session->remote[slot];
+    }
+  if (session->remote_frame == 0)
+    {
+      return none;
+    }
+  return session->remote[(session->remote_frame - 1) & NETPLAY_WINDOW_MASK];
+}
+
+// Save the state before the frame, then run it with both players' input
+static void
+simulate(netplay_session *session, i8080 *cpu, uint32_t frame)
+{
+  uint32_t slot = frame & NETPLAY_WINDOW_MASK;
+  netplay_input remote = remote_input(session, frame);
+
+  cpu_save_state(cpu, &session->states[slot]);
+  session->used[slot] = remote;
+  cpu->port1 = session->local[slot].port1 | remote.port1;
+  cpu->port2 = session->local[slot].port2 | remote.port2;
+  cpu_run_frame(cpu, NULL);
+}
+
+static void
+send_packet(netplay_session *session)
+{
+  netplay_packet packet;
+  memset(&packet, 0, sizeof(packet));
+
+  // everything the peer is missing, capped to what still fits in the window
+  uint32_t first = session->peer_ack < session->frame ? session->peer_ack
+                                                      : session->frame;
+  if (session->frame - first > NETPLAY_PACKET_INPUTS)
+    {
+      first = session->frame - NETPLAY_PACKET_INPUTS;
+    }
+
+  packet.magic = NETPLAY_MAGIC;
+  packet.first_frame = first;
+  packet.count = session->frame - first;
+  packet.ack = session->remote_frame;
+  for (uint32_t i = 0; i < packet.count; i++)
+    {
+      packet.inputs[i] = session->local[(first + i) & NETPLAY_WINDOW_MASK];
+    }
+  if (session->hashed_frame > 0)
+    {
+      packet.has_hash = 1;
+      packet.hash_frame = session->hashed_frame - 1;
+      packet.hash
+          = session->hashes[packet.hash_frame & NETPLAY_WINDOW_MASK];
+    }
+
+  // a lost packet is covered by the next one, so errors are not fatal
+  sendto(session->socket, &packet, sizeof(packet), 0,
+         (struct sockaddr *)&session->peer, sizeof(session->peer));
+}
+
+static void
+receive_input(netplay_session *session, uint32_t frame, netplay_input input)
+{
+  uint32_t slot = frame & NETPLAY_WINDOW_MASK;
+
+  // already known, or too old / too new to fit in the window
+  if (frame < session->remote_frame || session->remote_tag[slot] == frame
+      || frame + NETPLAY_WINDOW / 2 < session->frame
+      || frame >= session->frame + NETPLAY_WINDOW / 2)
+    {
+      return;
+    }
+
+  session->remote[slot] = input;
+  session->remote_tag[slot] = frame;
+
+  // a frame that already ran with a wrong prediction has to be redone
+  if (frame < session->frame && !input_equal(session->used[slot], input)
+      && frame < session->rollback_frame)
+    {
+      session->rollback_frame = frame;
+    }
+}
+
+static void
+compare_hash(netplay_session *session, uint32_t frame)
+{
+  uint32_t slot = frame & NETPLAY_WINDOW_MASK;
+  if (frame < session->hashed_frame
+      && frame + NETPLAY_WINDOW > session->hashed_frame
+      && session->peer_hash_tag[slot] == frame
+      && session->peer_hashes[slot] != session->hashes[slot]
+      && !session->desynced)
+    {
+      session->desynced = true;
+      session->desync_frame = frame;
+    }
+}
+
+static void
+receive_packets(netplay_session *session)
+{
+  netplay_packet packet;
+  ssize_t length;
+
+  while ((length = recv(session->socket, &packet, sizeof(packet), 0)) > 0)
+    {
+      if ((size_t)length != sizeof(packet) || packet.magic != NETPLAY_MAGIC
+          || packet.count > NETPLAY_PACKET_INPUTS)
+        {
+          continue;
+        }
+
+      for (uint32_t i = 0; i < packet.count; i++)
+        {
+          receive_input(session, packet.first_frame + i, packet.inputs[i]);
+        }
+      if (packet.ack > session->peer_ack)
+        {
+          session->peer_ack = packet.ack;
+        }
+      if (packet.has_hash)
+        {
+          uint32_t slot = packet.hash_frame & NETPLAY_WINDOW_MASK;
+          session->peer_hashes[slot] = packet.hash;
+          session->peer_hash_tag[slot] = packet.hash_frame;
+          compare_hash(session, packet.hash_frame);
+        }
+    }
+
+  // extend the run of frames with known remote input
+  while (session->remote_tag[session->remote_frame & NETPLAY_WINDOW_MASK]
+         == session->remote_frame)
+    {
+      session->remote_frame++;
+    }
+}
+
+// Restore the state before the first mispredicted frame and run forward
+// again with the corrected input
+static void
+rollback(netplay_session *session, i8080 *cpu)
+{
+  uint64_t start = SDL_GetPerformanceCounter();
+  uint32_t from = session->rollback_frame;
+
+  cpu_load_state(cpu, &session->states[from & NETPLAY_WINDOW_MASK]);
+  cpu->sound_muted = true;
+  for (uint32_t frame = from; frame < session->frame; frame++)
+    {
+      simulate(session, cpu, frame);
+    }
+  cpu->sound_muted = false;
+
+  // the corrected frames may have left the UFO latch somewhere else
+  cpu_sync_sound(cpu);
+
+  double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 // NOLINT
+              / (double)SDL_GetPerformanceFrequency();
+  uint32_t depth = session->frame - from;
+  session->rollbacks++;
+  session->resimulated += depth;
+  session->max_depth = depth > session->max_depth ? depth : session->max_depth;
+  session->max_rollback_ms
+      = ms > session->max_rollback_ms ? ms : session->max_rollback_ms;
+  session->rollback_frame = NO_ROLLBACK;
+}
+
+// Hash the state after every frame whose inputs are now all final
+static void
+hash_confirmed(netplay_session *session)
+{
+  while (session->hashed_frame < session->remote_frame
+         && session->hashed_frame + 1 < session->frame)
+    {
+      uint32_t frame = session->hashed_frame;
+      const i8080_state *after
+          = &session->states[(frame + 1) & NETPLAY_WINDOW_MASK];
+      session->hashes[frame & NETPLAY_WINDOW_MASK] = cpu_state_hash(after);
+      session->hashed_frame++;
+      compare_hash(session, frame);
+    }
+}
+
+// Run one real frame. Returns false when the session had to wait for the
+// peer instead because predicting further would exceed the rollback depth.
+bool
+netplay_advance(netplay_session *session, i8080 *cpu, netplay_input local)
+{
+  receive_packets(session);
+  if (session->rollback_frame != NO_ROLLBACK)
+    {
+      rollback(session, cpu);
+    }
+  hash_confirmed(session);
+
+  // the peer may be ahead of us, so compare without unsigned wrap-around
+  if (session->frame >= session->remote_frame + NETPLAY_MAX_ROLLBACK)
+    {
+      session->stalls++;
+      send_packet(session);
+      return false;
+    }
+
+  session->local[session->frame & NETPLAY_WINDOW_MASK] = local;
+  simulate(session, cpu, session->frame);
+  session->frame++;
+  send_packet(session);
+  return true;
+}
+
+void
+netplay_report(const netplay_session *session, FILE *out)
+{
+  fprintf(out,
+          "netplay: player %d, %u frames, %u rollbacks (%u frames "
+          "resimulated, deepest %u, slowest %.2f ms), %u stalls\n",
+          session->player, session->frame, session->rollbacks,
+          session->resimulated, session->max_depth, session->max_rollback_ms,
+          session->stalls);
+  if (session->desynced)
+    {
+      fprintf(out, "netplay: DESYNC detected after frame %u\n",
+              session->desync_frame);
+    }
+  else
+    {
+      fprintf(out, "netplay: %u frames verified in sync\n",
+              session->hashed_frame);
+    }
+}
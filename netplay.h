@@ -0,0 +1,85 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "emulator.h"
+#include <netinet/in.h>
+
+// Deepest rollback allowed, the session stalls rather than predict further
+#define NETPLAY_MAX_ROLLBACK 8 // NOLINT
+
+// Frames of history kept, must be a power of two well above the rollback
+// depth since the peer may be up to NETPLAY_MAX_ROLLBACK frames ahead
+#define NETPLAY_WINDOW 32 // NOLINT
+#define NETPLAY_WINDOW_MASK (NETPLAY_WINDOW - 1)
+
+// Most inputs a packet carries, enough to cover everything the peer can be
+// missing before both sides stall
+#define NETPLAY_PACKET_INPUTS (2 * NETPLAY_MAX_ROLLBACK)
+
+// The port bits one player drives for one frame
+typedef struct
+{
+  uint8_t port1, port2;
+} netplay_input;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t first_frame; // frame of inputs[0]
+  uint32_t count;
+  uint32_t ack;        // sender has all of our inputs below this frame
+  uint32_t hash_frame; // frame the hash was taken after, if has_hash
+  uint32_t has_hash;
+  uint64_t hash;
+  netplay_input inputs[NETPLAY_PACKET_INPUTS];
+} netplay_packet;
+
+/*
+Rollback session between two processes. Every frame is simulated straight
+away with the local input and a prediction for the remote one (its last
+known input). When the real remote input turns out different, the machine is
+restored to the state saved before that frame and re-simulated to the present
+with sound muted. Once both inputs of a frame are known the state after it is
+hashed and the hash is exchanged to detect desyncs.
+*/
+typedef struct
+{
+  int socket;
+  struct sockaddr_in peer;
+  int player; // 1 or 2
+
+  uint32_t frame;          // next frame to simulate
+  uint32_t remote_frame;   // remote inputs are known for all frames below
+  uint32_t peer_ack;       // peer has all of our inputs below this frame
+  uint32_t rollback_frame; // earliest mispredicted frame, UINT32_MAX if none
+  uint32_t hashed_frame;   // own hashes are taken for all frames below
+
+  netplay_input local[NETPLAY_WINDOW];
+  netplay_input remote[NETPLAY_WINDOW];
+  uint32_t remote_tag[NETPLAY_WINDOW]; // frame the remote slot is known for
+  netplay_input used[NETPLAY_WINDOW];  // remote input each frame ran with
+  i8080_state states[NETPLAY_WINDOW];  // state before each frame
+  uint64_t hashes[NETPLAY_WINDOW];     // state hash after each frame
+  uint64_t peer_hashes[NETPLAY_WINDOW];
+  uint32_t peer_hash_tag[NETPLAY_WINDOW];
+
+  bool desynced;
+  uint32_t desync_frame;
+
+  // statistics
+  uint32_t rollbacks;
+  uint32_t max_depth;
+  uint32_t resimulated;
+  uint32_t stalls;
+  double max_rollback_ms;
+} netplay_session;
+
+bool netplay_open(netplay_session *session, uint16_t local_port,
+                  uint16_t peer_port, int player);
+void netplay_close(netplay_session *session);
+netplay_input netplay_local_input(int player, uint8_t port1, uint8_t port2);
+bool netplay_advance(netplay_session *session, i8080 *cpu,
+                     netplay_input local);
+void netplay_report(const netplay_session *session, FILE *out);
+
+#endif
@@ -0,0 +1,7 @@
+#include "opcodes.h"
+
+#define OPCODE_ENTRY(code, mnemonic, length, cycles, taken_cycles, operand,   \
+                     flags, branch)                                           \
+  [code] = { mnemonic, length, cycles, taken_cycles, operand, flags, branch },
+
+const opcode_info opcode_table[256] = { OPCODES(OPCODE_ENTRY) }; // NOLINT
@@ -0,0 +1,322 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Flags Defined, in the bit positions the 8080 gives them in the PSW byte
+// PUSH PSW stores (S Z 0 AC 0 P 1 CY)
+#define FLAG_S 0x80  // NOLINT
+#define FLAG_Z 0x40  // NOLINT
+#define FLAG_AC 0x10 // NOLINT
+#define FLAG_P 0x04  // NOLINT
+#define FLAG_CY 0x01 // NOLINT
+
+// Bit 1 of the PSW byte always reads as 1, bits 3 and 5 as 0
+#define PSW_SET_BITS 0x02 // NOLINT
+
+// Flag sets an instruction can change
+#define FLAGS_NONE 0
+#define FLAGS_SZAP (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P)
+#define FLAGS_ALL (FLAGS_SZAP | FLAG_CY)
+
+// What follows the opcode byte
+enum opcode_operand
+{
+  OPERAND_NONE,
+  OPERAND_D8,   // immediate byte, #$nn
+  OPERAND_D16,  // immediate word, #$nnnn
+  OPERAND_ADDR, // address, $nnnn
+};
+
+/*
+Everything known about each opcode, in one place. The emulator, the
+disassembler and the tests are all built from this list rather than keeping
+their own copies.
+
+X(opcode, mnemonic, length, cycles, taken_cycles, operand, flags, branch)
+
+mnemonic      register operands included, immediates left to the operand
+length        bytes including the opcode
+cycles        states when a condition is not met (or there is none)
+taken_cycles  states when it is; only conditional calls and returns differ
+flags         FLAG_* bits the instruction can change
+branch        whether it can move PC anywhere but the next instruction
+
+Undocumented opcodes carry a '*' and alias the documented one they decode to.
+*/
+// NOLINTBEGIN
+#define OPCODES(X)                                                            \
+  X(0x00, "NOP", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                    \
+  X(0x01, "LXI B", 3, 10, 10, OPERAND_D16, FLAGS_NONE, false)                 \
+  X(0x02, "STAX B", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                 \
+  X(0x03, "INX B", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                  \
+  X(0x04, "INR B", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x05, "DCR B", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x06, "MVI B", 2, 7, 7, OPERAND_D8, FLAGS_NONE, false)                    \
+  X(0x07, "RLC", 1, 4, 4, OPERAND_NONE, FLAG_CY, false)                       \
+  X(0x08, "*NOP", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                   \
+  X(0x09, "DAD B", 1, 10, 10, OPERAND_NONE, FLAG_CY, false)                   \
+  X(0x0A, "LDAX B", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                 \
+  X(0x0B, "DCX B", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                  \
+  X(0x0C, "INR C", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x0D, "DCR C", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x0E, "MVI C", 2, 7, 7, OPERAND_D8, FLAGS_NONE, false)                    \
+  X(0x0F, "RRC", 1, 4, 4, OPERAND_NONE, FLAG_CY, false)                       \
+  X(0x10, "*NOP", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                   \
+  X(0x11, "LXI D", 3, 10, 10, OPERAND_D16, FLAGS_NONE, false)                 \
+  X(0x12, "STAX D", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                 \
+  X(0x13, "INX D", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                  \
+  X(0x14, "INR D", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x15, "DCR D", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x16, "MVI D", 2, 7, 7, OPERAND_D8, FLAGS_NONE, false)                    \
+  X(0x17, "RAL", 1, 4, 4, OPERAND_NONE, FLAG_CY, false)                       \
+  X(0x18, "*NOP", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                   \
+  X(0x19, "DAD D", 1, 10, 10, OPERAND_NONE, FLAG_CY, false)                   \
+  X(0x1A, "LDAX D", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                 \
+  X(0x1B, "DCX D", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                  \
+  X(0x1C, "INR E", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x1D, "DCR E", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x1E, "MVI E", 2, 7, 7, OPERAND_D8, FLAGS_NONE, false)                    \
+  X(0x1F, "RAR", 1, 4, 4, OPERAND_NONE, FLAG_CY, false)                       \
+  X(0x20, "*NOP", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                   \
+  X(0x21, "LXI H", 3, 10, 10, OPERAND_D16, FLAGS_NONE, false)                 \
+  X(0x22, "SHLD", 3, 16, 16, OPERAND_ADDR, FLAGS_NONE, false)                 \
+  X(0x23, "INX H", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                  \
+  X(0x24, "INR H", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x25, "DCR H", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x26, "MVI H", 2, 7, 7, OPERAND_D8, FLAGS_NONE, false)                    \
+  X(0x27, "DAA", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                     \
+  X(0x28, "*NOP", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                   \
+  X(0x29, "DAD H", 1, 10, 10, OPERAND_NONE, FLAG_CY, false)                   \
+  X(0x2A, "LHLD", 3, 16, 16, OPERAND_ADDR, FLAGS_NONE, false)                 \
+  X(0x2B, "DCX H", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                  \
+  X(0x2C, "INR L", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x2D, "DCR L", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x2E, "MVI L", 2, 7, 7, OPERAND_D8, FLAGS_NONE, false)                    \
+  X(0x2F, "CMA", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                    \
+  X(0x30, "*NOP", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                   \
+  X(0x31, "LXI SP", 3, 10, 10, OPERAND_D16, FLAGS_NONE, false)                \
+  X(0x32, "STA", 3, 13, 13, OPERAND_ADDR, FLAGS_NONE, false)                  \
+  X(0x33, "INX SP", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                 \
+  X(0x34, "INR M", 1, 10, 10, OPERAND_NONE, FLAGS_SZAP, false)                \
+  X(0x35, "DCR M", 1, 10, 10, OPERAND_NONE, FLAGS_SZAP, false)                \
+  X(0x36, "MVI M", 2, 10, 10, OPERAND_D8, FLAGS_NONE, false)                  \
+  X(0x37, "STC", 1, 4, 4, OPERAND_NONE, FLAG_CY, false)                       \
+  X(0x38, "*NOP", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                   \
+  X(0x39, "DAD SP", 1, 10, 10, OPERAND_NONE, FLAG_CY, false)                  \
+  X(0x3A, "LDA", 3, 13, 13, OPERAND_ADDR, FLAGS_NONE, false)                  \
+  X(0x3B, "DCX SP", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                 \
+  X(0x3C, "INR A", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x3D, "DCR A", 1, 5, 5, OPERAND_NONE, FLAGS_SZAP, false)                  \
+  X(0x3E, "MVI A", 2, 7, 7, OPERAND_D8, FLAGS_NONE, false)                    \
+  X(0x3F, "CMC", 1, 4, 4, OPERAND_NONE, FLAG_CY, false)                       \
+  X(0x40, "MOV B,B", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x41, "MOV B,C", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x42, "MOV B,D", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x43, "MOV B,E", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x44, "MOV B,H", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x45, "MOV B,L", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x46, "MOV B,M", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x47, "MOV B,A", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x48, "MOV C,B", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x49, "MOV C,C", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x4A, "MOV C,D", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x4B, "MOV C,E", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x4C, "MOV C,H", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x4D, "MOV C,L", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x4E, "MOV C,M", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x4F, "MOV C,A", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x50, "MOV D,B", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x51, "MOV D,C", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x52, "MOV D,D", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x53, "MOV D,E", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x54, "MOV D,H", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x55, "MOV D,L", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x56, "MOV D,M", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x57, "MOV D,A", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x58, "MOV E,B", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x59, "MOV E,C", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x5A, "MOV E,D", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x5B, "MOV E,E", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x5C, "MOV E,H", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x5D, "MOV E,L", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x5E, "MOV E,M", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x5F, "MOV E,A", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x60, "MOV H,B", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x61, "MOV H,C", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x62, "MOV H,D", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x63, "MOV H,E", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x64, "MOV H,H", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x65, "MOV H,L", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x66, "MOV H,M", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x67, "MOV H,A", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x68, "MOV L,B", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x69, "MOV L,C", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x6A, "MOV L,D", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x6B, "MOV L,E", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x6C, "MOV L,H", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x6D, "MOV L,L", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x6E, "MOV L,M", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x6F, "MOV L,A", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x70, "MOV M,B", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x71, "MOV M,C", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x72, "MOV M,D", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x73, "MOV M,E", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x74, "MOV M,H", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x75, "MOV M,L", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x76, "HLT", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                    \
+  X(0x77, "MOV M,A", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x78, "MOV A,B", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x79, "MOV A,C", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x7A, "MOV A,D", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x7B, "MOV A,E", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x7C, "MOV A,H", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x7D, "MOV A,L", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x7E, "MOV A,M", 1, 7, 7, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x7F, "MOV A,A", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0x80, "ADD B", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x81, "ADD C", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x82, "ADD D", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x83, "ADD E", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x84, "ADD H", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x85, "ADD L", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x86, "ADD M", 1, 7, 7, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x87, "ADD A", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x88, "ADC B", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x89, "ADC C", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x8A, "ADC D", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x8B, "ADC E", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x8C, "ADC H", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x8D, "ADC L", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x8E, "ADC M", 1, 7, 7, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x8F, "ADC A", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x90, "SUB B", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x91, "SUB C", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x92, "SUB D", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x93, "SUB E", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x94, "SUB H", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x95, "SUB L", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x96, "SUB M", 1, 7, 7, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x97, "SUB A", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x98, "SBB B", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x99, "SBB C", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x9A, "SBB D", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x9B, "SBB E", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x9C, "SBB H", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x9D, "SBB L", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x9E, "SBB M", 1, 7, 7, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0x9F, "SBB A", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA0, "ANA B", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA1, "ANA C", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA2, "ANA D", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA3, "ANA E", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA4, "ANA H", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA5, "ANA L", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA6, "ANA M", 1, 7, 7, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA7, "ANA A", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA8, "XRA B", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xA9, "XRA C", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xAA, "XRA D", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xAB, "XRA E", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xAC, "XRA H", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xAD, "XRA L", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xAE, "XRA M", 1, 7, 7, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xAF, "XRA A", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB0, "ORA B", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB1, "ORA C", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB2, "ORA D", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB3, "ORA E", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB4, "ORA H", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB5, "ORA L", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB6, "ORA M", 1, 7, 7, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB7, "ORA A", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB8, "CMP B", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xB9, "CMP C", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xBA, "CMP D", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xBB, "CMP E", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xBC, "CMP H", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xBD, "CMP L", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xBE, "CMP M", 1, 7, 7, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xBF, "CMP A", 1, 4, 4, OPERAND_NONE, FLAGS_ALL, false)                   \
+  X(0xC0, "RNZ", 1, 5, 11, OPERAND_NONE, FLAGS_NONE, true)                    \
+  X(0xC1, "POP B", 1, 10, 10, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0xC2, "JNZ", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                   \
+  X(0xC3, "JMP", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                   \
+  X(0xC4, "CNZ", 3, 11, 17, OPERAND_ADDR, FLAGS_NONE, true)                   \
+  X(0xC5, "PUSH B", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, false)               \
+  X(0xC6, "ADI", 2, 7, 7, OPERAND_D8, FLAGS_ALL, false)                       \
+  X(0xC7, "RST 0", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, true)                 \
+  X(0xC8, "RZ", 1, 5, 11, OPERAND_NONE, FLAGS_NONE, true)                     \
+  X(0xC9, "RET", 1, 10, 10, OPERAND_NONE, FLAGS_NONE, true)                   \
+  X(0xCA, "JZ", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                    \
+  X(0xCB, "*JMP", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                  \
+  X(0xCC, "CZ", 3, 11, 17, OPERAND_ADDR, FLAGS_NONE, true)                    \
+  X(0xCD, "CALL", 3, 17, 17, OPERAND_ADDR, FLAGS_NONE, true)                  \
+  X(0xCE, "ACI", 2, 7, 7, OPERAND_D8, FLAGS_ALL, false)                       \
+  X(0xCF, "RST 1", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, true)                 \
+  X(0xD0, "RNC", 1, 5, 11, OPERAND_NONE, FLAGS_NONE, true)                    \
+  X(0xD1, "POP D", 1, 10, 10, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0xD2, "JNC", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                   \
+  X(0xD3, "OUT", 2, 10, 10, OPERAND_D8, FLAGS_NONE, false)                    \
+  X(0xD4, "CNC", 3, 11, 17, OPERAND_ADDR, FLAGS_NONE, true)                   \
+  X(0xD5, "PUSH D", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, false)               \
+  X(0xD6, "SUI", 2, 7, 7, OPERAND_D8, FLAGS_ALL, false)                       \
+  X(0xD7, "RST 2", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, true)                 \
+  X(0xD8, "RC", 1, 5, 11, OPERAND_NONE, FLAGS_NONE, true)                     \
+  X(0xD9, "*RET", 1, 10, 10, OPERAND_NONE, FLAGS_NONE, true)                  \
+  X(0xDA, "JC", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                    \
+  X(0xDB, "IN", 2, 10, 10, OPERAND_D8, FLAGS_NONE, false)                     \
+  X(0xDC, "CC", 3, 11, 17, OPERAND_ADDR, FLAGS_NONE, true)                    \
+  X(0xDD, "*CALL", 3, 17, 17, OPERAND_ADDR, FLAGS_NONE, true)                 \
+  X(0xDE, "SBI", 2, 7, 7, OPERAND_D8, FLAGS_ALL, false)                       \
+  X(0xDF, "RST 3", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, true)                 \
+  X(0xE0, "RPO", 1, 5, 11, OPERAND_NONE, FLAGS_NONE, true)                    \
+  X(0xE1, "POP H", 1, 10, 10, OPERAND_NONE, FLAGS_NONE, false)                \
+  X(0xE2, "JPO", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                   \
+  X(0xE3, "XTHL", 1, 18, 18, OPERAND_NONE, FLAGS_NONE, false)                 \
+  X(0xE4, "CPO", 3, 11, 17, OPERAND_ADDR, FLAGS_NONE, true)                   \
+  X(0xE5, "PUSH H", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, false)               \
+  X(0xE6, "ANI", 2, 7, 7, OPERAND_D8, FLAGS_ALL, false)                       \
+  X(0xE7, "RST 4", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, true)                 \
+  X(0xE8, "RPE", 1, 5, 11, OPERAND_NONE, FLAGS_NONE, true)                    \
+  X(0xE9, "PCHL", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, true)                    \
+  X(0xEA, "JPE", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                   \
+  X(0xEB, "XCHG", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                   \
+  X(0xEC, "CPE", 3, 11, 17, OPERAND_ADDR, FLAGS_NONE, true)                   \
+  X(0xED, "*CALL", 3, 17, 17, OPERAND_ADDR, FLAGS_NONE, true)                 \
+  X(0xEE, "XRI", 2, 7, 7, OPERAND_D8, FLAGS_ALL, false)                       \
+  X(0xEF, "RST 5", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, true)                 \
+  X(0xF0, "RP", 1, 5, 11, OPERAND_NONE, FLAGS_NONE, true)                     \
+  X(0xF1, "POP PSW", 1, 10, 10, OPERAND_NONE, FLAGS_ALL, false)               \
+  X(0xF2, "JP", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                    \
+  X(0xF3, "DI", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                     \
+  X(0xF4, "CP", 3, 11, 17, OPERAND_ADDR, FLAGS_NONE, true)                    \
+  X(0xF5, "PUSH PSW", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, false)             \
+  X(0xF6, "ORI", 2, 7, 7, OPERAND_D8, FLAGS_ALL, false)                       \
+  X(0xF7, "RST 6", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, true)                 \
+  X(0xF8, "RM", 1, 5, 11, OPERAND_NONE, FLAGS_NONE, true)                     \
+  X(0xF9, "SPHL", 1, 5, 5, OPERAND_NONE, FLAGS_NONE, false)                   \
+  X(0xFA, "JM", 3, 10, 10, OPERAND_ADDR, FLAGS_NONE, true)                    \
+  X(0xFB, "EI", 1, 4, 4, OPERAND_NONE, FLAGS_NONE, false)                     \
+  X(0xFC, "CM", 3, 11, 17, OPERAND_ADDR, FLAGS_NONE, true)                    \
+  X(0xFD, "*CALL", 3, 17, 17, OPERAND_ADDR, FLAGS_NONE, true)                 \
+  X(0xFE, "CPI", 2, 7, 7, OPERAND_D8, FLAGS_ALL, false)                       \
+  X(0xFF, "RST 7", 1, 11, 11, OPERAND_NONE, FLAGS_NONE, true)
+
+// NOLINTEND
+
+typedef struct
+{
+  const char *mnemonic;
+  uint8_t length;
+  uint8_t cycles;
+  uint8_t taken_cycles;
+  uint8_t operand;
+  uint8_t flags;
+  bool branch;
+} opcode_info;
+
+extern const opcode_info opcode_table[256]; // NOLINT
+
+#endif
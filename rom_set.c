@@ -0,0 +1,126 @@
+#include "rom_set.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reflected CRC-32 polynomial, as used by zip and MAME
+#define CRC32_POLYNOMIAL 0xEDB88320U // NOLINT
+
+static const rom_file invaders_set[ROM_SET_FILES] = {
+  { "invaders.h", 0x0000, 0x734F5AD8 }, // NOLINT
+  { "invaders.g", 0x0800, 0x6BFACA4A }, // NOLINT
+  { "invaders.f", 0x1000, 0x0CCEAD96 }, // NOLINT
+  { "invaders.e", 0x1800, 0x14E538B0 }, // NOLINT
+};
+
+uint32_t
+rom_crc32(const uint8_t *data, size_t size)
+{
+  uint32_t crc = 0xFFFFFFFFU; // NOLINT
+
+  // bit at a time is plenty for 8 KB read once at startup
+  for (size_t i = 0; i < size; i++)
+    {
+      crc ^= data[i];
+      for (int bit = 0; bit < 8; bit++) // NOLINT
+        {
+          crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & -(crc & 1));
+        }
+    }
+  return ~crc;
+}
+
+// Map one file of the set read-only, NULL if it is missing or the wrong size
+static const uint8_t *
+map_file(const char *path)
+{
+  struct stat info;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    {
+      fprintf(stderr, "Error: Unable to open file %s\n", path);
+      return NULL;
+    }
+  if (fstat(fd, &info) < 0 || info.st_size != ROM_FILE_SIZE)
+    {
+      fprintf(stderr, "Error: %s is not a %d byte ROM\n", path,
+              ROM_FILE_SIZE);
+      close(fd);
+      return NULL;
+    }
+
+  void *data = mmap(NULL, ROM_FILE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file alive on its own
+  close(fd);
+  if (data == MAP_FAILED)
+    {
+      perror("Error: unable to map ROM file");
+      return NULL;
+    }
+  return data;
+}
+
+/*
+Map invaders.h, .g, .f and .e from directory and check each against its known
+CRC32, so a bad dump fails at startup instead of misbehaving in game.
+*/
+bool
+rom_set_open(rom_set *set, const char *directory)
+{
+  char path[PATH_MAX];
+
+  for (int i = 0; i < ROM_SET_FILES; i++)
+    {
+      set->data[i] = NULL;
+    }
+
+  for (int i = 0; i < ROM_SET_FILES; i++)
+    {
+      const rom_file *file = &invaders_set[i];
+
+      snprintf(path, sizeof(path), "%s/%s", directory, file->name);
+      set->data[i] = map_file(path);
+      if (set->data[i] == NULL)
+        {
+          rom_set_close(set);
+          return false;
+        }
+
+      uint32_t crc = rom_crc32(set->data[i], ROM_FILE_SIZE);
+      if (crc != file->crc32)
+        {
+          fprintf(stderr,
+                  "Error: %s has CRC32 %08X, expected %08X (bad dump?)\n",
+                  path, (unsigned int)crc, (unsigned int)file->crc32);
+          rom_set_close(set);
+          return false;
+        }
+    }
+  return true;
+}
+
+// Point the CPU's ROM pages at the mappings, call after cpu_map_invaders
+void
+rom_set_map(const rom_set *set, i8080 *cpu)
+{
+  for (int i = 0; i < ROM_SET_FILES; i++)
+    {
+      cpu_map_rom(cpu, invaders_set[i].address, set->data[i], ROM_FILE_SIZE);
+    }
+}
+
+void
+rom_set_close(rom_set *set)
+{
+  for (int i = 0; i < ROM_SET_FILES; i++)
+    {
+      if (set->data[i] != NULL)
+        {
+          munmap((void *)set->data[i], ROM_FILE_SIZE);
+          set->data[i] = NULL;
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef ROM_SET_H
+#define ROM_SET_H
+
+#include "emulator.h"
+
+// The standard split Space Invaders set: four 2 KB files
+#define ROM_SET_FILES 4
+#define ROM_FILE_SIZE 0x800 // NOLINT
+
+// One file of a set, where it sits in the address space and its checksum
+typedef struct
+{
+  const char *name;
+  uint16_t address;
+  uint32_t crc32;
+} rom_file;
+
+/*
+A ROM set mapped read-only with mmap. The CPU reads straight out of the
+mappings, so nothing is copied, and every emulator on the machine, in this
+process or another, shares the same page cache pages. The set must stay open
+for as long as a CPU it was mapped into runs.
+*/
+typedef struct
+{
+  const uint8_t *data[ROM_SET_FILES];
+} rom_set;
+
+uint32_t rom_crc32(const uint8_t *data, size_t size);
+bool rom_set_open(rom_set *set, const char *directory);
+void rom_set_map(const rom_set *set, i8080 *cpu);
+void rom_set_close(rom_set *set);
+
+#endif
@@ -1,11 +1,25 @@
+#include "audio.h"
 #include "emulator.h"
+#ifdef EMBED_ASSETS
+#include "embedded_assets.h"
+#endif
+#include "input.h"
+#include "latency.h"
+#include "movie.h"
+#include "netplay.h"
+#include "rom_set.h"
+#include "triple_buffer.h"
 #include <ctype.h>
+#include <getopt.h>
+#include <limits.h>
 
 #include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #define JOYSTICK_DEAD_ZONE 8000
 
@@ -19,232 +33,708 @@ char sound5_path[15] = "./sounds/4.wav";
 char sound6_path[15] = "./sounds/5.wav";
 char sound7_path[15] = "./sounds/6.wav";
 
-static SDL_Event e;
-bool has_event = false;
+static input_queue inputs;
+static SDL_atomic_t should_quit;
 
-static int speed = 1;
-static bool should_quit = false;
+// User event that wakes the main thread to present, and whether one is
+// already queued
+static Uint32 frame_event = (Uint32)-1;
+static SDL_atomic_t frame_pending;
+static void present_frame(void);
+
+// Set while Tab is held, read by the emulation thread
+static SDL_atomic_t turbo_held;
 bool colored_screen;
 
-void
-io_processor(i8080 *cpu) // NOLINT(readability-function-cognitive-complexity)
+// Translate an SDL event into port bit changes. Returns false for events that
+// do not touch the input ports.
+bool
+translate_event( // NOLINT(readability-function-cognitive-complexity)
+    const SDL_Event *e, input_event *input)
 {
+  memset(input, 0, sizeof(*input));
+  input->timestamp = e->common.timestamp;
 
-  has_event = SDL_PollEvent(&e) != 0;
-  if (has_event) // NOLINT
+  if (e->type == SDL_QUIT)
+    {
+      SDL_AtomicSet(&should_quit, 1);
+    }
+  else if (e->type == SDL_KEYDOWN)
     {
-      if (e.type == SDL_QUIT)
+      SDL_Scancode key = e->key.keysym.scancode;
+      if (key == SDL_SCANCODE_C) // C is for Coin
         {
-          should_quit = true;
-          exit(EXIT_SUCCESS);
+          input->port1_set |= 1 << 0; // NOLINT
         }
-      else if (e.type == SDL_KEYDOWN)
+      else if (key == SDL_SCANCODE_2) // P2 Start Button
         {
-          SDL_Scancode key = e.key.keysym.scancode;
-          if (key == SDL_SCANCODE_C) // C is for Coin
-            {
-              cpu->port1 |= 1 << 0; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_2) // P2 Start Button
-            {
-              cpu->port1 |= 1 << 1; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_RETURN) // P1 Start button
-            {
-              cpu->port1 |= 1 << 2; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_SPACE) // Shoot Button
-            {
-              cpu->port1 |= 1 << 4; // NOLINT
-              cpu->port2 |= 1 << 4; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_LEFT) // Left
-            {
-              cpu->port1 |= 1 << 5; // NOLINT
-              cpu->port2 |= 1 << 5; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_RIGHT) // Right
-            {
-              cpu->port1 |= 1 << 6; // NOLINT
-              cpu->port2 |= 1 << 6; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_T) // Tilt Screen
-            {
-              cpu->port2 |= 1 << 2; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_ESCAPE)
-            {
-              SDL_Event quit_event;
-              quit_event.type = SDL_QUIT;
-              SDL_PushEvent(&quit_event);
-            }
-          else if (key == SDL_SCANCODE_TAB) // Game speed
-            {
-              speed = 5; // NOLINT
-            }
+          input->port1_set |= 1 << 1; // NOLINT
         }
-      else if (e.type == SDL_KEYUP)
+      else if (key == SDL_SCANCODE_RETURN) // P1 Start button
         {
-          SDL_Scancode key = e.key.keysym.scancode;
-          if (key == SDL_SCANCODE_C) // Coin
-            {
-              cpu->port1 &= 0xFE; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_2) // P2 Start
-            {
-              cpu->port1 &= 0xFD; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_RETURN) // P1 Start
-            {
-              cpu->port1 &= 0xFB; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_SPACE) // Shoot button
-            {
-              cpu->port1 &= 0xEF; // NOLINT
-              cpu->port2 &= 0xEF; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_LEFT) // Left
-            {
-              cpu->port1 &= 0xDF; // NOLINT
-              cpu->port2 &= 0xDF; // NOLINT
-            }
-          else if (key == SDL_SCANCODE_RIGHT) // Right
+          input->port1_set |= 1 << 2; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_SPACE) // Shoot Button
+        {
+          input->port1_set |= 1 << 4; // NOLINT
+          input->port2_set |= 1 << 4; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_LEFT) // Left
+        {
+          input->port1_set |= 1 << 5; // NOLINT
+          input->port2_set |= 1 << 5; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_RIGHT) // Right
+        {
+          input->port1_set |= 1 << 6; // NOLINT
+          input->port2_set |= 1 << 6; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_T) // Tilt Screen
+        {
+          input->port2_set |= 1 << 2; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_ESCAPE)
+        {
+          SDL_Event quit_event;
+          quit_event.type = SDL_QUIT;
+          SDL_PushEvent(&quit_event);
+        }
+      else if (key == SDL_SCANCODE_TAB) // Turbo while held
+        {
+          SDL_AtomicSet(&turbo_held, 1);
+        }
+    }
+  else if (e->type == SDL_KEYUP)
+    {
+      SDL_Scancode key = e->key.keysym.scancode;
+      if (key == SDL_SCANCODE_C) // Coin
+        {
+          input->port1_clear |= 0x01; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_2) // P2 Start
+        {
+          input->port1_clear |= 0x02; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_RETURN) // P1 Start
+        {
+          input->port1_clear |= 0x04; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_SPACE) // Shoot button
+        {
+          input->port1_clear |= 0x10; // NOLINT
+          input->port2_clear |= 0x10; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_LEFT) // Left
+        {
+          input->port1_clear |= 0x20; // NOLINT
+          input->port2_clear |= 0x20; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_RIGHT) // Right
+        {
+          input->port1_clear |= 0x40; // NOLINT
+          input->port2_clear |= 0x40; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_T) // Tilt
+        {
+          input->port2_clear |= 0x04; // NOLINT
+        }
+      else if (key == SDL_SCANCODE_TAB) // Back to normal speed
+        {
+          SDL_AtomicSet(&turbo_held, 0);
+        }
+    }
+  else if (e->type == SDL_JOYAXISMOTION)
+    {
+      if (e->jaxis.axis == 0) // NOLINT
+        {
+          // left and right are mutually exclusive on the stick
+          input->port1_clear |= 0x60; // NOLINT
+          input->port2_clear |= 0x60; // NOLINT
+          if (e->jaxis.value < -JOYSTICK_DEAD_ZONE) // Left
             {
-              cpu->port1 &= 0xBF; // NOLINT
-              cpu->port2 &= 0xBF; // NOLINT
+              input->port1_set |= 1 << 5; // NOLINT
+              input->port2_set |= 1 << 5; // NOLINT
             }
-          else if (key == SDL_SCANCODE_T) // Tilt
+          else if (e->jaxis.value > JOYSTICK_DEAD_ZONE) // Right
             {
-              cpu->port2 &= 0xFB; // NOLINT
+              input->port1_set |= 1 << 6; // NOLINT
+              input->port2_set |= 1 << 6; // NOLINT
             }
-          else if (key == SDL_SCANCODE_TAB) // Change Speed
+        }
+    }
+  else if (e->type == SDL_JOYBUTTONDOWN)
+    {
+      if (e->jbutton.button == 1) // NOLINT // Coin
+        {
+          input->port1_set |= 1 << 0; // NOLINT
+        }
+      else if (e->jbutton.button == 0) // NOLINT // Shoot
+        {
+          input->port1_set |= 1 << 4; // NOLINT
+          input->port2_set |= 1 << 4; // NOLINT
+        }
+      else if (e->jbutton.button == 8) // NOLINT // Start
+        {
+          input->port1_set |= 1 << 2; // NOLINT
+        }
+      else if (e->jbutton.button == 9) // NOLINT // Select
+        {
+          input->port1_set |= 1 << 1; // NOLINT
+        }
+      else if (e->jbutton.button == 13) // NOLINT // Left
+        {
+          input->port1_set |= 1 << 5; // NOLINT
+          input->port2_set |= 1 << 5; // NOLINT
+        }
+      else if (e->jbutton.button == 14) // NOLINT // Right
+        {
+          input->port1_set |= 1 << 6; // NOLINT
+          input->port2_set |= 1 << 6; // NOLINT
+        }
+      else if (e->jbutton.button == 4) // NOLINT // Color or B/W toggle
+        {
+          colored_screen = !colored_screen;
+        }
+    }
+  else if (e->type == SDL_JOYBUTTONUP)
+    {
+      if (e->jbutton.button == 1) // NOLINT // coin
+        {
+          input->port1_clear |= 0x01; // NOLINT
+        }
+      else if (e->jbutton.button == 0) // NOLINT // shoot button
+        {
+          input->port1_clear |= 0x10; // NOLINT
+          input->port2_clear |= 0x10; // NOLINT
+        }
+      else if (e->jbutton.button == 8) // NOLINT // start
+        {
+          input->port1_clear |= 0x04; // NOLINT
+        }
+      else if (e->jbutton.button == 9) // NOLINT // select
+        {
+          input->port1_clear |= 0x02; // NOLINT
+        }
+      else if (e->jbutton.button == 13) // NOLINT // left
+        {
+          input->port1_clear |= 0x20; // NOLINT
+          input->port2_clear |= 0x20; // NOLINT
+        }
+      else if (e->jbutton.button == 14) // NOLINT // right
+        {
+          input->port1_clear |= 0x40; // NOLINT
+          input->port2_clear |= 0x40; // NOLINT
+        }
+    }
+
+  return !input_event_is_empty(input);
+}
+
+// Main thread: block until SDL has events, then drain the whole queue. Input
+// goes into the input ring so bursts never wait for the emulation thread, and
+// a newly published frame is presented once the input is through.
+void
+io_processor(void)
+{
+  SDL_Event e;
+  input_event input;
+  bool present = false;
+
+  if (SDL_WaitEvent(&e) == 0)
+    {
+      return;
+    }
+
+  do
+    {
+      if (e.type == frame_event)
+        {
+          present = true;
+        }
+      else if (translate_event(&e, &input))
+        {
+          // the emulation thread drains the ring every instruction, so a
+          // full ring only happens while it is stalled; wait rather than drop
+          // a key release
+          while (!input_queue_push(&inputs, &input))
             {
-              speed = 1;
+              SDL_Delay(1);
             }
         }
-      else if (e.type == SDL_JOYAXISMOTION)
+    }
+  while (SDL_PollEvent(&e) != 0);
+
+  if (present)
+    {
+      present_frame();
+    }
+}
+
+#define CLOCK_SPEED_MS 2000
+#define TICK (1000 * (1.0 / 60.0))
+
+// Upper limit for -r, each frame ahead costs one extra emulated frame
+#define MAX_RUNAHEAD 3
+
+// Frames emulated per presented frame while turbo is on, 0 is as many as fit
+// in a tick
+#define DEFAULT_TURBO 5
+
+// Upper limit for --render-hz
+#define MAX_RENDER_HZ 1000
+
+int run_cpu(i8080 *cpu, int cycles);
+int emulation_thread(void *data);
+int pflag = 0;
+int dflag = 0;
+int eflag = 0;
+int lflag = 0;
+int runahead = 0;
+int nflag = 0;
+int turbo_frames = DEFAULT_TURBO;
+int turbo_lock = 0;
+int no_audio = 0;
+int frameskip = 1;
+int render_hz = 0;
+static netplay_session netplay;
+static rom_set split_roms;
+static bool split_set = false;
+static uint16_t netplay_local_port = 0;
+static uint16_t netplay_peer_port = 0;
+static int netplay_player = 0;
+
+// Port images driven by the local player when the CPU ports are owned by a
+// netplay session
+static uint8_t pad_port1 = 0;
+static uint8_t pad_port2 = 0;
+static latency_tracker latency;
+
+// Input recorded with --record, written out on exit
+static const char *record_path = NULL;
+static input_movie recording;
+
+static triple_buffer frames;
+SDL_Window *window = NULL;
+SDL_Surface *screen_surface = NULL;
+SDL_Surface *buffer = NULL;
+
+// Cycle count and wall time (ms) at the start of the current and previous
+// frames, used to turn input timestamps into cycle positions
+static uint64_t frame_cycle = 0;
+static uint32_t frame_tick = 0;
+static uint32_t prev_frame_tick = 0;
+
+// Cycle at which an input event should become visible to the ROM. An event
+// that happened t ms into the previous frame is applied t ms into the current
+// one, which keeps the spacing between events (and short taps) intact.
+static uint64_t
+input_cycle(const input_event *input)
+{
+  if ((int32_t)(input->timestamp - prev_frame_tick) <= 0)
+    {
+      return frame_cycle;
+    }
+  return frame_cycle
+         + (uint64_t)(input->timestamp - prev_frame_tick) * CLOCK_SPEED_MS;
+}
+
+// Apply queued input changes whose cycle position has been reached
+static void
+apply_inputs(i8080 *cpu)
+{
+  input_event input;
+  while (input_queue_peek(&inputs, &input)
+         && input_cycle(&input) <= cpu->cycles)
+    {
+      uint8_t port1 = cpu->port1;
+      uint8_t port2 = cpu->port2;
+      input_apply(cpu, &input);
+      input_queue_pop(&inputs);
+      if (record_path != NULL)
         {
-          if (e.jaxis.axis == 0) // NOLINT
-            {
-              if (e.jaxis.value < -JOYSTICK_DEAD_ZONE) // Left
-                {
-                  cpu->port1 |= 1 << 5; // NOLINT
-                  cpu->port2 |= 1 << 5; // NOLINT
-                }
-              else if (e.jaxis.value > JOYSTICK_DEAD_ZONE) // Right
-                {
-                  cpu->port1 |= 1 << 6; // NOLINT
-                  cpu->port2 |= 1 << 6; // NOLINT
-                }
-              else
-                {
-                  cpu->port1 &= 0xDF; // NOLINT
-                  cpu->port2 &= 0xDF; // NOLINT
+          movie_record(&recording, cpu);
+        }
+      if (lflag)
+        {
+          latency_input(&latency, cpu, input.timestamp, port1 ^ cpu->port1,
+                        port2 ^ cpu->port2);
+        }
+    }
+}
 
-                  cpu->port1 &= 0xBF; // NOLINT
-                  cpu->port2 &= 0xBF; // NOLINT
-                }
+// Copy the finished frame's VRAM to the main thread
+static void
+publish_frame(i8080 *cpu, uint64_t frame)
+{
+  vram_frame *slot = triple_buffer_write_slot(&frames);
+  memcpy(slot->vram, &cpu->memory[VRAM_START], VRAM_SIZE);
+  slot->frame = frame;
+  triple_buffer_publish(&frames);
+
+  // one pending wakeup is enough, the reader always takes the newest frame
+  if (SDL_AtomicCAS(&frame_pending, 0, 1))
+    {
+      SDL_Event event;
+      SDL_zero(event);
+      event.type = frame_event;
+      SDL_PushEvent(&event);
+    }
+}
+
+/*
+Main thread: decode, scale and present the newest published frame. The window
+surface belongs to the thread that pumps events, and a resize frees it, so
+presentation stays here and the surface is fetched again every time. The
+triple buffer still keeps a slow present from holding up emulation.
+*/
+static void
+present_frame(void)
+{
+  // cleared first, so a frame published from here on queues a new wakeup
+  SDL_AtomicSet(&frame_pending, 0);
+
+  const vram_frame *latest = triple_buffer_acquire(&frames);
+  if (latest == NULL)
+    {
+      return;
+    }
+
+  screen_surface = SDL_GetWindowSurface(window);
+  if (screen_surface == NULL)
+    {
+      return;
+    }
+  draw_vram(latest->vram, buffer, screen_surface);
+  SDL_UpdateWindowSurface(window);
+  if (lflag)
+    {
+      latency_present(&latency, latest->frame, SDL_GetTicks());
+    }
+}
+
+// Show the frame the ROM would draw a few frames from now if the current
+// input is held, then rewind. This hides the ROM's own frames of input lag.
+static void
+run_ahead(i8080 *cpu, uint64_t frame)
+{
+  static i8080_state state;
+  uint8_t player_row_watch = cpu->player_row_watch;
+
+  // the latency probe follows the real timeline, not the guessed one
+  cpu_save_state(cpu, &state);
+  cpu->sound_muted = true;
+  cpu->player_row_watch = 0;
+  for (int i = 0; i < runahead; i++)
+    {
+      cpu_run_frame(cpu, NULL);
+    }
+  publish_frame(cpu, frame);
+  cpu_load_state(cpu, &state);
+  cpu->sound_muted = false;
+  cpu->player_row_watch = player_row_watch;
+  cpu_sync_sound(cpu);
+}
+
+// Netplay frames are driven by per-frame input, so the ring is drained into
+// the local pad instead of being applied at cycle positions
+static bool
+netplay_frame(i8080 *cpu)
+{
+  input_event input;
+  while (input_queue_peek(&inputs, &input))
+    {
+      input_apply_ports(&pad_port1, &pad_port2, &input);
+      input_queue_pop(&inputs);
+    }
+
+  bool was_desynced = netplay.desynced;
+  netplay_input local
+      = netplay_local_input(netplay_player, pad_port1, pad_port2);
+  bool advanced = netplay_advance(&netplay, cpu, local);
+  if (netplay.desynced && !was_desynced)
+    {
+      fprintf(stderr, "Netplay desync detected after frame %u\n",
+              netplay.desync_frame);
+    }
+  return advanced;
+}
+
+// Run both halves of a frame and their interrupts. Frames that will never be
+// shown (turbo) are silent, so sound effects are not stacked up N times over.
+static void
+emulate_frame(i8080 *cpu, uint64_t frame, bool shown)
+{
+  cpu->sound_muted = !shown;
+  cpu_run_frame(cpu, run_cpu);
+  cpu->sound_muted = false;
+  cpu_sync_sound(cpu);
+  if (lflag)
+    {
+      latency_frame(&latency, cpu, frame, frame_cycle, frame_tick,
+                    SDL_GetTicks());
+    }
+}
+
+// Whether turbo should emulate another hidden frame before the shown one.
+// Uncapped turbo keeps going until the next tick is due.
+static bool
+turbo_wants_frame(int hidden)
+{
+  if (turbo_frames == 0)
+    {
+      return SDL_GetTicks() - frame_tick < TICK;
+    }
+  return hidden < turbo_frames - 1;
+}
+
+/*
+Whether the frame just emulated should be drawn and presented. --frameskip N
+keeps every Nth frame, --render-hz caps presents to a wall-clock rate; the
+CPU and its interrupts run every frame either way.
+*/
+static bool
+present_due(void)
+{
+  static int skipped = 0;
+  static double next_present = 0;
+
+  if (++skipped < frameskip)
+    {
+      return false;
+    }
+  skipped = 0;
+
+  if (render_hz > 0)
+    {
+      double now = SDL_GetTicks();
+      if (now < next_present)
+        {
+          return false;
+        }
+      // step from the last due time so the average rate is exact, but do not
+      // try to catch up after a stall
+      next_present += 1000.0 / render_hz; // NOLINT
+      if (next_present < now)
+        {
+          next_present = now + 1000.0 / render_hz; // NOLINT
+        }
+    }
+  return true;
+}
+
+int
+emulation_thread(void *data)
+{
+  i8080 *cpu = data;
+
+  // start timer
+  uint64_t last_tick = SDL_GetTicks();
+  frame_tick = last_tick;
+
+  uint64_t frame = 0;
+
+  while (!SDL_AtomicGet(&should_quit))
+    {
+      if ((SDL_GetTicks() - last_tick) > TICK) // NOLINT
+        {
+          if (pflag)
+            {
+              printf("Current Tick: %d\n", SDL_GetTicks());
             }
-          else if (e.type == SDL_JOYBUTTONDOWN)
+
+          prev_frame_tick = frame_tick;
+          frame_tick = SDL_GetTicks();
+          frame_cycle = cpu->cycles;
+
+          if (nflag)
             {
-              if (e.jbutton.button == 1) // NOLINT // Coin
-                {
-                  cpu->port1 |= 1 << 0; // NOLINT
-                }
-              else if (e.jbutton.button == 0) // NOLINT // Shoot
-                {
-                  cpu->port1 |= 1 << 4; // NOLINT
-                  cpu->port2 |= 1 << 4; // NOLINT
-                }
-              else if (e.jbutton.button == 8) // NOLINT // Start
-                {
-                  cpu->port1 |= 1 << 2; // NOLINT
-                }
-              else if (e.jbutton.button == 9) // NOLINT // Select
-                {
-                  cpu->port1 |= 1 << 1; // NOLINT
-                }
-              else if (e.jbutton.button == 13) // NOLINT // Left
-                {
-                  cpu->port1 |= 1 << 5; // NOLINT
-                  cpu->port2 |= 1 << 5; // NOLINT
-                }
-              else if (e.jbutton.button == 14) // NOLINT // Right
-                {
-                  cpu->port1 |= 1 << 6; // NOLINT
-                  cpu->port2 |= 1 << 6; // NOLINT
-                }
-              else if (e.jbutton.button == 4) // NOLINT // Color or B/W toggle
+              if (netplay_frame(cpu))
                 {
-                  colored_screen = cpu->colored_screen;
-                  colored_screen = !colored_screen;
+                  frame++;
+                  if (present_due())
+                    {
+                      publish_frame(cpu, frame);
+                    }
                 }
+              last_tick = SDL_GetTicks();
+              continue;
             }
-          else if (e.type == SDL_JOYBUTTONUP)
+
+          // in turbo, emulate the frames that will not be shown first
+          if (turbo_lock || SDL_AtomicGet(&turbo_held))
             {
-              if (e.jbutton.button == 1) // NOLINT // coin
-                {
-                  cpu->port1 &= 0xFE; // NOLINT
-                }
-              else if (e.jbutton.button == 0) // NOLINT // shoot button
+              for (int hidden = 0; turbo_wants_frame(hidden); hidden++)
                 {
-                  cpu->port1 &= 0xEF; // NOLINT
-                  cpu->port2 &= 0xEF; // NOLINT
+                  frame++;
+                  emulate_frame(cpu, frame, false);
                 }
-              else if (e.jbutton.button == 8) // NOLINT // start
-                {
-                  cpu->port1 &= 0xFB; // NOLINT
-                }
-              else if (e.jbutton.button == 9) // NOLINT // select
-                {
-                  cpu->port1 &= 0xFD; // NOLINT
-                }
-              else if (e.jbutton.button == 13) // NOLINT // left
+            }
+
+          frame++;
+          emulate_frame(cpu, frame, true);
+
+          // a skipped frame is still emulated and heard, just not drawn
+          if (present_due())
+            {
+              if (runahead > 0)
                 {
-                  cpu->port1 &= 0xDF; // NOLINT
-                  cpu->port2 &= 0xDF; // NOLINT
+                  run_ahead(cpu, frame);
                 }
-              else if (e.jbutton.button == 14) // NOLINT // right
+              else
                 {
-                  cpu->port1 &= 0xBF; // NOLINT
-                  cpu->port2 &= 0xBF; // NOLINT
+                  publish_frame(cpu, frame);
                 }
             }
+
+          // Check for exit conditions
+          last_tick = SDL_GetTicks();
+        }
+      else
+        {
+          // give the core back to the input thread until the next tick
+          SDL_Delay(1);
         }
     }
 
-  // update
-  has_event = false;
+  return 0;
 }
 
-#define CLOCK_SPEED_MS 2000
-#define TICK (1000 * (1.0 / 60.0))
-#define CYCLES_PER_TICK (CLOCK_SPEED_MS * TICK)
+// Parse a whole decimal number in [min, max]
+static bool
+parse_count(const char *arg, int min, int max, int *value)
+{
+  char *end = NULL;
+  long parsed = strtol(arg, &end, 10); // NOLINT
 
-int run_cpu(i8080 *cpu, int cycles);
-int pflag = 0;
-int dflag = 0;
-SDL_Window *window = NULL;
-SDL_Surface *screen_surface = NULL;
-SDL_Surface *buffer = NULL;
+  if (*arg == '\0' || *end != '\0' || parsed < min || parsed > max)
+    {
+      return false;
+    }
+  *value = (int)parsed;
+  return true;
+}
+
+/*
+Load the ROM named on the command line, or the one compiled into an embedded
+build when none is given. A directory is taken to hold the split set, which
+is only mapped here and gets served in place once the board is mapped.
+*/
+static bool
+load_rom(i8080 *cpu, const char *rom_path, uint16_t address)
+{
+  struct stat info;
+
+#ifdef EMBED_ASSETS
+  if (rom_path == NULL)
+    {
+      return cpu_load_rom(cpu, embedded_rom, embedded_rom_size, address);
+    }
+#endif
+  if (stat(rom_path, &info) == 0 && S_ISDIR(info.st_mode))
+    {
+      split_set = rom_set_open(&split_roms, rom_path);
+      return split_set;
+    }
+  return cpu_load_file(cpu, rom_path, address);
+}
 
 int
 main(int argc, char *argv[])
 {
   int opt;
-
-  while ((opt = getopt(argc, argv, "pd")) != -1)
+  static const struct option long_options[]
+      = { { "turbo", required_argument, NULL, 'T' },
+          { "turbo-lock", no_argument, NULL, 'L' },
+          { "frameskip", required_argument, NULL, 'F' },
+          { "render-hz", required_argument, NULL, 'H' },
+          { "no-audio", no_argument, NULL, 'A' },
+          { "record", required_argument, NULL, 'R' },
+          { NULL, 0, NULL, 0 } };
+
+  while ((opt = getopt_long(argc, argv, "pdelr:n:", long_options, NULL))
+         != -1)
     {
       switch (opt)
         {
+        case 'T':
+          if (!parse_count(optarg, 0, INT_MAX, &turbo_frames))
+            {
+              fprintf(stderr, "Turbo takes a number of frames per shown "
+                              "frame, 0 for uncapped.\n");
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case 'F':
+          if (!parse_count(optarg, 1, INT_MAX, &frameskip))
+            {
+              fprintf(stderr, "Frameskip takes N >= 1 to draw every Nth "
+                              "frame.\n");
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case 'H':
+          if (!parse_count(optarg, 1, MAX_RENDER_HZ, &render_hz))
+            {
+              fprintf(stderr, "Render rate must be between 1 and %d Hz.\n",
+                      MAX_RENDER_HZ);
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case 'L':
+          turbo_lock = 1;
+          break;
+        case 'A':
+          no_audio = 1;
+          break;
+        case 'R':
+          record_path = optarg;
+          break;
         case 'p':
           pflag = 1;
           break;
         case 'd':
           dflag = 1;
           break;
+        case 'e':
+          eflag = 1;
+          break;
+        case 'l':
+          lflag = 1;
+          latency_init(&latency);
+          break;
+        case 'r':
+          if (!parse_count(optarg, 0, MAX_RUNAHEAD, &runahead))
+            {
+              fprintf(stderr, "Run-ahead must be between 0 and %d frames.\n",
+                      MAX_RUNAHEAD);
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case 'n':
+          {
+            unsigned int local_port = 0;
+            unsigned int peer_port = 0;
+            if (sscanf(optarg, "%u:%u:%d", &local_port, &peer_port,
+                       &netplay_player)
+                    != 3
+                || local_port > UINT16_MAX || peer_port > UINT16_MAX
+                || (netplay_player != 1 && netplay_player != 2))
+              {
+                fprintf(stderr, "Netplay takes local_port:peer_port:player "
+                                "with player 1 or 2.\n");
+                exit(EXIT_FAILURE);
+              }
+            netplay_local_port = (uint16_t)local_port;
+            netplay_peer_port = (uint16_t)peer_port;
+            nflag = 1;
+            break;
+          }
         case '?':
-          if (isprint(optopt))
+          if (optopt == 0)
+            {
+              fprintf(stderr, "Unknown option '%s'.\n", argv[optind - 1]);
+            }
+          else if (isprint(optopt))
             {
               fprintf(stderr, "Unknown option '-%c'.\n", optopt);
             }
@@ -258,16 +748,33 @@ main(int argc, char *argv[])
         }
     }
 
-  // Only accept one non-option argument
+  if (nflag && runahead > 0)
+    {
+      fprintf(stderr, "Run-ahead cannot be combined with netplay.\n");
+      exit(EXIT_FAILURE);
+    }
+  if (nflag && record_path != NULL)
+    {
+      fprintf(stderr, "Netplay input cannot be recorded.\n");
+      exit(EXIT_FAILURE);
+    }
+
+  // Only accept one non-option argument, which an embedded build can also do
+  // without
+#ifdef EMBED_ASSETS
+  if ((argc - optind) > 1)
+#else
   if ((argc - optind) != 1)
+#endif
     {
       fprintf(stderr, "Invalid number of arguments. Program only takes "
                       "one non-option argument (rom_filepath).\n");
       exit(EXIT_FAILURE);
     }
+  const char *rom_path = optind < argc ? argv[optind] : NULL;
   // Initialize SDL
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_JOYSTICK
-               | SDL_INIT_EVENTS | SDL_INIT_AUDIO)
+               | SDL_INIT_EVENTS | (no_audio ? 0 : SDL_INIT_AUDIO))
       < 0)
     {
       fprintf(stderr, "SDL could not initialize! SDL_Error: %s\n",
@@ -276,11 +783,13 @@ main(int argc, char *argv[])
     }
   else
     {
-      if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0)
+      // sound is optional, the game carries on silently without a device.
+      // With --no-audio nothing is opened and no sample is ever decoded.
+      if (!no_audio)
         {
-          fprintf(stderr, "SDL mixer could not initialize!");
-          exit(EXIT_FAILURE);
+          audio_open();
         }
+
       // Create window
       window = SDL_CreateWindow("Space Invaders Emulator",
                                 SDL_WINDOWPOS_UNDEFINED,
@@ -308,18 +817,26 @@ main(int argc, char *argv[])
   uint16_t load_address = 0x0000;
 
   // Load ROM into memory
-  if (!cpu_load_file(&cpu, argv[optind], load_address))
+  if (!load_rom(&cpu, rom_path, load_address))
     {
       fprintf(stderr, "Failed to load ROM\n");
       exit(EXIT_FAILURE);
     }
+  cpu_map_invaders(&cpu);
+  if (split_set)
+    {
+      rom_set_map(&split_roms, &cpu);
+    }
 
-  // start timer
-  uint64_t last_tick = SDL_GetTicks();
+  // tracing wants to see every instruction on its own
+  if (!pflag && !dflag)
+    {
+      cpu_fuse_rom(&cpu);
+    }
 
-  // set initial offset value
-  int cycle_offset = 0;
-  int num_cycles = CYCLES_PER_TICK / 2;
+  // flags are only worked out when something reads them, unless -e asks
+  // for every instruction to compute them as it goes
+  cpu_set_lazy_flags(&cpu, !eflag);
 
   // The surface contained by the window
 
@@ -337,47 +854,59 @@ main(int argc, char *argv[])
         }
     }
 
-  while (true)
+  if (nflag
+      && !netplay_open(&netplay, netplay_local_port, netplay_peer_port,
+                       netplay_player))
     {
-      if ((SDL_GetTicks() - last_tick) > TICK) // NOLINT
-        {
-          if (pflag)
-            {
-              printf("Current Tick: %d\n", SDL_GetTicks());
-            }
-
-          // run first half of tick cycles
-          cycle_offset = run_cpu(&cpu, num_cycles - abs(cycle_offset));
-
-          // first interrupt
-          handle_interrupt(&cpu, 0x01);
-
-          // run second half of tick cycles
-          cycle_offset = run_cpu(&cpu, num_cycles - abs(cycle_offset));
-          io_processor(&cpu);
-
-          // second interrupt
-          handle_interrupt(&cpu, 0x02);
-
-          // set number of cycles for next tick
-          num_cycles = CYCLES_PER_TICK / 2 - cycle_offset;
+      exit(EXIT_FAILURE);
+    }
 
-          // Update system state for display, input, and sound
-          io_processor(&cpu);
-          update_graphics(&cpu, buffer, screen_surface);
-          SDL_UpdateWindowSurface(window);
+  // SDL only delivers events to the thread that created the window, so the
+  // main thread handles input and presents, and the CPU gets its own thread
+  input_queue_init(&inputs);
+  triple_buffer_init(&frames);
+  frame_event = SDL_RegisterEvents(1);
+  SDL_AtomicSet(&frame_pending, 0);
+  SDL_AtomicSet(&should_quit, 0);
+  SDL_Thread *emulation
+      = frame_event == (Uint32)-1
+            ? NULL
+            : SDL_CreateThread(emulation_thread, "emulation", &cpu);
+  if (emulation == NULL)
+    {
+      fprintf(stderr, "Emulation thread could not be created! SDL_Error: %s\n",
+              SDL_GetError());
+      exit(EXIT_FAILURE);
+    }
 
-          // Check for exit conditions
-          last_tick = SDL_GetTicks();
-        }
+  while (!SDL_AtomicGet(&should_quit))
+    {
+      io_processor();
     }
 
-  // Destroy window
-  for (int i = 0; i < NUM_SOUNDS; i++)
+  SDL_WaitThread(emulation, NULL);
+  if (joystick)
+    {
+      SDL_JoystickClose(joystick);
+    }
+  if (lflag)
+    {
+      latency_report(&latency, stdout);
+    }
+  if (nflag)
     {
-      Mix_FreeChunk(cpu.sounds[i]);
+      netplay_report(&netplay, stdout);
+      netplay_close(&netplay);
     }
-  Mix_CloseAudio();
+  if (record_path != NULL)
+    {
+      movie_save(&recording, record_path);
+      movie_free(&recording);
+    }
+
+  // Destroy window
+  audio_close();
+  rom_set_close(&split_roms);
   SDL_DestroyWindow(window);
   // Quit SDL subsystems
   SDL_Quit();
@@ -390,6 +919,8 @@ run_cpu(i8080 *cpu, int cycles)
   // fetch and execute next instruction
   while (cycles > 0)
     {
+      apply_inputs(cpu);
+
       uint8_t next_instruction = cpu_read_mem(cpu, cpu->pc);
       if (pflag)
         {
@@ -399,11 +930,11 @@ run_cpu(i8080 *cpu, int cycles)
         {
           printf("PRE-INSTRUCTION  ");
           print_state(cpu);
-          print_flags(cpu->flags);
+          print_flags(cpu_flags(cpu));
           printf("\n");
         }
 
-      int num_cycles_used = execute_instruction(cpu, next_instruction);
+      int num_cycles_used = cpu_step(cpu, cycles);
 
       // execute instruction failed
       if (num_cycles_used < 0)
@@ -415,12 +946,13 @@ run_cpu(i8080 *cpu, int cycles)
       else
         {
           cycles -= num_cycles_used;
+          cpu->cycles += num_cycles_used;
         }
       if (dflag)
         {
           printf("POST-INSTRUCTION ");
           print_state(cpu);
-          print_flags(cpu->flags);
+          print_flags(cpu_flags(cpu));
           printf("\n");
         }
     }
@@ -0,0 +1,150 @@
+#include "sound_cache.h"
+#include <string.h>
+
+#ifdef EMBED_ASSETS
+
+#include "embedded_assets.h"
+
+// Decoded at build time, there is nothing to load or free
+const audio_sample *
+sound_get(enum audio_sound sound)
+{
+  if (embedded_sounds[sound].length == 0)
+    {
+      return NULL;
+    }
+  return &embedded_sounds[sound];
+}
+
+void
+sound_cache_preload(void)
+{
+}
+
+void
+sound_cache_free(void)
+{
+}
+
+#else
+
+// Slot states, a slot only ever moves forward until the cache is freed
+enum
+{
+  SOUND_UNLOADED,
+  SOUND_LOADING,
+  SOUND_READY,
+  SOUND_MISSING
+};
+
+static const char *const sound_files[NUM_SOUNDS] = {
+  "sounds/8.wav", "sounds/1.wav", "sounds/2.wav",
+  "sounds/3.wav", "sounds/4.wav", "sounds/5.wav",
+  "sounds/6.wav", "sounds/7.wav", "sounds/0.wav",
+};
+
+static audio_sample samples[NUM_SOUNDS];
+static SDL_atomic_t states[NUM_SOUNDS];
+
+// Decode a WAV file and convert it to the output format
+static bool
+load_sample(const char *path, audio_sample *sample)
+{
+  SDL_AudioSpec spec;
+  Uint8 *wav = NULL;
+  Uint32 length = 0;
+  SDL_AudioCVT cvt;
+
+  if (SDL_LoadWAV(path, &spec, &wav, &length) == NULL)
+    {
+      fprintf(stderr, "Failed to load sound file %s\n", path);
+      return false;
+    }
+  if (SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq,
+                        AUDIO_S16SYS, 1, AUDIO_RATE)
+      < 0)
+    {
+      fprintf(stderr, "Cannot convert sound file %s\n", path);
+      SDL_FreeWAV(wav);
+      return false;
+    }
+
+  cvt.len = (int)length;
+  cvt.buf = SDL_malloc((size_t)length * cvt.len_mult);
+  if (cvt.buf == NULL)
+    {
+      SDL_FreeWAV(wav);
+      return false;
+    }
+  memcpy(cvt.buf, wav, length);
+  SDL_FreeWAV(wav);
+
+  if (SDL_ConvertAudio(&cvt) < 0)
+    {
+      fprintf(stderr, "Cannot convert sound file %s\n", path);
+      SDL_free(cvt.buf);
+      return false;
+    }
+  sample->data = (int16_t *)cvt.buf;
+  sample->length = (uint32_t)cvt.len_cvt / sizeof(int16_t);
+  return true;
+}
+
+/*
+Returns the decoded sample, or NULL if it could not be loaded. The first
+caller decodes it; anyone asking while that is in progress gets NULL rather
+than waiting, which costs at most one dropped trigger and never blocks the
+emulation thread. A sound that failed to load is not retried.
+*/
+const audio_sample *
+sound_get(enum audio_sound sound)
+{
+  SDL_atomic_t *state = &states[sound];
+
+  if (SDL_AtomicGet(state) == SOUND_READY)
+    {
+      // pairs with the release below, the sample is filled in by now
+      SDL_MemoryBarrierAcquire();
+      return &samples[sound];
+    }
+  if (!SDL_AtomicCAS(state, SOUND_UNLOADED, SOUND_LOADING))
+    {
+      return NULL;
+    }
+
+  if (!load_sample(sound_files[sound], &samples[sound]))
+    {
+      SDL_AtomicSet(state, SOUND_MISSING);
+      return NULL;
+    }
+
+  // make the sample visible before publishing it
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(state, SOUND_READY);
+  return &samples[sound];
+}
+
+// Decode every sound now, so that sound_get never touches a file later
+void
+sound_cache_preload(void)
+{
+  for (int sound = 0; sound < NUM_SOUNDS; sound++)
+    {
+      sound_get(sound);
+    }
+}
+
+// Only safe once nothing can be playing a cached sample any more
+void
+sound_cache_free(void)
+{
+  for (int sound = 0; sound < NUM_SOUNDS; sound++)
+    {
+      SDL_free((void *)samples[sound].data);
+      samples[sound].data = NULL;
+      samples[sound].length = 0;
+      SDL_AtomicSet(&states[sound], SOUND_UNLOADED);
+    }
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef SOUND_CACHE_H
+#define SOUND_CACHE_H
+
+#include "audio.h"
+
+/*
+Process-wide cache of decoded sound samples, shared by every caller, so
+creating a CPU (or a pool of them) costs no file I/O. The audio device
+preloads every sound when it opens, before the emulation thread can trigger
+one; anything else (tools, tests) decodes each sound the first time it asks.
+*/
+const audio_sample *sound_get(enum audio_sound sound);
+void sound_cache_preload(void);
+void sound_cache_free(void);
+
+#endif
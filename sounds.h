@@ -1,9 +0,0 @@
-#ifndef SOUNDS_H
-#define SOUNDS_H
-
-#include <SDL2/SDL_mixer.h>
-
-extern Mix_Chunk *sound1;
-extern Mix_Chunk *sound2;
-
-#endif
\ No newline at end of file
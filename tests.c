@@ -1,9 +1,19 @@
+#include "audio.h"
 #include "emulator.h"
+#include "input.h"
+#include "movie.h"
+#include "rom_set.h"
+#include "sound_cache.h"
+#include "triple_buffer.h"
 #include <CUnit/Basic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 /* Open any necessary files for test suite here */
 int
@@ -1521,7 +1531,8 @@ test_opcode_0xe6(void)
   CU_ASSERT((cpu.flags & FLAG_S) == 0);
   CU_ASSERT((cpu.flags & FLAG_P) == 0);
   CU_ASSERT((cpu.flags & FLAG_CY) == 0);
-  CU_ASSERT((cpu.flags & FLAG_AC) == 0);
+  // bit 3 is set in A, and the 8080 sets AC from the OR of the bit 3s
+  CU_ASSERT((cpu.flags & FLAG_AC) == FLAG_AC);
 
   cpu.a = 0;
   cpu_write_mem(&cpu, 0x0001, 0x00);
@@ -1625,7 +1636,7 @@ test_opcode_0xa7(void) // NOLINT
 
   cpu.a = 85; // NOLINT
   // S and CY flag set.
-  cpu.flags = 0x88; // NOLINT
+  cpu.flags = FLAG_S | FLAG_CY;
 
   int code_found = execute_instruction(&cpu, 0xa7); // NOLINT
 
@@ -1692,16 +1703,22 @@ test_opcode_0xf1(void) // NOLINT
   cpu_init(&cpu);
 
   cpu.sp = 0xCBDE;                       // NOLINT
-  cpu_write_mem(&cpu, cpu.sp, 0xA8);     // NOLINT
+  cpu_write_mem(&cpu, cpu.sp, 0x93);     // NOLINT S AC CY and bit 1
   cpu_write_mem(&cpu, cpu.sp + 1, 0xDE); // NOLINT
-  cpu.flags = 0x50;                      // NOLINT
-  cpu.a = 0x19;                          // NOLINT
+  cpu.flags = FLAG_Z | FLAG_P;
+  cpu.a = 0x19; // NOLINT
 
   int code_found = execute_instruction(&cpu, 0xf1); // NOLINT
 
   CU_ASSERT(code_found >= 0);
-  CU_ASSERT_EQUAL(cpu.flags, 0xA8); // NOLINT
-  CU_ASSERT_EQUAL(cpu.a, 0xDE);     // NOLINT
+  CU_ASSERT_EQUAL(cpu.flags, FLAG_S | FLAG_AC | FLAG_CY);
+  CU_ASSERT_EQUAL(cpu.a, 0xDE); // NOLINT
+
+  // the fixed bits of a popped byte are not flags
+  cpu.sp = 0xCBDE;                   // NOLINT
+  cpu_write_mem(&cpu, cpu.sp, 0xFF); // NOLINT
+  execute_instruction(&cpu, 0xf1);   // NOLINT
+  CU_ASSERT_EQUAL(cpu.flags, FLAGS_ALL);
 
   cpu_write_mem(&cpu, 0xCBDE, 0x00); // NOLINT
   cpu_write_mem(&cpu, 0xCBDF, 0x00); // NOLINT
@@ -2775,7 +2792,8 @@ test_opcode_0xf5(void) // NOLINT
   CU_ASSERT(1 == cpu.pc);
   CU_ASSERT(0x4442 == cpu.sp); // NOLINT
   CU_ASSERT(cpu.a == cpu_read_mem(&cpu, cpu.sp + 1));
-  CU_ASSERT(cpu.flags == cpu_read_mem(&cpu, cpu.sp));
+  // the 8080's layout, S Z 0 AC 0 P 1 CY
+  CU_ASSERT(cpu_read_mem(&cpu, cpu.sp) == 0x07); // NOLINT
 
   // cleanup
   cpu_write_mem(&cpu, cpu.sp, 0x00);     // NOLINT
@@ -3110,7 +3128,8 @@ test_opcode_0xfe(void) // NOLINT
   CU_ASSERT((cpu.flags & FLAG_P) == 0);
   CU_ASSERT((cpu.flags & FLAG_S) == 0);
   CU_ASSERT((cpu.flags & FLAG_Z) == 0);
-  CU_ASSERT((cpu.flags & FLAG_AC) == 0);
+  // 1 + ~0 + 1 carries out of bit 3, so no borrow from the low nibble
+  CU_ASSERT((cpu.flags & FLAG_AC) == FLAG_AC);
   CU_ASSERT((cpu.flags & FLAG_CY) == 0);
 
   // clean up
@@ -3371,10 +3390,1610 @@ test_handle_interrupt_interrupts_disabled(void) // NOLINT
   CU_ASSERT(cpu.sp == 0xFFFF); // NOLINT
 }
 
+void
+test_input_queue_order(void) // NOLINT
+{
+  input_queue queue;
+  input_queue_init(&queue);
+
+  input_event event = { 0 };
+  input_event out;
+  CU_ASSERT(input_queue_peek(&queue, &out) == false);
+
+  for (int i = 0; i < 3; i++)
+    {
+      event.timestamp = i;
+      event.port1_set = 1 << i;
+      CU_ASSERT(input_queue_push(&queue, &event));
+    }
+
+  // events come back out in the order they were pushed
+  for (int i = 0; i < 3; i++)
+    {
+      CU_ASSERT(input_queue_peek(&queue, &out));
+      CU_ASSERT(out.timestamp == (uint32_t)i);
+      CU_ASSERT(out.port1_set == (1 << i));
+      input_queue_pop(&queue);
+    }
+  CU_ASSERT(input_queue_peek(&queue, &out) == false);
+}
+
+void
+test_input_queue_full(void) // NOLINT
+{
+  input_queue queue;
+  input_queue_init(&queue);
+
+  input_event event = { 0 };
+  input_event out;
+  for (int i = 0; i < INPUT_QUEUE_SIZE; i++)
+    {
+      CU_ASSERT(input_queue_push(&queue, &event));
+    }
+  CU_ASSERT(input_queue_push(&queue, &event) == false);
+
+  // freeing one slot makes room for exactly one more event
+  CU_ASSERT(input_queue_peek(&queue, &out));
+  input_queue_pop(&queue);
+  CU_ASSERT(input_queue_push(&queue, &event));
+  CU_ASSERT(input_queue_push(&queue, &event) == false);
+}
+
+void
+test_input_apply(void) // NOLINT
+{
+  i8080 cpu;
+  cpu_init(&cpu);
+  cpu.port1 = 0x01; // NOLINT
+  cpu.port2 = 0x60; // NOLINT
+
+  input_event event = { 0 };
+  event.port1_set = 0x10;   // NOLINT
+  event.port2_clear = 0x60; // NOLINT
+  event.port2_set = 0x20;   // NOLINT
+  input_apply(&cpu, &event);
+
+  CU_ASSERT(cpu.port1 == 0x11); // NOLINT
+  CU_ASSERT(cpu.port2 == 0x20); // NOLINT
+}
+
+void
+test_port_read_tracking(void) // NOLINT
+{
+  i8080 cpu;
+  cpu_init(&cpu);
+  cpu.port1 = 0x08; // NOLINT
+
+  // IN 1
+  cpu_write_mem(&cpu, 0x0001, 0x01);            // NOLINT
+  int cycles = execute_instruction(&cpu, 0xdb); // NOLINT
+
+  CU_ASSERT(cycles == 10);  // NOLINT
+  CU_ASSERT(cpu.a == 0x08); // NOLINT
+  CU_ASSERT(cpu.ports_read == (1 << 1));
+  CU_ASSERT(cpu.port_read_cycle[1] == 0);
+
+  // IN 3 reads the shift register and is not tracked
+  cpu.pc = 0;
+  cpu.cycles = 100;                  // NOLINT
+  cpu_write_mem(&cpu, 0x0001, 0x03); // NOLINT
+  execute_instruction(&cpu, 0xdb);   // NOLINT
+  CU_ASSERT(cpu.ports_read == (1 << 1));
+
+  // only the first read since the bit was cleared is timed
+  cpu.pc = 0;
+  cpu_write_mem(&cpu, 0x0001, 0x01); // NOLINT
+  execute_instruction(&cpu, 0xdb);   // NOLINT
+  CU_ASSERT(cpu.port_read_cycle[1] == 0);
+  cpu.ports_read = 0;
+  cpu.pc = 0;
+  execute_instruction(&cpu, 0xdb); // NOLINT
+  CU_ASSERT(cpu.port_read_cycle[1] == 100);
+}
+
+void
+test_player_row_watch(void) // NOLINT
+{
+  static i8080 cpu;
+  uint16_t player = VRAM_START + 10 * VRAM_COLUMN_BYTES + PLAYER_ROW;
+  cpu_init(&cpu);
+  cpu_map_invaders(&cpu);
+  cpu.player_row_watch = 1 << 1;
+  cpu.cycles = 50; // NOLINT
+
+  // nothing counts until the watched port has been read
+  cpu_write_mem(&cpu, player, 0xFF); // NOLINT
+  CU_ASSERT(cpu.player_row_watch == (1 << 1));
+  cpu.ports_read = 1 << 1;
+
+  // nor do writes elsewhere, or ones that leave the row as it was
+  cpu_write_mem(&cpu, player + 1, 0xFF); // NOLINT
+  cpu_write_mem(&cpu, player, 0xFF);     // NOLINT
+  CU_ASSERT(cpu.player_row_watch == (1 << 1));
+
+  // the first change to the row is stamped and ends the watch
+  cpu.cycles = 70;                   // NOLINT
+  cpu_write_mem(&cpu, player, 0x0F); // NOLINT
+  CU_ASSERT(cpu.player_row_watch == 0);
+  CU_ASSERT(cpu.player_write_cycle == 70);
+  cpu.cycles = 90;                   // NOLINT
+  cpu_write_mem(&cpu, player, 0xF0); // NOLINT
+  CU_ASSERT(cpu.player_write_cycle == 70);
+}
+
+void
+test_triple_buffer_latest(void) // NOLINT
+{
+  static triple_buffer frames;
+  triple_buffer_init(&frames);
+  CU_ASSERT(triple_buffer_acquire(&frames) == NULL);
+
+  // the reader skips straight to the newest of several published frames
+  for (uint64_t frame = 1; frame <= 3; frame++)
+    {
+      vram_frame *slot = triple_buffer_write_slot(&frames);
+      slot->frame = frame;
+      slot->vram[0] = (uint8_t)frame;
+      triple_buffer_publish(&frames);
+    }
+
+  const vram_frame *latest = triple_buffer_acquire(&frames);
+  CU_ASSERT(latest != NULL);
+  CU_ASSERT(latest->frame == 3);
+  CU_ASSERT(latest->vram[0] == 3);
+  CU_ASSERT(triple_buffer_acquire(&frames) == NULL);
+}
+
+void
+test_triple_buffer_slots_disjoint(void) // NOLINT
+{
+  static triple_buffer frames;
+  triple_buffer_init(&frames);
+
+  vram_frame *slot = triple_buffer_write_slot(&frames);
+  slot->frame = 1;
+  triple_buffer_publish(&frames);
+  const vram_frame *latest = triple_buffer_acquire(&frames);
+
+  // the writer never gets the slot the reader is holding
+  for (int i = 0; i < 4; i++)
+    {
+      CU_ASSERT(triple_buffer_write_slot(&frames) != latest);
+      triple_buffer_publish(&frames);
+    }
+  CU_ASSERT(latest->frame == 1);
+}
+
+void
+test_save_load_state(void) // NOLINT
+{
+  static i8080 cpu;
+  static i8080_state state;
+  cpu_init(&cpu);
+
+  // loop: INR A, JMP 0x0000
+  cpu_write_mem(&cpu, 0x0000, 0x3c); // NOLINT
+  cpu_write_mem(&cpu, 0x0001, 0xc3); // NOLINT
+  cpu_write_mem(&cpu, 0x0002, 0x00); // NOLINT
+  cpu_write_mem(&cpu, 0x0003, 0x00); // NOLINT
+  cpu.b = 0x12;                      // NOLINT
+  cpu.port1 = 0x08;                  // NOLINT
+
+  cpu_save_state(&cpu, &state);
+  cpu_run_frame(&cpu, NULL);
+  uint8_t a = cpu.a;
+  uint16_t pc = cpu.pc;
+  uint64_t cycles = cpu.cycles;
+  int debt = cpu.cycle_debt;
+
+  // changes made after the save are undone by the load
+  cpu.port1 = 0;
+  cpu_write_mem(&cpu, 0x2400, 0xFF); // NOLINT
+  cpu_load_state(&cpu, &state);
+  CU_ASSERT(cpu.a == 0);
+  CU_ASSERT(cpu.b == 0x12);     // NOLINT
+  CU_ASSERT(cpu.port1 == 0x08); // NOLINT
+  CU_ASSERT(cpu.pc == 0);
+  CU_ASSERT(cpu.cycles == 0);
+  CU_ASSERT(cpu_read_mem(&cpu, 0x2400) == 0); // NOLINT
+
+  // replaying from the saved state gives the same result
+  cpu_run_frame(&cpu, NULL);
+  CU_ASSERT(cpu.a == a);
+  CU_ASSERT(cpu.pc == pc);
+  CU_ASSERT(cpu.cycles == cycles);
+  CU_ASSERT(cpu.cycle_debt == debt);
+}
+
+void
+test_load_state_writable_only(void) // NOLINT
+{
+  static i8080 cpu;
+  static i8080_state state;
+  static uint8_t rom[ROM_SIZE];
+  memset(rom, 0xAA, sizeof(rom)); // NOLINT
+  cpu_init(&cpu);
+  cpu_map_invaders(&cpu);
+  cpu_map_rom(&cpu, 0, rom, sizeof(rom));
+  cpu_write_mem(&cpu, 0x2000, 0x11); // NOLINT
+  cpu_write_mem(&cpu, 0x2400, 0x22); // NOLINT
+  cpu_save_state(&cpu, &state);
+
+  // the save sees the mapped ROM and the mirrors, as the CPU does
+  CU_ASSERT(state.memory[0x0000] == 0xAA); // NOLINT
+  CU_ASSERT(state.memory[0x6000] == 0x11); // NOLINT
+
+  cpu_write_mem(&cpu, 0x2000, 0x33); // NOLINT
+  cpu_write_mem(&cpu, 0x2400, 0x44); // NOLINT
+  cpu.vram_dirty = 0;
+  cpu_load_state(&cpu, &state);
+
+  // RAM and VRAM come back, and all of VRAM is marked as changed
+  CU_ASSERT(cpu_read_mem(&cpu, 0x2000) == 0x11); // NOLINT
+  CU_ASSERT(cpu_read_mem(&cpu, 0x2400) == 0x22); // NOLINT
+  CU_ASSERT(cpu.vram_dirty == VRAM_DIRTY_ALL);
+
+  // the memory behind the split set ROM and the mirrors is never written
+  CU_ASSERT(cpu.memory[0x0000] == 0);
+  CU_ASSERT(cpu.memory[0x6000] == 0); // NOLINT
+}
+
+void
+test_run_frame_timing(void) // NOLINT
+{
+  static i8080 cpu;
+  cpu_init(&cpu);
+
+  // JMP 0x0000 forever, 10 cycles per instruction
+  cpu_write_mem(&cpu, 0x0000, 0xc3); // NOLINT
+
+  // overruns are paid back so frames average out to FRAME_CYCLES
+  const uint64_t expected = 60 * (uint64_t)(2 * HALF_FRAME_CYCLES); // NOLINT
+  for (int i = 0; i < 60; i++)                                       // NOLINT
+    {
+      cpu_run_frame(&cpu, NULL);
+    }
+  CU_ASSERT(cpu.cycles >= expected);
+  CU_ASSERT(cpu.cycles < expected + 10); // NOLINT
+}
+
+void
+test_state_hash(void) // NOLINT
+{
+  static i8080 cpu;
+  static i8080_state state;
+  cpu_init(&cpu);
+
+  cpu_save_state(&cpu, &state);
+  uint64_t hash = cpu_state_hash(&state);
+  CU_ASSERT(hash == cpu_state_hash(&state));
+
+  // any register or memory byte changes the hash
+  cpu.h = 0x01;
+  cpu_save_state(&cpu, &state);
+  CU_ASSERT(cpu_state_hash(&state) != hash);
+
+  cpu.h = 0x00;
+  cpu_write_mem(&cpu, 0xFFFF, 0x01); // NOLINT
+  cpu_save_state(&cpu, &state);
+  CU_ASSERT(cpu_state_hash(&state) != hash);
+
+  cpu_write_mem(&cpu, 0xFFFF, 0x00); // NOLINT
+  cpu_save_state(&cpu, &state);
+  CU_ASSERT(cpu_state_hash(&state) == hash);
+}
+
+void
+test_memory_map_invaders(void) // NOLINT
+{
+  static i8080 cpu;
+  cpu_init(&cpu);
+  cpu.memory[0x0100] = 0x3E; // NOLINT
+  cpu_map_invaders(&cpu);
+
+  // ROM ignores writes
+  cpu_write_mem(&cpu, 0x0100, 0x00); // NOLINT
+  CU_ASSERT(cpu_read_mem(&cpu, 0x0100) == 0x3E);
+
+  // Work RAM is written directly and mirrored above 0x3FFF
+  cpu_write_mem(&cpu, 0x2010, 0x55); // NOLINT
+  CU_ASSERT(cpu.vram_dirty == 0);
+  CU_ASSERT(cpu_read_mem(&cpu, 0x6010) == 0x55);
+  cpu_write_mem(&cpu, 0xE010, 0xAA); // NOLINT
+  CU_ASSERT(cpu.memory[0x2010] == 0xAA);
+  CU_ASSERT(cpu_read_mem(&cpu, 0x4100) == 0x3E);
+
+  // VRAM writes, including through a mirror, mark the page dirty
+  cpu_write_mem(&cpu, 0x2400, 0x01); // NOLINT
+  CU_ASSERT(cpu.vram_dirty == 0x01);
+  cpu_write_mem(&cpu, 0x7FFF, 0x02); // NOLINT
+  CU_ASSERT(cpu.memory[0x3FFF] == 0x02);
+  CU_ASSERT(cpu.vram_dirty == (0x01 | (1U << 27))); // NOLINT
+
+  // The flat map used by cpu_init has no ROM and no mirror
+  cpu_map_flat(&cpu);
+  cpu_write_mem(&cpu, 0x0100, 0x00); // NOLINT
+  CU_ASSERT(cpu_read_mem(&cpu, 0x0100) == 0x00);
+  CU_ASSERT(cpu_read_mem(&cpu, 0x6010) == 0x00);
+}
+
+void
+test_register_pair_layout(void) // NOLINT
+{
+  i8080 cpu;
+  cpu_init(&cpu);
+
+  cpu.b = 0x12; // NOLINT
+  cpu.c = 0x34; // NOLINT
+  CU_ASSERT(cpu.bc == 0x1234);
+  cpu.hl = 0xBEEF; // NOLINT
+  CU_ASSERT(cpu.h == 0xBE);
+  CU_ASSERT(cpu.l == 0xEF);
+  cpu.a = 0x56;     // NOLINT
+  cpu.flags = 0x78; // NOLINT
+  CU_ASSERT(cpu.psw == 0x5678);
+  CU_ASSERT(readRegisterPair(&cpu, PSW) == 0x5678);
+
+  // XCHG swaps the pairs as a whole
+  cpu.de = 0x0102; // NOLINT
+  execute_instruction(&cpu, 0xEB);
+  CU_ASSERT(cpu.de == 0xBEEF);
+  CU_ASSERT(cpu.d == 0xBE);
+  CU_ASSERT(cpu.hl == 0x0102);
+}
+
+void
+test_superinstruction_fusion(void) // NOLINT
+{
+  static i8080 fused, plain;
+  static i8080_state fused_state, plain_state;
+  // LDAX D / MOV M,A / INX H / INX D / DCR B / JNZ 0000
+  const uint8_t copy[] = { 0x1A, 0x77, 0x23, 0x13, 0x05, 0xC2, 0x00, 0x00 };
+
+  i8080 *cpus[] = { &fused, &plain };
+  for (int i = 0; i < 2; i++)
+    {
+      cpu_init(cpus[i]);
+      memcpy(cpus[i]->memory, copy, sizeof(copy));
+      cpus[i]->memory[0x1000] = 0xAA; // NOLINT
+      cpus[i]->de = 0x1000;           // NOLINT
+      cpus[i]->hl = 0x2400;           // NOLINT
+      cpus[i]->b = 0x10;              // NOLINT
+    }
+
+  // nothing is fused while code can still be written
+  CU_ASSERT(cpu_fuse_rom(&fused) == 0);
+  cpu_map_invaders(&fused);
+  cpu_map_invaders(&plain);
+  CU_ASSERT(cpu_fuse_rom(&fused) == 1);
+
+  // budgets that end mid-sequence must stop on the same instruction
+  int budgets[] = { 1, 30, 39, 40, 100, 350 };
+  for (int i = 0; i < 6; i++) // NOLINT
+    {
+      CU_ASSERT(cpu_run(&fused, budgets[i]) == cpu_run(&plain, budgets[i]));
+      cpu_save_state(&fused, &fused_state);
+      cpu_save_state(&plain, &plain_state);
+      CU_ASSERT(fused.pc == plain.pc);
+      CU_ASSERT(fused.cycles == plain.cycles);
+      CU_ASSERT(cpu_state_hash(&fused_state) == cpu_state_hash(&plain_state));
+    }
+  CU_ASSERT(fused.memory[0x2400] == 0xAA);
+}
+
+void
+test_lazy_flags_match_eager(void) // NOLINT
+{
+  static i8080 eager, lazy;
+  // INR, DCR, MOV, ALU ops on every register, the immediates, DAA and a
+  // conditional jump that has to read pending flags
+  const uint8_t opcodes[]
+      = { 0x04, 0x05, 0x0C, 0x0D, 0x14, 0x15, 0x1C, 0x1D, 0x24, 0x25, 0x27,
+          0x2C, 0x2D, 0x34, 0x35, 0x3C, 0x3D, 0x80, 0x81, 0x86, 0x87, 0x88,
+          0x8E, 0x90, 0x96, 0x97, 0xA0, 0xA6, 0xA7, 0xA8, 0xAE, 0xAF, 0xB0,
+          0xB6, 0xB7, 0xB8, 0xBE, 0xBF, 0xC2, 0xC6, 0xD6, 0xDE, 0xE6, 0xF6,
+          0xFA, 0xFE };
+  const uint8_t values[] = { 0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0x99, 0xFF };
+  const uint8_t flags[] = { 0x00, FLAG_CY, FLAG_AC, FLAG_CY | FLAG_AC };
+
+  cpu_init(&eager);
+  cpu_init(&lazy);
+  cpu_set_lazy_flags(&lazy, true);
+
+  for (size_t op = 0; op < sizeof(opcodes); op++)
+    {
+      for (size_t a = 0; a < sizeof(values); a++)
+        {
+          for (size_t v = 0; v < sizeof(values); v++)
+            {
+              for (size_t f = 0; f < sizeof(flags); f++)
+                {
+                  i8080 *cpus[] = { &eager, &lazy };
+                  for (int i = 0; i < 2; i++)
+                    {
+                      i8080 *cpu = cpus[i];
+                      cpu->pc = 0x0100;  // NOLINT
+                      cpu->hl = 0x2000;  // NOLINT
+                      cpu->memory[0x0100] = opcodes[op];
+                      cpu->memory[0x0101] = values[v];
+                      cpu->memory[0x2000] = values[v];
+                      cpu->a = values[a];
+                      cpu->b = values[v];
+                      cpu->c = values[v];
+                      // an earlier ALU op leaves its own flags pending
+                      cpu->d = values[a];
+                      execute_instruction(cpu, 0x15); // DCR D
+                      cpu->flags = (cpu_flags(cpu) & ~(FLAG_CY | FLAG_AC))
+                                   | flags[f];
+                      cpu->flags_pending &= ~FLAG_AC;
+                      execute_instruction(cpu, opcodes[op]);
+                    }
+                  CU_ASSERT(cpu_flags(&eager) == cpu_flags(&lazy));
+                  CU_ASSERT(eager.a == lazy.a);
+                  CU_ASSERT(eager.pc == lazy.pc);
+                }
+            }
+        }
+    }
+
+  // materializing once leaves nothing pending
+  cpu_sync_flags(&lazy);
+  CU_ASSERT(lazy.flags_pending == 0);
+  CU_ASSERT(lazy.flags == eager.flags);
+}
+
+void
+test_audio_mixer_timing(void) // NOLINT
+{
+  static audio_mixer mixer;
+  static int16_t ufo[300];
+  static int16_t shot[50];
+  int16_t out[4 * AUDIO_BUFFER_SAMPLES];
+
+  for (int i = 0; i < 300; i++) // NOLINT
+    {
+      ufo[i] = (int16_t)i;
+    }
+  for (int i = 0; i < 50; i++) // NOLINT
+    {
+      shot[i] = 1000; // NOLINT
+    }
+
+  audio_mixer_init(&mixer);
+  audio_sample ufo_sample = { ufo, 300 };
+  audio_sample shot_sample = { shot, 50 };
+
+  // 20000 cycles at 2 MHz is exactly 441 samples at 44.1 kHz
+  audio_trigger start_ufo = { 1000, SOUND_UFO, true, true, &ufo_sample };
+  audio_trigger start_shot = { 21000, SOUND_SHOT, true, false, &shot_sample };
+  audio_trigger stop_ufo = { 41000, SOUND_UFO, false, false, NULL };
+  CU_ASSERT(audio_mixer_push(&mixer, &start_ufo));
+  CU_ASSERT(audio_mixer_push(&mixer, &start_shot));
+  CU_ASSERT(audio_mixer_push(&mixer, &stop_ufo));
+
+  for (int i = 0; i < 4; i++) // NOLINT
+    {
+      audio_mixer_render(&mixer, &out[i * AUDIO_BUFFER_SAMPLES],
+                         AUDIO_BUFFER_SAMPLES);
+    }
+
+  // the first trigger anchors the clock and starts at once
+  CU_ASSERT(out[0] == 0);
+  CU_ASSERT(out[299] == 299);
+  // the UFO loops
+  CU_ASSERT(out[300] == 0);
+  CU_ASSERT(out[301] == 1);
+  // the shot starts 441 samples after the UFO and plays once
+  CU_ASSERT(out[440] == 140);
+  CU_ASSERT(out[441] == 1141);
+  CU_ASSERT(out[490] == 1190);
+  CU_ASSERT(out[491] == 191);
+  // and the UFO stops 882 samples in
+  CU_ASSERT(out[881] == 281);
+  CU_ASSERT(out[883] == 0);
+  CU_ASSERT(out[1023] == 0);
+}
+
+void
+test_sound_cache_shared(void) // NOLINT
+{
+  i8080 cpu;
+
+  // creating a CPU loads nothing, the first request decodes the sound
+  cpu_init(&cpu);
+  const audio_sample *first = sound_get(SOUND_SHOT);
+  const audio_sample *again = sound_get(SOUND_SHOT);
+  CU_ASSERT(first != NULL);
+  if (first == NULL)
+    {
+      return;
+    }
+  CU_ASSERT(first->length > 0);
+
+  // every later request shares the same decoded copy
+  CU_ASSERT(first == again);
+  CU_ASSERT(first->data == again->data);
+
+  // and a freed cache loads again on demand
+  sound_cache_free();
+  CU_ASSERT(sound_get(SOUND_SHOT) != NULL);
+  sound_cache_free();
+
+  // preloading, as audio_open does, leaves every sound ready to hand out
+  sound_cache_preload();
+  for (int sound = 0; sound < NUM_SOUNDS; sound++)
+    {
+      const audio_sample *sample = sound_get(sound);
+      CU_ASSERT(sample != NULL && sample->length > 0);
+    }
+  sound_cache_free();
+}
+
+// OUT 3 with the given A
+static void
+out_port3(i8080 *cpu, uint8_t value)
+{
+  cpu->pc = 0;
+  cpu->a = value;
+  cpu_write_mem(cpu, 0x0001, 0x03); // NOLINT
+  execute_instruction(cpu, 0xd3);   // NOLINT
+}
+
+void
+test_ufo_muted_frames(void) // NOLINT
+{
+  static i8080 cpu;
+  static i8080_state state;
+  cpu_init(&cpu);
+
+  out_port3(&cpu, 0x01);
+  CU_ASSERT(cpu.ufo_playing);
+
+  // a speculative frame that clears the bit leaves the real loop alone
+  cpu_save_state(&cpu, &state);
+  cpu.sound_muted = true;
+  out_port3(&cpu, 0x00);
+  CU_ASSERT(cpu.last_out_port3 == 0x00);
+  CU_ASSERT(cpu.ufo_playing);
+  cpu_load_state(&cpu, &state);
+  cpu.sound_muted = false;
+  cpu_sync_sound(&cpu);
+  CU_ASSERT(cpu.ufo_playing);
+
+  // a real muted frame (turbo, rollback) that clears it stops it afterwards
+  cpu.sound_muted = true;
+  out_port3(&cpu, 0x00);
+  cpu.sound_muted = false;
+  CU_ASSERT(cpu.ufo_playing);
+  cpu_sync_sound(&cpu);
+  CU_ASSERT(!cpu.ufo_playing);
+
+  // a bit set while muted starts the loop at the next heard OUT, though
+  // there is no rising edge left to see
+  cpu.sound_muted = true;
+  out_port3(&cpu, 0x01);
+  cpu.sound_muted = false;
+  out_port3(&cpu, 0x01);
+  CU_ASSERT(cpu.ufo_playing);
+}
+
+void
+test_load_rom_from_memory(void) // NOLINT
+{
+  static const uint8_t rom[] = { 0x31, 0x00, 0x24 }; // NOLINT
+  i8080 cpu;
+
+  cpu_init(&cpu);
+  CU_ASSERT(cpu_load_rom(&cpu, rom, sizeof(rom), 0x100)); // NOLINT
+  CU_ASSERT(memcmp(&cpu.memory[0x100], rom, sizeof(rom)) == 0); // NOLINT
+  CU_ASSERT(cpu.memory[0x103] == 0); // NOLINT
+
+  // an image that would run off the end of memory is refused untouched
+  CU_ASSERT(!cpu_load_rom(&cpu, rom, sizeof(rom), 0xFFFE)); // NOLINT
+  CU_ASSERT(cpu.memory[0xFFFE] == 0); // NOLINT
+}
+
+void
+test_rom_set_mapped(void) // NOLINT
+{
+  static uint8_t image[ROM_SIZE];
+  static i8080_state mapped_state;
+  static i8080_state loaded_state;
+  static const char *names[ROM_SET_FILES]
+      = { "invaders.h", "invaders.g", "invaders.f", "invaders.e" };
+  char directory[] = "/tmp/rom_set_XXXXXX";
+  char path[64]; // NOLINT
+  i8080 mapped;
+  i8080 loaded;
+  rom_set set;
+
+  // the standard CRC-32 check value
+  CU_ASSERT(rom_crc32((const uint8_t *)"123456789", 9) // NOLINT
+            == 0xCBF43926);                            // NOLINT
+
+  // split the combined image into the four files of the set
+  FILE *file = fopen("invaders", "rb");
+  CU_ASSERT(file != NULL);
+  if (file == NULL || mkdtemp(directory) == NULL)
+    {
+      return;
+    }
+  CU_ASSERT(fread(image, 1, ROM_SIZE, file) == ROM_SIZE);
+  fclose(file);
+  for (int i = 0; i < ROM_SET_FILES; i++)
+    {
+      snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+      file = fopen(path, "wb");
+      fwrite(&image[i * ROM_FILE_SIZE], 1, ROM_FILE_SIZE, file);
+      fclose(file);
+    }
+
+  CU_ASSERT(rom_set_open(&set, directory));
+  cpu_init(&mapped);
+  cpu_map_invaders(&mapped);
+  rom_set_map(&set, &mapped);
+  cpu_init(&loaded);
+  cpu_load_file(&loaded, "invaders", 0);
+  cpu_map_invaders(&loaded);
+
+  // reads come straight from the mappings, mirrors included, and nothing
+  // was copied into the CPU
+  CU_ASSERT(cpu_read_mem(&mapped, 0x0000) == image[0]);      // NOLINT
+  CU_ASSERT(cpu_read_mem(&mapped, 0x1FFF) == image[0x1FFF]); // NOLINT
+  CU_ASSERT(cpu_read_mem(&mapped, 0x4800) == image[0x0800]); // NOLINT
+  CU_ASSERT(mapped.read_page[0] != &mapped.memory[0]);
+  cpu_write_mem(&mapped, 0x0000, 0xFF); // NOLINT
+  CU_ASSERT(cpu_read_mem(&mapped, 0x0000) == image[0]);
+
+  // a mapped ROM saves and hashes the same as a loaded one
+  cpu_save_state(&mapped, &mapped_state);
+  cpu_save_state(&loaded, &loaded_state);
+  CU_ASSERT(cpu_state_hash(&mapped_state) == cpu_state_hash(&loaded_state));
+  rom_set_close(&set);
+
+  // a bad dump is refused
+  snprintf(path, sizeof(path), "%s/%s", directory, names[2]);
+  file = fopen(path, "r+b");
+  fputc(image[2 * ROM_FILE_SIZE] ^ 1, file);
+  fclose(file);
+  CU_ASSERT(!rom_set_open(&set, directory));
+  CU_ASSERT(set.data[0] == NULL);
+
+  for (int i = 0; i < ROM_SET_FILES; i++)
+    {
+      snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+      remove(path);
+    }
+  remove(directory);
+}
+
+void
+test_opcode_table_matches_interpreter(void) // NOLINT
+{
+  i8080 cpu;
+
+  for (int opcode = 0; opcode <= MAX_8_BIT_VALUE; opcode++)
+    {
+      const opcode_info *info = &opcode_table[opcode];
+      int cycles[2];
+
+      CU_ASSERT(info->mnemonic != NULL);
+      CU_ASSERT(info->length >= 1 && info->length <= 3);
+
+      // once with every flag clear and once with every flag set, so each
+      // conditional instruction runs both ways
+      for (int set = 0; set < 2; set++)
+        {
+          cpu_init(&cpu);
+          cpu.pc = 0x1000;                 // NOLINT
+          cpu.sp = 0x3000;                 // NOLINT
+          cpu.hl = 0x2800;                 // NOLINT
+          cpu.flags = set ? FLAGS_ALL : 0;
+          cpu.memory[0x1000] = opcode;     // NOLINT
+          cpu.memory[0x1001] = 0x02;       // NOLINT port 2 for IN and OUT
+          cpu.memory[0x1002] = 0x20;       // NOLINT
+
+          cycles[set] = execute_instruction(&cpu, opcode);
+          CU_ASSERT(cycles[set] >= 0);
+          if (info->branch)
+            {
+              CU_ASSERT(cycles[set] == info->cycles
+                        || cycles[set] == info->taken_cycles);
+            }
+          else
+            {
+              CU_ASSERT(cycles[set] == info->cycles);
+              CU_ASSERT(cpu.pc == 0x1000 + info->length); // NOLINT
+            }
+        }
+
+      if (info->cycles != info->taken_cycles)
+        {
+          CU_ASSERT(cycles[0] != cycles[1]);
+        }
+    }
+}
+
+void
+test_opcode_0x76(void) // NOLINT
+{
+  // HLT
+  i8080 cpu;
+  cpu_init(&cpu);
+
+  cpu.pc = 0x1000;                       // NOLINT
+  cpu.sp = 0x3000;                       // NOLINT
+  cpu_write_mem(&cpu, 0x1000, 0x76);     // NOLINT
+  cpu_write_mem(&cpu, 0x1001, 0x3c);     // NOLINT INR A
+
+  CU_ASSERT(execute_instruction(&cpu, 0x76) == 7); // NOLINT
+  CU_ASSERT(cpu.halted);
+  CU_ASSERT_EQUAL(cpu.pc, 0x1001); // NOLINT
+
+  // stays put, whatever the budget
+  CU_ASSERT(cpu_run(&cpu, 1000) <= 0); // NOLINT
+  CU_ASSERT_EQUAL(cpu.pc, 0x1001);     // NOLINT
+  CU_ASSERT_EQUAL(cpu.a, 0);
+
+  // an interrupt while disabled does not wake it
+  handle_interrupt(&cpu, 1);
+  CU_ASSERT(cpu.halted);
+
+  // one that is taken does, and returns past the HLT
+  cpu.interrupt_enabled = true;
+  handle_interrupt(&cpu, 1);
+  CU_ASSERT(!cpu.halted);
+  CU_ASSERT_EQUAL(cpu.pc, 0x0008);                    // NOLINT
+  CU_ASSERT_EQUAL(cpu_read_mem(&cpu, 0x2FFE), 0x01); // NOLINT
+  CU_ASSERT_EQUAL(cpu_read_mem(&cpu, 0x2FFF), 0x10); // NOLINT
+}
+
+void
+test_opcode_0xcf(void) // NOLINT
+{
+  // RST 1
+  i8080 cpu;
+  cpu_init(&cpu);
+
+  cpu.pc = 0xABCD; // NOLINT
+  cpu.sp = 0xDCBA; // NOLINT
+
+  CU_ASSERT(execute_instruction(&cpu, 0xcf) == 11);    // NOLINT
+  CU_ASSERT_EQUAL(cpu_read_mem(&cpu, 0xDCB9), 0xAB); // NOLINT
+  CU_ASSERT_EQUAL(cpu_read_mem(&cpu, 0xDCB8), 0xCE); // NOLINT
+  CU_ASSERT_EQUAL(cpu.sp, 0xDCBA - 2);               // NOLINT
+  CU_ASSERT_EQUAL(cpu.pc, 0x0008);                   // NOLINT
+
+  // RST 7
+  CU_ASSERT(execute_instruction(&cpu, 0xff) == 11); // NOLINT
+  CU_ASSERT_EQUAL(cpu.pc, 0x0038);                // NOLINT
+  CU_ASSERT_EQUAL(cpu_read_mem(&cpu, 0xDCB6), 0x09); // NOLINT
+}
+
+void
+test_opcode_0xe2(void) // NOLINT
+{
+  // JPO and JPE, from the parity of the last result
+  i8080 cpu;
+  cpu_init(&cpu);
+
+  cpu.pc = 0x1000;                   // NOLINT
+  cpu_write_mem(&cpu, 0x1001, 0x34); // NOLINT
+  cpu_write_mem(&cpu, 0x1002, 0x12); // NOLINT
+  cpu.a = 0x03;                      // NOLINT
+  cpu.b = 0x00;
+  execute_instruction(&cpu, 0xb0); // ORA B, even parity
+
+  cpu.pc = 0x1000; // NOLINT
+  CU_ASSERT(execute_instruction(&cpu, 0xe2) == 10); // NOLINT
+  CU_ASSERT_EQUAL(cpu.pc, 0x1003);                 // NOLINT
+  cpu.pc = 0x1000;                                 // NOLINT
+  CU_ASSERT(execute_instruction(&cpu, 0xea) == 10); // NOLINT
+  CU_ASSERT_EQUAL(cpu.pc, 0x1234);                 // NOLINT
+
+  // the same with the flags left pending
+  cpu_set_lazy_flags(&cpu, true);
+  cpu.a = 0x07; // NOLINT
+  execute_instruction(&cpu, 0xb0); // ORA B, odd parity
+
+  cpu.pc = 0x1000; // NOLINT
+  execute_instruction(&cpu, 0xea);
+  CU_ASSERT_EQUAL(cpu.pc, 0x1003); // NOLINT
+  cpu.pc = 0x1000;                 // NOLINT
+  execute_instruction(&cpu, 0xe2);
+  CU_ASSERT_EQUAL(cpu.pc, 0x1234); // NOLINT
+}
+
+void
+test_opcode_0x98(void) // NOLINT
+{
+  // SBB B
+  i8080 cpu;
+  cpu_init(&cpu);
+
+  cpu.a = 0x04; // NOLINT
+  cpu.b = 0x02; // NOLINT
+  cpu.flags |= FLAG_CY;
+
+  CU_ASSERT(execute_instruction(&cpu, 0x98) == 4); // NOLINT
+  CU_ASSERT_EQUAL(cpu.a, 0x01);
+  CU_ASSERT((cpu.flags & FLAG_CY) == 0);
+  CU_ASSERT((cpu.flags & FLAG_Z) == 0);
+
+  // borrow out
+  CU_ASSERT(execute_instruction(&cpu, 0x98) == 4); // NOLINT
+  CU_ASSERT_EQUAL(cpu.a, 0xFF);                     // NOLINT
+  CU_ASSERT((cpu.flags & FLAG_CY) == FLAG_CY);
+  CU_ASSERT((cpu.flags & FLAG_S) == FLAG_S);
+
+  // SBB M
+  cpu.hl = 0x2000;                   // NOLINT
+  cpu_write_mem(&cpu, 0x2000, 0xFE); // NOLINT
+  CU_ASSERT(execute_instruction(&cpu, 0x9e) == 7); // NOLINT
+  CU_ASSERT_EQUAL(cpu.a, 0x00);
+  CU_ASSERT((cpu.flags & FLAG_Z) == FLAG_Z);
+  CU_ASSERT((cpu.flags & FLAG_CY) == 0);
+}
+
+void
+test_movie_round_trip(void) // NOLINT
+{
+  char path[] = "/tmp/movie_XXXXXX";
+  input_movie recorded;
+  input_movie loaded;
+  i8080 cpu;
+
+  cpu_init(&cpu);
+  movie_init(&recorded);
+  cpu.cycles = 100;   // NOLINT
+  cpu.port1 = 0x01;   // NOLINT
+  movie_record(&recorded, &cpu);
+  cpu.cycles = 5000;  // NOLINT
+  cpu.port1 = 0x00;
+  cpu.port2 = 0x10;   // NOLINT
+  movie_record(&recorded, &cpu);
+
+  int fd = mkstemp(path);
+  CU_ASSERT(fd >= 0);
+  if (fd < 0)
+    {
+      movie_free(&recorded);
+      return;
+    }
+  close(fd);
+  CU_ASSERT(movie_save(&recorded, path));
+  CU_ASSERT(movie_load(&loaded, path));
+  CU_ASSERT(loaded.count == 2);
+  for (size_t i = 0; i < loaded.count && i < 2; i++)
+    {
+      CU_ASSERT(loaded.entries[i].cycle == recorded.entries[i].cycle);
+      CU_ASSERT(loaded.entries[i].port1 == recorded.entries[i].port1);
+      CU_ASSERT(loaded.entries[i].port2 == recorded.entries[i].port2);
+    }
+
+  // entries take effect once the CPU reaches their cycle, not before
+  cpu_init(&cpu);
+  cpu.cycles = 99; // NOLINT
+  movie_replay(&loaded, &cpu);
+  CU_ASSERT(cpu.port1 == 0 && loaded.next == 0);
+  cpu.cycles = 4999; // NOLINT
+  movie_replay(&loaded, &cpu);
+  CU_ASSERT(cpu.port1 == 0x01 && cpu.port2 == 0 && loaded.next == 1);
+  cpu.cycles = 9000; // NOLINT
+  movie_replay(&loaded, &cpu);
+  CU_ASSERT(cpu.port1 == 0 && cpu.port2 == 0x10 && loaded.next == 2);
+  movie_free(&loaded);
+
+  // entries out of cycle order are refused
+  FILE *file = fopen(path, "w");
+  fprintf(file, "# cycle port1 port2\n200 01 00\n100 00 00\n");
+  fclose(file);
+  CU_ASSERT(!movie_load(&loaded, path));
+  CU_ASSERT(loaded.entries == NULL);
+
+  movie_free(&recorded);
+  remove(path);
+}
+
+// A and the PSW byte PUSH PSW would store after an instruction, as the
+// reference model below works them out
+typedef struct
+{
+  uint8_t a;
+  uint8_t psw;
+} alu_result;
+
+// The PSW byte from the 8080 data book, S Z 0 AC 0 P 1 CY, spelled out here
+// rather than taken from FLAG_* so a wrong layout there is caught too
+#define REFERENCE_S 0x80   // NOLINT
+#define REFERENCE_Z 0x40   // NOLINT
+#define REFERENCE_AC 0x10  // NOLINT
+#define REFERENCE_P 0x04   // NOLINT
+#define REFERENCE_ONE 0x02 // NOLINT bit 1 always reads as 1
+#define REFERENCE_CY 0x01  // NOLINT
+
+// Where the exhaustive tests push PSW
+#define ALU_STACK 0x2000 // NOLINT
+
+// Instructions the exhaustive tests run. The first ALU_OPS are in their
+// encoding order and run with the operand in B and as an immediate.
+enum
+{
+  ALU_ADD,
+  ALU_ADC,
+  ALU_SUB,
+  ALU_SBB,
+  ALU_ANA,
+  ALU_XRA,
+  ALU_ORA,
+  ALU_CMP,
+  ALU_INR,
+  ALU_DCR,
+  ALU_DAA
+};
+#define ALU_OPS ALU_INR
+
+static uint8_t
+reference_szp(int result)
+{
+  uint8_t flags = REFERENCE_ONE;
+  // fold the bits together, bit 0 ends up as their XOR
+  int ones = result ^ (result >> 4); // NOLINT
+  ones ^= ones >> 2;
+  ones ^= ones >> 1;
+  if (result & 0x80) // NOLINT
+    {
+      flags |= REFERENCE_S;
+    }
+  if ((result & 0xFF) == 0) // NOLINT
+    {
+      flags |= REFERENCE_Z;
+    }
+  if ((ones & 1) == 0)
+    {
+      flags |= REFERENCE_P;
+    }
+  return flags;
+}
+
+/*
+The 8080 ALU from the data book, written out plainly with ints and no shared
+code with the emulator: subtraction borrows rather than adding a complement,
+so AC is "no borrow out of the low nibble", and the logical ops follow the
+8080 (not 8085) rules, ANA setting AC from bit 3 of either operand.
+*/
+static alu_result
+reference_alu(int op, uint8_t a, uint8_t value, bool cy, bool ac)
+{
+  int lo = a & 0x0F; // NOLINT
+  int value_lo = value & 0x0F; // NOLINT
+  int result = a;
+  bool new_cy = cy;
+  bool new_ac = false;
+
+  switch (op)
+    {
+    case ALU_ADD:
+    case ALU_ADC:
+      {
+        int carry = (op == ALU_ADC && cy) ? 1 : 0;
+        result = a + value + carry;
+        new_cy = result > 0xFF; // NOLINT
+        new_ac = lo + value_lo + carry > 0x0F; // NOLINT
+        break;
+      }
+    case ALU_SUB:
+    case ALU_SBB:
+    case ALU_CMP:
+      {
+        int borrow = (op == ALU_SBB && cy) ? 1 : 0;
+        result = a - value - borrow;
+        new_cy = result < 0;
+        new_ac = lo - value_lo - borrow >= 0;
+        break;
+      }
+    case ALU_ANA:
+      result = a & value;
+      new_cy = false;
+      new_ac = ((a | value) & 0x08) != 0; // NOLINT
+      break;
+    case ALU_XRA:
+      result = a ^ value;
+      new_cy = false;
+      break;
+    case ALU_ORA:
+      result = a | value;
+      new_cy = false;
+      break;
+    case ALU_INR:
+      result = a + 1;
+      new_ac = lo == 0x0F; // NOLINT
+      break;
+    case ALU_DCR:
+      result = a - 1;
+      new_ac = lo != 0;
+      break;
+    case ALU_DAA:
+      {
+        int adjust = 0;
+        if (lo > 9 || ac) // NOLINT
+          {
+            adjust += 0x06; // NOLINT
+          }
+        if ((a >> 4) > 9 || ((a >> 4) == 9 && lo > 9) || cy) // NOLINT
+          {
+            adjust += 0x60; // NOLINT
+            new_cy = true;
+          }
+        result = a + adjust;
+        new_ac = lo + (adjust & 0x0F) > 0x0F; // NOLINT
+        break;
+      }
+    }
+
+  alu_result out = { (uint8_t)result, reference_szp(result) };
+  if (op == ALU_CMP) // leaves A alone
+    {
+      out.a = a;
+    }
+  if (new_cy)
+    {
+      out.psw |= REFERENCE_CY;
+    }
+  if (new_ac)
+    {
+      out.psw |= REFERENCE_AC;
+    }
+  return out;
+}
+
+/*
+Run one opcode over every A, operand and incoming CY and AC on each of cpus
+(one with eager and one with lazy flags) and return how many combinations
+disagree with the reference, printing the first. Both the flags and the byte
+a following PUSH PSW stores, which is all a program can see of them, are
+checked.
+*/
+static int
+alu_mismatches(i8080 *cpus[2], int op, uint8_t opcode, bool immediate)
+{
+  static const char *names[] = { "ADD", "ADC", "SUB", "SBB", "ANA", "XRA",
+                                 "ORA", "CMP", "INR", "DCR", "DAA" };
+  const uint8_t all_flags = REFERENCE_S | REFERENCE_Z | REFERENCE_AC
+                            | REFERENCE_P | REFERENCE_CY;
+  int values = op < ALU_OPS ? 256 : 1; // NOLINT
+  int mismatches = 0;
+
+  for (int a = 0; a < 256; a++) // NOLINT
+    {
+      for (int value = 0; value < values; value++)
+        {
+          for (int carries = 0; carries < 4; carries++) // NOLINT
+            {
+              bool cy = (carries & 1) != 0;
+              bool ac = (carries & 2) != 0;
+              alu_result want
+                  = reference_alu(op, (uint8_t)a, (uint8_t)value, cy, ac);
+
+              for (int i = 0; i < 2; i++)
+                {
+                  i8080 *cpu = cpus[i];
+                  cpu->pc = 0x0100; // NOLINT
+                  cpu->memory[0x0101] = (uint8_t)value; // NOLINT
+                  cpu->a = (uint8_t)a;
+                  cpu->b = (uint8_t)value;
+                  cpu->sp = ALU_STACK;
+                  cpu->flags = (cy ? FLAG_CY : 0) | (ac ? FLAG_AC : 0);
+                  cpu->flags_pending = 0;
+                  execute_instruction(cpu, opcode);
+
+                  uint8_t got = cpu_flags(cpu);
+                  execute_instruction(cpu, 0xf5); // NOLINT PUSH PSW
+                  uint8_t pushed = cpu->memory[ALU_STACK - 2];
+                  if ((cpu->a != want.a || got != (want.psw & all_flags)
+                       || pushed != want.psw)
+                      && mismatches++ == 0)
+                    {
+                      printf("\n%s%s%s A=%02x value=%02x CY=%d AC=%d: got "
+                             "A=%02x flags=%02x PSW=%02x, expected A=%02x "
+                             "PSW=%02x\n",
+                             names[op], immediate ? " immediate" : "",
+                             cpu->lazy_flags ? " (lazy)" : "", a, value, cy,
+                             ac, cpu->a, got, pushed, want.a, want.psw);
+                    }
+                }
+            }
+        }
+    }
+  return mismatches;
+}
+
+// Check one instruction in every form against the reference, with eager
+// and with lazy flags
+static void
+alu_exhaustive(int op)
+{
+  static const uint8_t single_opcodes[] = { 0x3C, 0x3D, 0x27 }; // NOLINT
+  static i8080 eager, lazy;
+  i8080 *cpus[] = { &eager, &lazy };
+
+  cpu_init(&eager);
+  cpu_init(&lazy);
+  cpu_set_lazy_flags(&lazy, true);
+
+  if (op < ALU_OPS)
+    {
+      // the register form with B, then the immediate form
+      CU_ASSERT(alu_mismatches(cpus, op, 0x80 | (op << 3), false) == 0);
+      CU_ASSERT(alu_mismatches(cpus, op, 0xC6 | (op << 3), true) == 0);
+    }
+  else
+    {
+      CU_ASSERT(alu_mismatches(cpus, op, single_opcodes[op - ALU_OPS], false)
+                == 0);
+    }
+}
+
+// One test per instruction, so the test runner can spread them over CPUs
+void
+test_alu_add(void)
+{
+  alu_exhaustive(ALU_ADD);
+}
+
+void
+test_alu_adc(void)
+{
+  alu_exhaustive(ALU_ADC);
+}
+
+void
+test_alu_sub(void)
+{
+  alu_exhaustive(ALU_SUB);
+}
+
+void
+test_alu_sbb(void)
+{
+  alu_exhaustive(ALU_SBB);
+}
+
+void
+test_alu_ana(void)
+{
+  alu_exhaustive(ALU_ANA);
+}
+
+void
+test_alu_xra(void)
+{
+  alu_exhaustive(ALU_XRA);
+}
+
+void
+test_alu_ora(void)
+{
+  alu_exhaustive(ALU_ORA);
+}
+
+void
+test_alu_cmp(void)
+{
+  alu_exhaustive(ALU_CMP);
+}
+
+void
+test_alu_inr(void)
+{
+  alu_exhaustive(ALU_INR);
+}
+
+void
+test_alu_dcr(void)
+{
+  alu_exhaustive(ALU_DCR);
+}
+
+void
+test_alu_daa(void)
+{
+  alu_exhaustive(ALU_DAA);
+}
+
+void
+test_vram_hash(void) // NOLINT
+{
+  static i8080 cpu;
+
+  cpu_init(&cpu);
+  uint64_t blank = cpu_vram_hash(&cpu);
+
+  // anything outside VRAM is left out
+  cpu.memory[VRAM_START - 1] = 0xFF;          // NOLINT
+  cpu.memory[VRAM_START + VRAM_SIZE] = 0xFF; // NOLINT
+  cpu.a = 0x12;                              // NOLINT
+  CU_ASSERT(cpu_vram_hash(&cpu) == blank);
+
+  // both ends of VRAM count
+  cpu.memory[VRAM_START] = 0x01; // NOLINT
+  uint64_t first = cpu_vram_hash(&cpu);
+  CU_ASSERT(first != blank);
+  cpu.memory[VRAM_START] = 0x00;
+  cpu.memory[VRAM_START + VRAM_SIZE - 1] = 0x01; // NOLINT
+  CU_ASSERT(cpu_vram_hash(&cpu) != blank);
+  CU_ASSERT(cpu_vram_hash(&cpu) != first);
+}
+
+/*
+Test runner. The registered tests are dealt out to forked workers, one per
+CPU unless -j says otherwise, worker n taking every jobs-th test from the nth.
+Each worker runs its tests with CU_run_test and writes a line per test down a
+pipe, "T index microseconds asserts failures" followed by an "F index line
+file condition" line for every failed assert. The parent prints them in
+registration order with the time each test took, so the report reads the same
+however the tests were split. -j 1 runs everything in this process, for a
+debugger.
+*/
+
+// Most workers forked, and tests listed as the slowest
+#define MAX_TEST_JOBS 64 // NOLINT
+#define SLOWEST_TESTS 5  // NOLINT
+
+// Longest result line read back from a worker
+#define RESULT_LINE_LENGTH 1024 // NOLINT
+
+typedef struct
+{
+  CU_pSuite suite;
+  CU_pTest test;
+  bool done;
+  unsigned long micros;
+  unsigned int asserts;
+  unsigned int failures;
+  char *failure_text; // "    file:line: condition" lines
+  size_t failure_length;
+} test_result;
+
+static double
+test_seconds_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9; // NOLINT
+}
+
+// Run every jobs-th test from worker, writing result lines to out
+static void
+run_shard(const test_result *results, size_t count, int worker, int jobs,
+          FILE *out)
+{
+  for (size_t i = (size_t)worker; i < count; i += (size_t)jobs)
+    {
+      double start = test_seconds_now();
+      CU_run_test(results[i].suite, results[i].test);
+      double elapsed = test_seconds_now() - start;
+
+      fprintf(out, "T %zu %lu %u %u\n", i,
+              (unsigned long)(elapsed * 1e6), // NOLINT
+              CU_get_number_of_asserts(), CU_get_number_of_failures());
+      for (CU_pFailureRecord failure = CU_get_failure_list(); failure != NULL;
+           failure = failure->pNext)
+        {
+          fprintf(out, "F %zu %u %s %s\n", i, failure->uiLineNumber,
+                  failure->strFileName, failure->strCondition);
+        }
+      fflush(out);
+    }
+}
+
+static void
+add_failure_text(test_result *result, const char *file, unsigned int line,
+                 const char *condition)
+{
+  size_t length = strlen(file) + strlen(condition) + 32; // NOLINT
+  char *text = realloc(result->failure_text,
+                       result->failure_length + length);
+
+  if (text == NULL)
+    {
+      return;
+    }
+  result->failure_length
+      += (size_t)snprintf(text + result->failure_length, length,
+                          "    %s:%u: %s\n", file, line, condition);
+  result->failure_text = text;
+}
+
+// Read a worker's result lines into results
+static void
+read_results(FILE *in, test_result *results, size_t count)
+{
+  char line[RESULT_LINE_LENGTH];
+
+  while (fgets(line, sizeof(line), in) != NULL)
+    {
+      size_t index = 0;
+      unsigned long micros = 0;
+      unsigned int asserts = 0;
+      unsigned int failures = 0;
+      unsigned int number = 0;
+      int used = 0;
+
+      line[strcspn(line, "\n")] = '\0';
+      if (sscanf(line, "T %zu %lu %u %u", &index, &micros, &asserts,
+                 &failures)
+              == 4
+          && index < count)
+        {
+          results[index].done = true;
+          results[index].micros = micros;
+          results[index].asserts = asserts;
+          results[index].failures = failures;
+        }
+      else if (sscanf(line, "F %zu %u %n", &index, &number, &used) == 2
+               && index < count)
+        {
+          char *file = line + used;
+          char *condition = file + strcspn(file, " ");
+          if (*condition != '\0')
+            {
+              *condition++ = '\0';
+            }
+          add_failure_text(&results[index], file, number, condition);
+        }
+    }
+}
+
+// Fork the workers and collect what they report, false if one could not be
+// started
+static bool
+run_workers(test_result *results, size_t count, int jobs)
+{
+  pid_t workers[MAX_TEST_JOBS];
+  FILE *pipes[MAX_TEST_JOBS];
+
+  // anything buffered would otherwise be printed again by every worker
+  fflush(stdout);
+  fflush(stderr);
+
+  for (int worker = 0; worker < jobs; worker++)
+    {
+      int fds[2];
+      if (pipe(fds) != 0)
+        {
+          perror("pipe");
+          return false;
+        }
+      workers[worker] = fork();
+      if (workers[worker] < 0)
+        {
+          perror("fork");
+          return false;
+        }
+      if (workers[worker] == 0)
+        {
+          close(fds[0]);
+          FILE *out = fdopen(fds[1], "w");
+          run_shard(results, count, worker, jobs, out);
+          fclose(out);
+          fflush(stdout);
+          _exit(EXIT_SUCCESS);
+        }
+      close(fds[1]);
+      pipes[worker] = fdopen(fds[0], "r");
+    }
+
+  // a worker whose pipe fills waits for its turn here, it never holds up
+  // the one being read
+  for (int worker = 0; worker < jobs; worker++)
+    {
+      int status = 0;
+      read_results(pipes[worker], results, count);
+      fclose(pipes[worker]);
+      waitpid(workers[worker], &status, 0);
+      if (WIFSIGNALED(status))
+        {
+          fprintf(stderr, "Test worker %d killed by signal %d\n", worker,
+                  WTERMSIG(status));
+        }
+    }
+  return true;
+}
+
+// Print the results in registration order, return the number of tests that
+// failed or never reported
+static unsigned int
+report_results(const test_result *results, size_t count)
+{
+  unsigned int tests_failed = 0;
+  unsigned int asserts = 0;
+  unsigned int asserts_failed = 0;
+  CU_pSuite suite = NULL;
+
+  for (size_t i = 0; i < count; i++)
+    {
+      const test_result *result = &results[i];
+      if (suite != result->suite)
+        {
+          printf("Suite: %s\n", result->suite->pName);
+          suite = result->suite;
+        }
+      if (!result->done)
+        {
+          printf("  Test: %s ...NO RESULT, its worker died\n",
+                 result->test->pName);
+          tests_failed++;
+          continue;
+        }
+      printf("  Test: %s ...%s %.2f ms\n", result->test->pName,
+             result->failures == 0 ? "passed" : "FAILED",
+             result->micros / 1e3); // NOLINT
+      if (result->failure_text != NULL)
+        {
+          fputs(result->failure_text, stdout);
+        }
+      tests_failed += result->failures != 0;
+      asserts += result->asserts;
+      asserts_failed += result->failures;
+    }
+
+  printf("\nRun Summary: tests %zu failed %u asserts %u failed %u\n", count,
+         tests_failed, asserts, asserts_failed);
+  return tests_failed;
+}
+
+// The slowest few tests, the ones worth splitting or speeding up
+static void
+report_slowest(const test_result *results, size_t count)
+{
+  size_t slowest[SLOWEST_TESTS];
+  size_t found = 0;
+
+  while (found < SLOWEST_TESTS)
+    {
+      size_t pick = count;
+      for (size_t i = 0; i < count; i++)
+        {
+          bool taken = false;
+          for (size_t j = 0; j < found; j++)
+            {
+              taken = taken || slowest[j] == i;
+            }
+          if (!taken && results[i].done
+              && (pick == count || results[i].micros > results[pick].micros))
+            {
+              pick = i;
+            }
+        }
+      if (pick == count)
+        {
+          break;
+        }
+      slowest[found++] = pick;
+    }
+
+  printf("Slowest tests:\n");
+  for (size_t j = 0; j < found; j++)
+    {
+      printf("  %8.2f ms  %s\n", results[slowest[j]].micros / 1e3, // NOLINT
+             results[slowest[j]].test->pName);
+    }
+}
+
+static int
+run_tests(int jobs)
+{
+  CU_pTestRegistry registry = CU_get_registry();
+  size_t count = registry->uiNumberOfTests;
+  test_result *results = calloc(count, sizeof(test_result));
+  size_t next = 0;
+
+  if (results == NULL)
+    {
+      return EXIT_FAILURE;
+    }
+  for (CU_pSuite suite = registry->pSuite; suite != NULL;
+       suite = suite->pNext)
+    {
+      for (CU_pTest test = suite->pTest; test != NULL && next < count;
+           test = test->pNext)
+        {
+          results[next].suite = suite;
+          results[next].test = test;
+          next++;
+        }
+    }
+
+  if (jobs > (int)count)
+    {
+      jobs = (int)count;
+    }
+
+  double start = test_seconds_now();
+  if (jobs <= 1)
+    {
+      // straight through, with the results going through a temporary file
+      // so they are reported the same way
+      FILE *buffer = tmpfile();
+      if (buffer == NULL)
+        {
+          perror("tmpfile");
+          free(results);
+          return EXIT_FAILURE;
+        }
+      run_shard(results, count, 0, 1, buffer);
+      rewind(buffer);
+      read_results(buffer, results, count);
+      fclose(buffer);
+      jobs = 1;
+    }
+  else if (!run_workers(results, count, jobs))
+    {
+      free(results);
+      return EXIT_FAILURE;
+    }
+  double elapsed = test_seconds_now() - start;
+
+  unsigned int failed = report_results(results, count);
+  report_slowest(results, count);
+  printf("%zu tests in %.1f ms with %d worker%s\n", count,
+         elapsed * 1e3, jobs, jobs == 1 ? "" : "s"); // NOLINT
+
+  for (size_t i = 0; i < count; i++)
+    {
+      free(results[i].failure_text);
+    }
+  free(results);
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Parse a -j worker count, a whole decimal number from 1 to MAX_TEST_JOBS
+static bool
+parse_jobs(const char *arg, int *jobs)
+{
+  char *end = NULL;
+  long parsed = strtol(arg, &end, 10); // NOLINT
+
+  if (*arg == '\0' || *end != '\0' || parsed < 1 || parsed > MAX_TEST_JOBS)
+    {
+      return false;
+    }
+  *jobs = (int)parsed;
+  return true;
+}
+
 int
-main(void)
+main(int argc, char *argv[])
 {
   CU_pSuite pSuite = NULL;
+  int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:")) != -1)
+    {
+      if (opt != 'j')
+        {
+          fprintf(stderr, "Usage: %s [-j workers]\n", argv[0]);
+          return EXIT_FAILURE;
+        }
+      if (!parse_jobs(optarg, &jobs))
+        {
+          fprintf(stderr, "-j takes 1 to %d workers, not %s\n",
+                  MAX_TEST_JOBS, optarg);
+          return EXIT_FAILURE;
+        }
+    }
+  // the default comes from the CPU count, which may be out of range
+  if (jobs < 1)
+    {
+      jobs = 1;
+    }
+  if (jobs > MAX_TEST_JOBS)
+    {
+      jobs = MAX_TEST_JOBS;
+    }
 
   if (CUE_SUCCESS != CU_initialize_registry())
     {
@@ -3815,14 +5434,116 @@ main(void)
           == CU_add_test(pSuite, "test of test_opcode_0x85", test_opcode_0x85))
       || (NULL
           == CU_add_test(pSuite, "test of test_opcode_0x86",
-                         test_opcode_0x86)))
+                         test_opcode_0x86))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_input_queue_order()",
+                         test_input_queue_order))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_input_queue_full()",
+                         test_input_queue_full))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_input_apply()",
+                         test_input_apply))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_port_read_tracking()",
+                         test_port_read_tracking))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_player_row_watch()",
+                         test_player_row_watch))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_triple_buffer_latest()",
+                         test_triple_buffer_latest))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_triple_buffer_slots_disjoint()",
+                         test_triple_buffer_slots_disjoint))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_save_load_state()",
+                         test_save_load_state))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_load_state_writable_only()",
+                         test_load_state_writable_only))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_run_frame_timing()",
+                         test_run_frame_timing))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_state_hash()",
+                         test_state_hash))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_memory_map_invaders()",
+                         test_memory_map_invaders))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_register_pair_layout()",
+                         test_register_pair_layout))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_superinstruction_fusion()",
+                         test_superinstruction_fusion))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_lazy_flags_match_eager()",
+                         test_lazy_flags_match_eager))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_audio_mixer_timing()",
+                         test_audio_mixer_timing))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_sound_cache_shared()",
+                         test_sound_cache_shared))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_ufo_muted_frames()",
+                         test_ufo_muted_frames))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_load_rom_from_memory()",
+                         test_load_rom_from_memory))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_rom_set_mapped()",
+                         test_rom_set_mapped))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_opcode_table_matches_interpreter()",
+                         test_opcode_table_matches_interpreter))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_opcode_0x76()",
+                         test_opcode_0x76))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_opcode_0xcf()",
+                         test_opcode_0xcf))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_opcode_0xe2()",
+                         test_opcode_0xe2))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_opcode_0x98()",
+                         test_opcode_0x98))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_movie_round_trip()",
+                         test_movie_round_trip))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_add()", test_alu_add))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_adc()", test_alu_adc))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_sub()", test_alu_sub))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_sbb()", test_alu_sbb))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_ana()", test_alu_ana))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_xra()", test_alu_xra))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_ora()", test_alu_ora))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_cmp()", test_alu_cmp))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_inr()", test_alu_inr))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_dcr()", test_alu_dcr))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_alu_daa()", test_alu_daa))
+      || (NULL
+          == CU_add_test(pSuite, "test of test_vram_hash()",
+                         test_vram_hash)))
     {
       CU_cleanup_registry();
       return CU_get_error();
     }
 
-  CU_basic_set_mode(CU_BRM_VERBOSE);
-  CU_basic_run_tests();
+  int status = run_tests(jobs);
   CU_cleanup_registry();
-  return CU_get_error();
+  return status;
 }
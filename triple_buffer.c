@@ -0,0 +1,43 @@
+#include "triple_buffer.h"
+#include <string.h>
+
+#define SLOT_MASK 0x3
+#define FRESH 0x4
+
+void
+triple_buffer_init(triple_buffer *buffer)
+{
+  memset(buffer->slots, 0, sizeof(buffer->slots));
+  buffer->write = 0;
+  buffer->read = 2;
+  SDL_AtomicSet(&buffer->middle, 1);
+}
+
+// Slot the writer may fill, not visible to the reader until published
+vram_frame *
+triple_buffer_write_slot(triple_buffer *buffer)
+{
+  return &buffer->slots[buffer->write];
+}
+
+// Hand the filled slot to the reader and take back the shared one
+void
+triple_buffer_publish(triple_buffer *buffer)
+{
+  int previous = SDL_AtomicSet(&buffer->middle, buffer->write | FRESH);
+  buffer->write = previous & SLOT_MASK;
+}
+
+// Newest published frame, or NULL if nothing was published since last time
+const vram_frame *
+triple_buffer_acquire(triple_buffer *buffer)
+{
+  if ((SDL_AtomicGet(&buffer->middle) & FRESH) == 0)
+    {
+      return NULL;
+    }
+
+  int previous = SDL_AtomicSet(&buffer->middle, buffer->read);
+  buffer->read = previous & SLOT_MASK;
+  return &buffer->slots[buffer->read];
+}
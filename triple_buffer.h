@@ -0,0 +1,33 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include "emulator.h"
+
+// Snapshot of video memory for one emulated frame
+typedef struct
+{
+  uint8_t vram[VRAM_SIZE];
+  uint64_t frame;
+} vram_frame;
+
+/*
+Lock-free triple buffer between the emulation thread (writer) and the main
+thread that presents (reader). Each side owns one slot outright; the third is
+swapped in and out through a single atomic that also carries a "fresh" bit,
+so the writer never waits for the reader and the reader always sees the
+newest frame.
+*/
+typedef struct
+{
+  vram_frame slots[3];
+  int write;
+  int read;
+  SDL_atomic_t middle;
+} triple_buffer;
+
+void triple_buffer_init(triple_buffer *buffer);
+vram_frame *triple_buffer_write_slot(triple_buffer *buffer);
+void triple_buffer_publish(triple_buffer *buffer);
+const vram_frame *triple_buffer_acquire(triple_buffer *buffer);
+
+#endif